@@ -0,0 +1,390 @@
+#include "rtweekend.hpp"
+
+#include "benchmark.hpp"
+#include "bvh.hpp"
+#include "camera_rt2.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "instance.hpp"
+#include "material.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
+#include "sphere.hpp"
+#include "triangle_mesh.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 光线追踪热点路径的微基准测试
+// 用法: rtw_benchmark [--filter name] [--reps n] [--rep-ms ms] [--warmup-ms ms] [--json path] [--label text]
+// 每个测试的输入(光线、碰撞记录等)都提前生成好放在数组里，循环使用，
+// 这样测到的只有被测函数本身，不含生成输入的开销
+
+// 输入数组的长度，2的幂，循环取的时候用位与代替取模
+static const size_t input_count = 1024;
+static const size_t input_mask = input_count - 1;
+
+// 从半径为distance的球面上的随机点，射向[-spread, spread]^3立方体里的随机点
+// 物体放在原点附近时，大约一部分光线打中、一部分打不中，和真实渲染的情况接近
+static std::vector<ray> make_rays(double distance, double spread) {
+    std::vector<ray> rays;
+    for (size_t k = 0; k < input_count; k++) {
+        point3 origin = distance * random_unit_vector();
+        point3 target = vec3::random(-spread, spread);
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+static void bench_sphere_hit(bench_runner& runner) {
+    sphere s(point3(0, 0, 0), 1.0, nullptr);
+    auto rays = make_rays(5, 1.5);
+    runner.run("sphere::hit", "ray", [&](size_t n) {
+        hit_record rec;
+        size_t hits = 0;
+        for (size_t k = 0; k < n; k++)
+            hits += s.hit(rays[k & input_mask], interval(0.001, infinity), rec);
+        do_not_optimize(hits);
+    });
+}
+
+static void bench_hittable_list_hit(bench_runner& runner) {
+    for (int count : { 1, 4, 16, 64, 256, 1024 }) {
+        hittable_list world;
+        for (int k = 0; k < count; k++)
+            world.add(make_shared<sphere>(vec3::random(-10, 10), 0.5, nullptr));
+        auto rays = make_rays(30, 10);
+        runner.run("hittable_list::hit/" + std::to_string(count), "ray", [&](size_t n) {
+            hit_record rec;
+            size_t hits = 0;
+            for (size_t k = 0; k < n; k++)
+                hits += world.hit(rays[k & input_mask], interval(0.001, infinity), rec);
+            do_not_optimize(hits);
+        });
+    }
+}
+
+// 同一个球直接求交和包在实例里(平移、旋转、缩放)求交，差别就是每条光线变换进出物体空间的开销
+static void bench_instance_hit(bench_runner& runner) {
+    sphere s(point3(0, 0, 0), 1.0, nullptr);
+    instance placed(&s, affine_transform::translate(vec3(0.5, -0.25, 0)) * affine_transform::rotate(vec3(1, 1, 0), 30)
+        * affine_transform::scale(1.2));
+    auto rays = make_rays(5, 1.5);
+    runner.run("instance::hit", "ray", [&](size_t n) {
+        hit_record rec;
+        size_t hits = 0;
+        for (size_t k = 0; k < n; k++)
+            hits += placed.hit(rays[k & input_mask], interval(0.001, infinity), rec);
+        do_not_optimize(hits);
+    });
+}
+
+// 半径1的带起伏的球面网格，三角形个数约4 * segments^2
+static void bench_triangle_mesh_hit(bench_runner& runner) {
+    for (int segments : { 4, 32, 256 }) {
+        std::vector<float> positions;
+        std::vector<uint32_t> indices;
+        bumpy_sphere_mesh(segments, positions, indices);
+        triangle_mesh mesh(std::move(positions), std::move(indices), nullptr);
+        auto rays = make_rays(5, 1.5);
+        runner.run("triangle_mesh::hit/" + std::to_string(mesh.triangle_count()), "ray", [&](size_t n) {
+            hit_record rec;
+            size_t hits = 0;
+            for (size_t k = 0; k < n; k++)
+                hits += mesh.hit(rays[k & input_mask], interval(0.001, infinity), rec);
+            do_not_optimize(hits);
+        });
+    }
+}
+
+static void bench_sampling(bench_runner& runner) {
+    runner.run("random_double", "sample", [](size_t n) {
+        double sum = 0;
+        for (size_t k = 0; k < n; k++)
+            sum += random_double();
+        do_not_optimize(sum);
+    });
+    runner.run("random_unit_vector", "sample", [](size_t n) {
+        vec3 sum;
+        for (size_t k = 0; k < n; k++)
+            sum += random_unit_vector();
+        do_not_optimize(sum);
+    });
+    runner.run("random_in_unit_disk", "sample", [](size_t n) {
+        vec3 sum;
+        for (size_t k = 0; k < n; k++)
+            sum += random_in_unit_disk();
+        do_not_optimize(sum);
+    });
+    // 原来的拒绝采样版本，对比用
+    runner.run("random_unit_vector_rejection", "sample", [](size_t n) {
+        vec3 sum;
+        for (size_t k = 0; k < n; k++)
+            sum += random_unit_vector_rejection();
+        do_not_optimize(sum);
+    });
+    runner.run("random_in_unit_disk_rejection", "sample", [](size_t n) {
+        vec3 sum;
+        for (size_t k = 0; k < n; k++)
+            sum += random_in_unit_disk_rejection();
+        do_not_optimize(sum);
+    });
+
+    // 批量映射：随机数提前生成好，只测映射本身，每次处理input_count个
+    std::vector<real> u1(input_count), u2(input_count);
+    for (size_t k = 0; k < input_count; k++) {
+        u1[k] = real(random_double());
+        u2[k] = real(random_double());
+    }
+    std::vector<real> x(input_count), y(input_count), z(input_count);
+    runner.run("sample_unit_sphere", "sample", [&](size_t n) {
+        vec3 sum;
+        for (size_t k = 0; k < n; k++)
+            sum += sample_unit_sphere(u1[k & input_mask], u2[k & input_mask]);
+        do_not_optimize(sum);
+    });
+    runner.run("sample_unit_sphere_batch", "sample", [&](size_t n) {
+        for (size_t k = 0; k < n; k += input_count)
+            sample_unit_sphere_batch(u1.data(), u2.data(), std::min(input_count, n - k), x.data(), y.data(), z.data());
+        do_not_optimize(x[0]);
+    });
+    runner.run("sample_unit_disk", "sample", [&](size_t n) {
+        vec3 sum;
+        for (size_t k = 0; k < n; k++)
+            sum += sample_unit_disk(u1[k & input_mask], u2[k & input_mask]);
+        do_not_optimize(sum);
+    });
+    runner.run("sample_unit_disk_batch", "sample", [&](size_t n) {
+        for (size_t k = 0; k < n; k += input_count)
+            sample_unit_disk_batch(u1.data(), u2.data(), std::min(input_count, n - k), x.data(), y.data());
+        do_not_optimize(x[0]);
+    });
+}
+
+static void bench_scatter(bench_runner& runner) {
+    lambertian diffuse(color(0.5, 0.5, 0.5));
+    metal shiny(color(0.7, 0.6, 0.5), 0.0);
+    metal fuzzy(color(0.7, 0.6, 0.5), 0.3);
+    dielectric glass(1.5);
+
+    // 打在y=0平面上、法线朝上的碰撞记录，入射光线从上方各个方向射下来
+    std::vector<ray> incoming;
+    std::vector<hit_record> records;
+    for (size_t k = 0; k < input_count; k++) {
+        vec3 dir = random_unit_vector();
+        if (dir.y() > 0) dir = -dir;
+        ray r(point3(0, 1, 0) - dir, dir);
+        hit_record rec;
+        rec.t = 1;
+        rec.p = point3(0, 1, 0);
+        rec.set_face_normal(r, vec3(0, 1, 0));
+        incoming.push_back(r);
+        records.push_back(rec);
+    }
+
+    auto bench = [&](const std::string& name, const material& mat) {
+        runner.run(name, "ray", [&](size_t n) {
+            color attenuation;
+            ray scattered;
+            size_t count = 0;
+            for (size_t k = 0; k < n; k++)
+                count += mat.scatter(incoming[k & input_mask], records[k & input_mask], attenuation, scattered);
+            do_not_optimize(count);
+            do_not_optimize(scattered);
+        });
+    };
+    bench("lambertian::scatter", diffuse);
+    bench("metal::scatter", shiny);
+    bench("metal::scatter/fuzz", fuzzy);
+    bench("dielectric::scatter", glass);
+}
+
+// 同一个场景(main_16的随机小球场景)，求交和散射分别用两种分派方式(见dispatch_mode)
+// hit: 只做BVH遍历；scatter: 按场景里实际打中的顺序、几种材质交错的散射；
+// path: 完整的路径(求交 + 散射，最多弹射10次，不含相机和累加)
+// 场景按两种方式组织：grouped和main_16一样，小球按空间分组放进sphere_set；spheres是每个球一个物体，
+// 后者每个叶子要调用好几次hit，分派的开销占比更大
+static void bench_dispatch(bench_runner& runner) {
+    scene_data scene = random_spheres_scene();
+    material_table materials;
+    scene_arena arena;
+    hittable_list grouped;
+    build_scene_world(scene, materials, grouped, arena);
+    hittable_list spheres;
+    for (size_t k = 0; k < scene.sphere_count(); k++)
+        spheres.add(arena.make_shared<sphere>(point3(scene.cx[k], scene.cy[k], scene.cz[k]), scene.radius[k],
+            materials[scene.material[k]], int(k)));
+    bvh_node grouped_bvh(grouped);
+    bvh_node spheres_bvh(spheres);
+
+    camera_rt2 cam;
+    apply_scene_camera(scene.camera, cam);
+    cam.image_width = 400;
+    cam.prepare();
+    const int height = int(cam.image_width / cam.aspect_ratio);
+    std::vector<ray> rays;
+    for (size_t k = 0; k < input_count; k++)
+        rays.push_back(cam.primary_ray(int(random_double() * cam.image_width), int(random_double() * height)));
+
+    // 先求交一遍，取打中的碰撞记录作为散射的输入，材质的顺序就是场景里实际打中的顺序
+    std::vector<ray> incoming;
+    std::vector<hit_record> records;
+    for (size_t k = 0; records.size() < input_count; k++) {
+        hit_record rec;
+        const ray& r = rays[k & input_mask];
+        ray jittered(r.origin(), r.direction() + 0.01 * random_unit_vector());
+        if (grouped_bvh.hit(jittered, interval(0.001, infinity), rec)) {
+            incoming.push_back(jittered);
+            records.push_back(rec);
+        }
+    }
+
+    for (dispatch_mode mode : { dispatch_mode::closed_set, dispatch_mode::virtual_calls }) {
+        const std::string suffix = mode == dispatch_mode::closed_set ? "/closed" : "/virtual";
+        runner.run("dispatch::scatter" + suffix, "ray", [&](size_t n) {
+            rng_state& rng = thread_rng();
+            color attenuation;
+            ray scattered;
+            size_t count = 0;
+            for (size_t k = 0; k < n; k++) {
+                const hit_record& rec = records[k & input_mask];
+                count += scatter_material(*rec.mat, incoming[k & input_mask], rec, attenuation, scattered, rng, mode);
+            }
+            do_not_optimize(count);
+            do_not_optimize(scattered);
+        });
+    }
+
+    auto bench_world = [&](const std::string& world_name, bvh_node& bvh, dispatch_mode mode) {
+        const std::string suffix = world_name + (mode == dispatch_mode::closed_set ? "/closed" : "/virtual");
+        bvh.set_dispatch(mode);
+        runner.run("dispatch::hit/" + suffix, "ray", [&](size_t n) {
+            hit_record rec;
+            size_t hits = 0;
+            for (size_t k = 0; k < n; k++)
+                hits += bvh.hit(rays[k & input_mask], interval(0.001, infinity), rec);
+            do_not_optimize(hits);
+        });
+        runner.run("dispatch::path/" + suffix, "path", [&](size_t n) {
+            rng_state& rng = thread_rng();
+            color sum;
+            for (size_t k = 0; k < n; k++) {
+                ray current = rays[k & input_mask];
+                color throughput(1, 1, 1);
+                for (int depth = 0; depth < 10; depth++) {
+                    hit_record rec;
+                    if (!bvh.hit(current, interval(0.001, infinity), rec)) {
+                        sum += throughput;
+                        break;
+                    }
+                    color attenuation;
+                    ray scattered;
+                    if (!scatter_material(*rec.mat, current, rec, attenuation, scattered, rng, mode))
+                        break;
+                    throughput = throughput * attenuation;
+                    current = scattered;
+                }
+            }
+            do_not_optimize(sum);
+        });
+    };
+    for (dispatch_mode mode : { dispatch_mode::closed_set, dispatch_mode::virtual_calls })
+        bench_world("grouped", grouped_bvh, mode);
+    for (dispatch_mode mode : { dispatch_mode::closed_set, dispatch_mode::virtual_calls })
+        bench_world("spheres", spheres_bvh, mode);
+}
+
+static void bench_get_ray(bench_runner& runner) {
+    // 和main_16一样的相机参数
+    camera_rt2 cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 1200;
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+    cam.focus_dist = 10.0;
+
+    for (double angle : { 0.0, 0.6 }) {
+        cam.defocus_angle = angle;
+        cam.prepare();
+        std::string name = angle > 0 ? "camera_rt2::get_ray/defocus" : "camera_rt2::get_ray/pinhole";
+        runner.run(name, "ray", [&](size_t n) {
+            vec3 sum;
+            for (size_t k = 0; k < n; k++) {
+                ray r = cam.primary_ray(int(k % 1200), int((k / 1200) % 675));
+                sum += r.direction();
+            }
+            do_not_optimize(sum);
+        });
+    }
+}
+
+static void bench_write_color(bench_runner& runner) {
+    std::vector<color> pixels;
+    for (size_t k = 0; k < input_count; k++)
+        pixels.push_back(color::random());
+
+    runner.run("write_color", "pixel", [&](size_t n) {
+        std::ostringstream out;
+        for (size_t k = 0; k < n; k++)
+            write_color(out, pixels[k & input_mask]);
+        do_not_optimize(out.tellp());
+    });
+    // image_writer用的是不经过流的版本
+    runner.run("color_to_bytes", "pixel", [&](size_t n) {
+        unsigned char rgb[3];
+        unsigned sum = 0;
+        for (size_t k = 0; k < n; k++) {
+            color_to_bytes(pixels[k & input_mask], rgb);
+            sum += rgb[0] + rgb[1] + rgb[2];
+        }
+        do_not_optimize(sum);
+    });
+}
+
+int main(int argc, char* argv[]) {
+    bench_options options;
+    std::string json_path;
+    std::string label;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "--filter" && k + 1 < argc)
+            options.filter = argv[++k];
+        else if (arg == "--reps" && k + 1 < argc)
+            options.repetitions = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--rep-ms" && k + 1 < argc)
+            options.rep_ms = std::max(0.1, std::atof(argv[++k]));
+        else if (arg == "--warmup-ms" && k + 1 < argc)
+            options.warmup_ms = std::max(0.0, std::atof(argv[++k]));
+        else if (arg == "--json" && k + 1 < argc)
+            json_path = argv[++k];
+        else if (arg == "--label" && k + 1 < argc)
+            label = argv[++k];
+        else {
+            std::cerr << "Usage: " << argv[0]
+                << " [--filter name] [--reps n] [--rep-ms ms] [--warmup-ms ms] [--json path] [--label text]\n";
+            return 1;
+        }
+    }
+
+    // 固定种子，每次运行的输入都一样
+    seed_random(1);
+
+    bench_runner runner(options);
+    bench_runner::print_header();
+    bench_sphere_hit(runner);
+    bench_hittable_list_hit(runner);
+    bench_instance_hit(runner);
+    bench_triangle_mesh_hit(runner);
+    bench_sampling(runner);
+    bench_scatter(runner);
+    bench_dispatch(runner);
+    bench_get_ray(runner);
+    bench_write_color(runner);
+
+    if (!json_path.empty() && !runner.write_json(json_path, label))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "rtweekend.hpp"
+
+#include "bvh.hpp"
+#include "camera_rt2.hpp"
+#include "framebuffer.hpp"
+#include "hittable_list.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 采样器的收敛测试：在main_16的场景上，先用很多采样渲染一张参考图，
+// 再用各个采样器分别以1、2、4...个采样渲染，算出和参考图的均方根误差(RMSE)
+// 用法: convergence [--width n] [--ref-spp n] [--max-spp n] [--scene path] [--json path]
+// 伪随机采样的误差按spp^-1/2下降，表里的"random spp"是伪随机采样要达到同样的误差大约需要的采样数
+
+struct convergence_point {
+    std::string sampler;
+    int spp = 0;
+    double rmse = 0;
+    double seconds = 0;
+};
+
+static double rmse(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    for (int j = 0; j < a.height(); j++)
+        for (int i = 0; i < a.width(); i++) {
+            vec3 d = a.at(i, j) - b.at(i, j);
+            sum += double(d.length_squared()) / 3;
+        }
+    return std::sqrt(sum / (double(a.width()) * a.height()));
+}
+
+int main(int argc, char* argv[]) {
+    int width = 160;
+    int reference_spp = 2048;
+    int max_spp = 64;
+    std::string scene_path;
+    std::string json_path;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "--width" && k + 1 < argc)
+            width = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--ref-spp" && k + 1 < argc)
+            reference_spp = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--max-spp" && k + 1 < argc)
+            max_spp = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--scene" && k + 1 < argc)
+            scene_path = argv[++k];
+        else if (arg == "--json" && k + 1 < argc)
+            json_path = argv[++k];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--width n] [--ref-spp n] [--max-spp n] [--scene path] [--json path]\n";
+            return 1;
+        }
+    }
+
+    scene_data scene;
+    std::string error;
+    if (scene_path.empty())
+        scene = random_spheres_scene();
+    else if (!load_scene(scene_path, scene, error)) {
+        std::cerr << "Cannot load scene: " << error << "\n";
+        return 1;
+    }
+    material_table materials;
+    hittable_list world;
+    build_scene_world(scene, materials, world);
+    world = hittable_list(make_shared<bvh_node>(world));
+
+    camera_rt2 cam;
+    apply_scene_camera(scene.camera, cam);
+    cam.image_width = width;
+    cam.thread_count = 0;
+
+    // 渲染时相机的进度和统计输出关掉，只输出表格
+    std::ostringstream discard;
+    auto render = [&](sampler_type sampler, int spp, uint64_t seed, double& seconds) {
+        cam.sampler = sampler;
+        cam.samples_per_pixel = spp;
+        cam.seed = seed;
+        auto old = std::clog.rdbuf(discard.rdbuf());
+        stage_timer timer;
+        framebuffer image = cam.render_image(world);
+        seconds = 0;
+        timer.lap(seconds);
+        std::clog.rdbuf(old);
+        discard.str("");
+        return image;
+    };
+
+    // 参考图用伪随机采样和另一个种子，和被测的渲染互相独立
+    double reference_seconds;
+    std::clog << "Rendering reference at " << reference_spp << " spp..." << std::flush;
+    framebuffer reference = render(sampler_type::random, reference_spp, 0x5eed, reference_seconds);
+    std::clog << " " << reference_seconds << " s\n";
+
+    const char* names[] = { "random", "stratified", "sobol", "zsobol" };
+    std::vector<convergence_point> points;
+    std::printf("%-12s %6s %12s %10s %12s\n", "sampler", "spp", "rmse", "seconds", "random spp");
+    double random_error_at_1 = 0;
+    for (const char* name : names) {
+        sampler_type sampler = sampler_type::random;
+        parse_sampler_type(name, sampler);
+        for (int spp = 1; spp <= max_spp; spp *= 2) {
+            convergence_point p;
+            p.sampler = name;
+            p.spp = spp;
+            framebuffer image = render(sampler, spp, 0, p.seconds);
+            p.rmse = rmse(image, reference);
+            if (sampler == sampler_type::random && spp == 1)
+                random_error_at_1 = p.rmse;
+            // 伪随机采样误差是rmse(1)/sqrt(spp)，反推出同样误差需要的采样数
+            double equivalent = random_error_at_1 > 0 ? (random_error_at_1 / p.rmse) * (random_error_at_1 / p.rmse) : 0;
+            std::printf("%-12s %6d %12.6f %10.3f %12.1f\n", name, spp, p.rmse, p.seconds, equivalent);
+            std::fflush(stdout);
+            points.push_back(p);
+        }
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        out << "{\n  \"width\": " << width << ",\n  \"reference_spp\": " << reference_spp << ",\n  \"points\": [\n";
+        for (size_t k = 0; k < points.size(); k++) {
+            char line[256];
+            std::snprintf(line, sizeof(line), "    {\"sampler\": \"%s\", \"spp\": %d, \"rmse\": %.8f, \"seconds\": %.4f}%s\n",
+                points[k].sampler.c_str(), points[k].spp, points[k].rmse, points[k].seconds,
+                k + 1 < points.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+        if (!out) {
+            std::cerr << "Cannot write " << json_path << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
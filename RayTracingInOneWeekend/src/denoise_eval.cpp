@@ -0,0 +1,156 @@
+#include "rtweekend.hpp"
+
+#include "bvh.hpp"
+#include "camera_rt2.hpp"
+#include "denoise.hpp"
+#include "framebuffer.hpp"
+#include "hittable_list.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 降噪的效果测试：在main_16的场景上，先用很多采样渲染一张参考图，
+// 再分别以1、4、16、64...个采样渲染并降噪，算出降噪前后和参考图的均方根误差(RMSE)和各自的耗时
+// 用法: denoise_eval [--width n] [--ref-spp n] [--max-spp n] [--scene path] [--json path] [--max-rmse e]
+// 误差按spp^-1/2下降，表里的"equal spp"是不降噪时要达到降噪后的误差大约需要的采样数
+// 给了--max-rmse时，任何一档降噪后的误差超过e就返回1
+
+struct denoise_point {
+    int spp = 0;
+    double rmse_noisy = 0;
+    double rmse_denoised = 0;
+    double render_seconds = 0;
+    double denoise_seconds = 0;
+};
+
+static double rmse(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    for (int j = 0; j < a.height(); j++)
+        for (int i = 0; i < a.width(); i++) {
+            vec3 d = a.at(i, j) - b.at(i, j);
+            sum += double(d.length_squared()) / 3;
+        }
+    return std::sqrt(sum / (double(a.width()) * a.height()));
+}
+
+int main(int argc, char* argv[]) {
+    int width = 200;
+    int reference_spp = 1024;
+    int max_spp = 64;
+    double max_rmse = 0;
+    std::string scene_path;
+    std::string json_path;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "--width" && k + 1 < argc)
+            width = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--ref-spp" && k + 1 < argc)
+            reference_spp = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--max-spp" && k + 1 < argc)
+            max_spp = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--max-rmse" && k + 1 < argc)
+            max_rmse = std::atof(argv[++k]);
+        else if (arg == "--scene" && k + 1 < argc)
+            scene_path = argv[++k];
+        else if (arg == "--json" && k + 1 < argc)
+            json_path = argv[++k];
+        else {
+            std::cerr << "Usage: " << argv[0]
+                << " [--width n] [--ref-spp n] [--max-spp n] [--scene path] [--json path] [--max-rmse e]\n";
+            return 1;
+        }
+    }
+
+    scene_data scene;
+    std::string error;
+    if (scene_path.empty())
+        scene = random_spheres_scene();
+    else if (!load_scene(scene_path, scene, error)) {
+        std::cerr << "Cannot load scene: " << error << "\n";
+        return 1;
+    }
+    material_table materials;
+    hittable_list world;
+    build_scene_world(scene, materials, world);
+    world = hittable_list(make_shared<bvh_node>(world));
+
+    camera_rt2 cam;
+    apply_scene_camera(scene.camera, cam);
+    cam.image_width = width;
+    cam.thread_count = 0;
+
+    // 渲染时相机的进度和统计输出关掉，只输出表格
+    std::ostringstream discard;
+    auto render = [&](int spp, uint64_t seed, double& seconds) {
+        cam.samples_per_pixel = spp;
+        cam.seed = seed;
+        auto old = std::clog.rdbuf(discard.rdbuf());
+        stage_timer timer;
+        framebuffer image = cam.render_image(world);
+        seconds = 0;
+        timer.lap(seconds);
+        std::clog.rdbuf(old);
+        discard.str("");
+        return image;
+    };
+
+    // 参考图用另一个种子，和被测的渲染互相独立
+    double reference_seconds;
+    std::clog << "Rendering reference at " << reference_spp << " spp..." << std::flush;
+    framebuffer reference = render(reference_spp, 0x5eed, reference_seconds);
+    std::clog << " " << reference_seconds << " s\n";
+
+    // 被测的渲染收集引导特征，降噪单独计时
+    cam.collect_features = true;
+    denoise_settings settings;
+    std::vector<denoise_point> points;
+    bool within_limit = true;
+    std::printf("%6s %12s %12s %10s %10s %10s\n", "spp", "noisy rmse", "denoised", "render s", "denoise s", "equal spp");
+    for (int spp = 1; spp <= max_spp; spp *= 4) {
+        denoise_point p;
+        p.spp = spp;
+        framebuffer noisy = render(spp, 0, p.render_seconds);
+        stage_timer timer;
+        framebuffer denoised = denoise_image(noisy, cam.feature_guides(), settings);
+        timer.lap(p.denoise_seconds);
+        p.rmse_noisy = rmse(noisy, reference);
+        p.rmse_denoised = rmse(denoised, reference);
+        // 参考图本身也有噪声，降噪后的误差很小时这个数只是个下限
+        double ratio = p.rmse_noisy / p.rmse_denoised;
+        std::printf("%6d %12.6f %12.6f %10.3f %10.3f %10.1f\n", spp, p.rmse_noisy, p.rmse_denoised,
+            p.render_seconds, p.denoise_seconds, spp * ratio * ratio);
+        std::fflush(stdout);
+        if (max_rmse > 0 && p.rmse_denoised > max_rmse)
+            within_limit = false;
+        points.push_back(p);
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        out << "{\n  \"width\": " << width << ",\n  \"reference_spp\": " << reference_spp << ",\n  \"points\": [\n";
+        for (size_t k = 0; k < points.size(); k++) {
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                "    {\"spp\": %d, \"rmse_noisy\": %.8f, \"rmse_denoised\": %.8f, \"render_seconds\": %.4f, "
+                "\"denoise_seconds\": %.4f}%s\n",
+                points[k].spp, points[k].rmse_noisy, points[k].rmse_denoised, points[k].render_seconds,
+                points[k].denoise_seconds, k + 1 < points.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+        if (!out) {
+            std::cerr << "Cannot write " << json_path << "\n";
+            return 1;
+        }
+    }
+    if (!within_limit) {
+        std::cerr << "Denoised error exceeds " << max_rmse << "\n";
+        return 1;
+    }
+    return 0;
+}
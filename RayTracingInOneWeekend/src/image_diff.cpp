@@ -0,0 +1,97 @@
+#include "rtweekend.hpp"
+
+#include "framebuffer.hpp"
+#include "image_reader.hpp"
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// 比较两张同样大小的图像(比如双精度和单精度构建渲染的同一个场景)，输出误差统计
+// 用法: image_diff a.pfm b.pfm [-d diff_image] [-t threshold]
+// -d 输出误差图，每个像素是两张图对应像素差的绝对值，放大scale倍
+// -t 统计有多少像素的最大通道误差超过阈值
+int main(int argc, char* argv[]) {
+    std::string paths[2];
+    int path_count = 0;
+    std::string diff_path;
+    double threshold = 1.0 / 255;
+    double diff_scale = 10;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "-d" && k + 1 < argc)
+            diff_path = argv[++k];
+        else if (arg == "-t" && k + 1 < argc)
+            threshold = std::atof(argv[++k]);
+        else if (arg == "--scale" && k + 1 < argc)
+            diff_scale = std::atof(argv[++k]);
+        else if (path_count < 2 && !arg.empty() && arg[0] != '-')
+            paths[path_count++] = arg;
+        else {
+            path_count = 0;
+            break;
+        }
+    }
+    if (path_count != 2) {
+        std::cerr << "Usage: " << argv[0] << " a.(ppm|pfm) b.(ppm|pfm) [-d diff_image] [-t threshold] [--scale s]\n";
+        return 1;
+    }
+
+    framebuffer a, b;
+    std::string error;
+    if (!read_image(paths[0], a, error) || !read_image(paths[1], b, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    if (a.width() != b.width() || a.height() != b.height()) {
+        std::cerr << "Image sizes differ: " << a.width() << "x" << a.height()
+            << " vs " << b.width() << "x" << b.height() << "\n";
+        return 1;
+    }
+
+    const int w = a.width();
+    const int h = a.height();
+    framebuffer diff(w, h);
+    double sum_abs = 0, sum_sq = 0, max_abs = 0, peak = 0;
+    double mean_a = 0, mean_b = 0;
+    size_t over_threshold = 0;
+    for (int j = 0; j < h; j++) {
+        for (int i = 0; i < w; i++) {
+            const color& ca = a.at(i, j);
+            const color& cb = b.at(i, j);
+            double pixel_max = 0;
+            for (int c = 0; c < 3; c++) {
+                double d = std::fabs(double(ca[c]) - double(cb[c]));
+                sum_abs += d;
+                sum_sq += d * d;
+                pixel_max = std::max(pixel_max, d);
+                peak = std::max(peak, std::max(double(ca[c]), double(cb[c])));
+                diff.at(i, j)[c] = real(d * diff_scale);
+            }
+            max_abs = std::max(max_abs, pixel_max);
+            if (pixel_max > threshold)
+                over_threshold++;
+            mean_a += luminance(ca);
+            mean_b += luminance(cb);
+        }
+    }
+
+    const double samples = double(w) * h * 3;
+    const double rmse = std::sqrt(sum_sq / samples);
+    // PSNR以1.0为峰值(PPM读出来就在[0,1]，PFM是线性值，超过1的高光也按1算)
+    const double psnr = rmse > 0 ? 20 * std::log10(1.0 / rmse) : infinity;
+
+    std::cout << "Image:          " << w << "x" << h << "\n"
+        << "Mean luminance: " << mean_a / (double(w) * h) << " vs " << mean_b / (double(w) * h) << "\n"
+        << "Mean abs error: " << sum_abs / samples << "\n"
+        << "RMSE:           " << rmse << "\n"
+        << "Max abs error:  " << max_abs << " (peak value " << peak << ")\n"
+        << "PSNR:           " << psnr << " dB\n"
+        << "Pixels > " << threshold << ": " << over_threshold
+        << " (" << 100.0 * over_threshold / (double(w) * h) << "%)\n";
+
+    if (!diff_path.empty() && !write_image(diff, image_format_from_path(diff_path), diff_path))
+        return 1;
+    return 0;
+}
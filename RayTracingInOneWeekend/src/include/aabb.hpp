@@ -0,0 +1,122 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+// 轴对齐包围盒(axis-aligned bounding box)，由x,y,z三个轴上的区间(slab)组成
+class aabb {
+public:
+    // 三个轴上的区间
+    interval x, y, z;
+
+    // 默认是空包围盒，因为interval默认就是空区间
+    aabb() {}
+    // 直接用三个轴的区间构造
+    aabb(const interval& x, const interval& y, const interval& z)
+        : x(x), y(y), z(z) {
+        pad_to_minimums();
+    }
+    // 用两个点作为对角点构造包围盒，a,b不需要区分大小
+    aabb(const point3& a, const point3& b) {
+        x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+        pad_to_minimums();
+    }
+    // 构造能同时包住两个包围盒的最小包围盒
+    aabb(const aabb& box0, const aabb& box1) {
+        x = interval(box0.x, box1.x);
+        y = interval(box0.y, box1.y);
+        z = interval(box0.z, box1.z);
+    }
+
+    // 按下标取某个轴的区间，0是x，1是y，2是z
+    const interval& axis_interval(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    // slab法判断光线是否穿过包围盒
+    // 对每个轴求出光线进入和离开该轴区间的t，三个轴的t区间取交集，交集不为空则相交
+    bool hit(const ray& r, interval ray_t) const {
+        const point3& ray_orig = r.origin();
+        const vec3& ray_dir = r.direction();
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axis_interval(axis);
+            const real adinv = real(1) / ray_dir[axis];
+
+            auto t0 = (ax.min - ray_orig[axis]) * adinv;
+            auto t1 = (ax.max - ray_orig[axis]) * adinv;
+
+            if (t0 < t1) {
+                if (t0 > ray_t.min) ray_t.min = t0;
+                if (t1 < ray_t.max) ray_t.max = t1;
+            }
+            else {
+                if (t1 > ray_t.min) ray_t.min = t1;
+                if (t0 < ray_t.max) ray_t.max = t0;
+            }
+
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+
+    // 和上面一样的slab法，但方向的倒数由调用者提前算好
+    // BVH遍历时同一条光线要测很多个包围盒，提前算好倒数可以省掉每次的除法
+    bool hit(const point3& ray_orig, const vec3& inv_dir, interval ray_t) const {
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axis_interval(axis);
+            auto t0 = (ax.min - ray_orig[axis]) * inv_dir[axis];
+            auto t1 = (ax.max - ray_orig[axis]) * inv_dir[axis];
+            // 方向为负时t0会比t1大，交换一下
+            if (t0 > t1) std::swap(t0, t1);
+            ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+            ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+
+    // 返回包围盒最长的轴的下标
+    int longest_axis() const {
+        if (x.size() > y.size())
+            return x.size() > z.size() ? 0 : 2;
+        else
+            return y.size() > z.size() ? 1 : 2;
+    }
+
+    // 包围盒表面积，SAH(表面积启发式)用它来估计光线打中这个盒子的概率
+    double surface_area() const {
+        // 空包围盒的size是负数，面积视为0
+        if (x.size() < 0 || y.size() < 0 || z.size() < 0)
+            return 0;
+        auto dx = x.size();
+        auto dy = y.size();
+        auto dz = z.size();
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // 包围盒中心点，建BVH时用来给物体分桶
+    point3 centroid() const {
+        return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+    }
+
+    // 两个预定义的包围盒：空的和无限大的
+    static const aabb empty, universe;
+
+private:
+    // 防止某个轴的厚度太小(比如平面)，导致光线判断时出现数值问题
+    void pad_to_minimums() {
+        double delta = 0.0001;
+        if (x.size() < delta) x = x.expand(delta);
+        if (y.size() < delta) y = y.expand(delta);
+        if (z.size() < delta) z = z.expand(delta);
+    }
+};
+
+const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
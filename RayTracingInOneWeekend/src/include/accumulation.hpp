@@ -0,0 +1,252 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 渲染的累加缓冲：每个像素到目前为止所有采样的颜色之和、采样次数，以及自适应采样用的亮度均值和离差平方和
+// 像素的平均颜色到最后才算，所以渲染到一半时随时可以把累加缓冲存成检查点，
+// 之后从检查点接着加采样，不用从头开始(见camera_rt2的checkpoint_path和resume_path)
+//
+// 检查点文件(整数和浮点数按本机字节序直接写，只能在字节序相同的机器上续算)：文件头，然后是每个像素的[r和, g和, b和, 亮度均值, 离差平方和](5个double)，
+// 再是每个像素的采样次数(uint32)。颜色和都按double存，单精度版本读回来也是原样的值
+// 收集了第一次击中处的特征时(文件头flags的第0位)，后面再跟每个像素的
+// [反射率r, g, b, 法线x, y, z, 深度](7个double的和)、特征的采样次数(uint32)、材质编号和物体编号(各一个int32)
+// 亮度均值和离差平方和统计了所有采样时设置flags的第1位；没有这一位时读回来的均值和离差平方和作废，
+// 续算时从新的采样重新开始统计(固定采样数又不写检查点的渲染不统计它们)
+
+// 一个像素的累加值
+struct pixel_accumulator {
+    color sum = color(0, 0, 0); // 所有采样颜色之和
+    double mean = 0;            // 采样亮度的均值(Welford算法)
+    double m2 = 0;              // 采样亮度的离差平方和
+    int samples = 0;            // 已经采样的次数
+    int moment_samples = 0;     // mean和m2统计了几个采样，有的采样没有统计亮度时比samples少
+};
+
+// 一个像素各采样点第一次击中处的特征之和，给降噪做引导(见denoise.hpp)，也作为AOV输出
+// 没击中物体的采样，反射率按1、法线按0、深度按0算
+// 编号没法平均，取像素第一个采样击中的，没击中是-1
+struct pixel_features {
+    color albedo = color(0, 0, 0); // 表面反射率(material::feature_albedo)
+    vec3 normal = vec3(0, 0, 0);   // 表面法线
+    double depth = 0;              // 到相机的距离
+    int samples = 0;               // 累加了几个采样
+    int material_id = -1;          // 材质编号(material::id)
+    int object_id = -1;            // 物体编号(hit_record::object_id)
+};
+
+// 一个采样点第一次击中处的特征
+struct sample_features {
+    color albedo = color(1.0, 1.0, 1.0);
+    vec3 normal = vec3(0, 0, 0);
+    double depth = 0;
+    int material_id = -1;
+    int object_id = -1;
+};
+
+// 检查点文件头
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint32_t flags; // 第0位：带有第一次击中处的特征；第1位：亮度均值和离差平方和统计了所有采样
+    uint64_t key;   // 渲染设置和场景的摘要，和当前的不一致就不能接着渲染
+};
+
+static_assert(sizeof(checkpoint_header) == 32, "checkpoint_header is part of the checkpoint format");
+
+static const char checkpoint_magic[8] = { 'R', 'T', 'W', 'A', 'C', 'C', 'U', 'M' };
+static const uint32_t checkpoint_version = 1;
+static const uint32_t checkpoint_has_features = 1;
+static const uint32_t checkpoint_moments_valid = 2;
+
+class accumulation_buffer {
+public:
+    // 清空成width x height个没有采样的像素，with_features为true时同时准备好特征的累加
+    void reset(int width, int height, bool with_features = false) {
+        w = width;
+        h = height;
+        pixels.assign(size_t(width) * height, pixel_accumulator());
+        features.assign(with_features ? pixels.size() : 0, pixel_features());
+    }
+
+    bool has_features() const { return !features.empty(); }
+    pixel_features& features_at(int i, int j) { return features[size_t(j) * w + i]; }
+    const pixel_features& features_at(int i, int j) const { return features[size_t(j) * w + i]; }
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    pixel_accumulator& at(int i, int j) { return pixels[size_t(j) * w + i]; }
+    const pixel_accumulator& at(int i, int j) const { return pixels[size_t(j) * w + i]; }
+    const std::vector<pixel_accumulator>& data() const { return pixels; }
+
+    // 所有像素里最少的采样次数
+    int min_samples() const {
+        int lo = pixels.empty() ? 0 : pixels[0].samples;
+        for (const auto& p : pixels)
+            lo = std::min(lo, p.samples);
+        return lo;
+    }
+
+    // 所有像素的采样次数之和
+    uint64_t total_samples() const {
+        uint64_t total = 0;
+        for (const auto& p : pixels)
+            total += uint64_t(p.samples);
+        return total;
+    }
+
+    // 写检查点：先写到临时文件，写完再改名替换，写到一半被杀掉时原来的检查点还是完整的
+    bool save(const std::string& path, uint64_t key, std::string& error) const {
+        checkpoint_header header = {};
+        std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+        header.version = checkpoint_version;
+        header.width = w;
+        header.height = h;
+        header.flags = has_features() ? checkpoint_has_features : 0;
+        if (std::all_of(pixels.begin(), pixels.end(),
+                [](const pixel_accumulator& p) { return p.moment_samples == p.samples; }))
+            header.flags |= checkpoint_moments_valid;
+        header.key = key;
+
+        std::vector<double> values(pixels.size() * 5);
+        std::vector<uint32_t> counts(pixels.size());
+        for (size_t k = 0; k < pixels.size(); k++) {
+            const auto& p = pixels[k];
+            values[k * 5 + 0] = p.sum.x();
+            values[k * 5 + 1] = p.sum.y();
+            values[k * 5 + 2] = p.sum.z();
+            values[k * 5 + 3] = p.mean;
+            values[k * 5 + 4] = p.m2;
+            counts[k] = uint32_t(p.samples);
+        }
+
+        const std::string temp = path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(double)));
+            out.write(reinterpret_cast<const char*>(counts.data()), std::streamsize(counts.size() * sizeof(uint32_t)));
+            if (has_features()) {
+                std::vector<double> feature_values(features.size() * 7);
+                std::vector<int32_t> ids(features.size() * 2);
+                for (size_t k = 0; k < features.size(); k++) {
+                    const auto& f = features[k];
+                    double v[7] = { f.albedo.x(), f.albedo.y(), f.albedo.z(), f.normal.x(), f.normal.y(), f.normal.z(),
+                        f.depth };
+                    std::copy(v, v + 7, feature_values.begin() + k * 7);
+                    counts[k] = uint32_t(f.samples);
+                    ids[k * 2 + 0] = f.material_id;
+                    ids[k * 2 + 1] = f.object_id;
+                }
+                out.write(reinterpret_cast<const char*>(feature_values.data()),
+                    std::streamsize(feature_values.size() * sizeof(double)));
+                out.write(reinterpret_cast<const char*>(counts.data()), std::streamsize(counts.size() * sizeof(uint32_t)));
+                out.write(reinterpret_cast<const char*>(ids.data()), std::streamsize(ids.size() * sizeof(int32_t)));
+            }
+            out.flush();
+            if (!out) {
+                error = "cannot write " + temp;
+                return false;
+            }
+        }
+#ifdef _WIN32
+        // Windows的rename不能覆盖已有的文件
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temp.c_str(), path.c_str()) != 0) {
+            error = "cannot rename " + temp + " to " + path;
+            return false;
+        }
+        return true;
+    }
+
+    // 读检查点，大小和key要和当前的渲染一致
+    // with_features为true而检查点里没有特征时，特征从0开始累加(只包含之后的采样)
+    bool load(const std::string& path, int width, int height, uint64_t key, bool with_features, std::string& error) {
+        mapped_file file;
+        if (!file.open(path)) {
+            error = "cannot open " + path;
+            return false;
+        }
+        checkpoint_header header;
+        if (file.size() < sizeof(header)) {
+            error = "file is too small";
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0
+            || header.version != checkpoint_version) {
+            error = "not a checkpoint file";
+            return false;
+        }
+        if (header.width != width || header.height != height || header.key != key) {
+            error = "checkpoint was written with a different scene or render settings";
+            return false;
+        }
+        const size_t n = size_t(width) * height;
+        const bool stored_features = (header.flags & checkpoint_has_features) != 0;
+        const bool moments_valid = (header.flags & checkpoint_moments_valid) != 0;
+        const size_t feature_bytes = stored_features ? n * (7 * sizeof(double) + sizeof(uint32_t) + 2 * sizeof(int32_t)) : 0;
+        if (file.size() != sizeof(header) + n * (5 * sizeof(double) + sizeof(uint32_t)) + feature_bytes) {
+            error = "checkpoint is truncated";
+            return false;
+        }
+
+        reset(width, height, with_features);
+        const char* values = file.data() + sizeof(header);
+        const char* counts = values + n * 5 * sizeof(double);
+        for (size_t k = 0; k < n; k++) {
+            double v[5];
+            uint32_t count;
+            std::memcpy(v, values + k * 5 * sizeof(double), sizeof(v));
+            std::memcpy(&count, counts + k * sizeof(uint32_t), sizeof(count));
+            auto& p = pixels[k];
+            p.sum = color(v[0], v[1], v[2]);
+            p.samples = int(count);
+            if (moments_valid) {
+                p.mean = v[3];
+                p.m2 = v[4];
+                p.moment_samples = p.samples;
+            }
+        }
+        if (stored_features && with_features) {
+            const char* feature_values = counts + n * sizeof(uint32_t);
+            const char* feature_counts = feature_values + n * 7 * sizeof(double);
+            const char* feature_ids = feature_counts + n * sizeof(uint32_t);
+            for (size_t k = 0; k < n; k++) {
+                double v[7];
+                uint32_t count;
+                int32_t ids[2];
+                std::memcpy(v, feature_values + k * 7 * sizeof(double), sizeof(v));
+                std::memcpy(&count, feature_counts + k * sizeof(uint32_t), sizeof(count));
+                std::memcpy(ids, feature_ids + k * sizeof(ids), sizeof(ids));
+                auto& f = features[k];
+                f.albedo = color(v[0], v[1], v[2]);
+                f.normal = vec3(v[3], v[4], v[5]);
+                f.depth = v[6];
+                f.samples = int(count);
+                f.material_id = ids[0];
+                f.object_id = ids[1];
+            }
+        }
+        return true;
+    }
+
+private:
+    int w = 0;
+    int h = 0;
+    std::vector<pixel_accumulator> pixels;
+    std::vector<pixel_features> features;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "accumulation.hpp"
+#include "framebuffer.hpp"
+#include "hash.hpp"
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// 输出变量(AOV, arbitrary output variables)：和颜色同一遍渲染顺带收集的辅助图像，给后期合成用
+// 数据就是累加缓冲里每个像素第一次击中处的特征(见accumulation.hpp的pixel_features)，另加每个像素的采样次数
+//
+// 每个AOV写成输出图像旁边的一个文件：out.pfm -> out.depth.pfm、out.normal.pfm ...
+// PFM里存原始值(深度是到相机的距离，法线各分量在[-1, 1]，编号原样存在三个通道里，没击中是-1)；
+// P6只有8位，深度和采样次数按最大值归一化，法线按(n + 1) / 2映射到[0, 1]，编号按哈希换成颜色
+// (写出时和颜色图一样会经过gamma)
+
+// 一张AOV图像
+struct aov_layer {
+    std::string name;
+    framebuffer image;
+};
+
+// AOV的文件路径：输出图像的路径去掉后缀，加上".名字"和格式对应的后缀
+inline std::string aov_path(const std::string& output_path, const std::string& name, image_format format) {
+    std::string base = output_path;
+    size_t dot = base.find_last_of('.');
+    size_t slash = base.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        base.erase(dot);
+    return base + "." + name + (format == image_format::pfm ? ".pfm" : ".ppm");
+}
+
+// 8位格式里编号的颜色：相邻的编号颜色差得很远，没击中(-1)是黑色
+inline color id_color(int id) {
+    if (id < 0)
+        return color(0, 0, 0);
+    uint64_t h = mix_bits(uint64_t(id) + 1);
+    return color(0.2 + 0.8 * double(h & 0xff) / 255, 0.2 + 0.8 * double((h >> 8) & 0xff) / 255,
+        0.2 + 0.8 * double((h >> 16) & 0xff) / 255);
+}
+
+// 从累加缓冲做出所有AOV图像，format是要写出的格式(决定存原始值还是映射到[0, 1])
+// 累加缓冲需要带着特征(accumulation_buffer::has_features)
+inline std::vector<aov_layer> make_aov_layers(const accumulation_buffer& accum, image_format format) {
+    const int w = accum.width();
+    const int h = accum.height();
+    const bool raw = format == image_format::pfm;
+    framebuffer depth(w, h), normal(w, h), albedo(w, h), material_id(w, h), object_id(w, h), samples(w, h);
+
+    double max_depth = 0;
+    int max_samples = 0;
+    for (int j = 0; j < h; j++)
+        for (int i = 0; i < w; i++) {
+            const pixel_features& f = accum.features_at(i, j);
+            if (f.samples > 0)
+                max_depth = std::max(max_depth, f.depth / f.samples);
+            max_samples = std::max(max_samples, accum.at(i, j).samples);
+        }
+    const double depth_scale = raw || max_depth <= 0 ? 1.0 : 1.0 / max_depth;
+    const double sample_scale = raw || max_samples <= 0 ? 1.0 : 1.0 / max_samples;
+
+    for (int j = 0; j < h; j++)
+        for (int i = 0; i < w; i++) {
+            const pixel_features& f = accum.features_at(i, j);
+            if (f.samples > 0) {
+                double d = depth_scale * f.depth / f.samples;
+                depth.at(i, j) = color(d, d, d);
+                vec3 n = f.normal / f.samples;
+                if (n.length_squared() > 0)
+                    n = unit_vector(n);
+                normal.at(i, j) = raw ? n : 0.5 * (n + vec3(1, 1, 1));
+                albedo.at(i, j) = f.albedo / f.samples;
+            }
+            material_id.at(i, j) = raw ? color(f.material_id, f.material_id, f.material_id) : id_color(f.material_id);
+            object_id.at(i, j) = raw ? color(f.object_id, f.object_id, f.object_id) : id_color(f.object_id);
+            double s = sample_scale * accum.at(i, j).samples;
+            samples.at(i, j) = color(s, s, s);
+        }
+
+    std::vector<aov_layer> layers;
+    layers.push_back({ "depth", std::move(depth) });
+    layers.push_back({ "normal", std::move(normal) });
+    layers.push_back({ "albedo", std::move(albedo) });
+    layers.push_back({ "material_id", std::move(material_id) });
+    layers.push_back({ "object_id", std::move(object_id) });
+    layers.push_back({ "spp", std::move(samples) });
+    return layers;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// 微基准测试的小框架
+// 每个测试是一个fn(n)，执行n次被测操作；框架先预热并估计单次耗时，
+// 再定出每轮的次数n让一轮大约跑rep_ms毫秒，重复repetitions轮，统计每次操作的纳秒数
+
+// 防止编译器把算出来但没用到的结果整个优化掉
+template <class T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile char sink;
+    sink = *reinterpret_cast<const volatile char*>(&value);
+#endif
+}
+
+// 一个测试的结果，时间都是每次操作的纳秒数
+struct bench_result {
+    std::string name;
+    std::string unit;        // 一次操作是什么，比如"ray"、"sample"、"pixel"
+    size_t ops_per_rep = 0;  // 每轮执行多少次操作
+    int repetitions = 0;
+    double ns_median = 0;
+    double ns_mean = 0;
+    double ns_min = 0;
+    double ns_stddev = 0;
+    // 每秒多少次操作(按中位数算)，单位是ray时就是每秒光线数
+    double ops_per_sec() const { return ns_median > 0 ? 1e9 / ns_median : 0; }
+};
+
+struct bench_options {
+    double warmup_ms = 50;  // 每个测试先预热这么久，同时估计单次耗时
+    double rep_ms = 20;     // 每轮的目标时长
+    int repetitions = 15;   // 重复多少轮
+    std::string filter;     // 只跑名字里包含这个字符串的测试，为空则全跑
+};
+
+class bench_runner {
+public:
+    explicit bench_runner(const bench_options& options) : options(options) {}
+
+    // 运行一个测试，fn(n)执行n次被测操作
+    template <class F>
+    void run(const std::string& name, const std::string& unit, F&& fn) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+
+        // 预热：次数从1开始翻倍，直到一次调用的时间够长，能可靠地估计单次耗时
+        size_t n = 1;
+        double elapsed_ms = 0;
+        double warmup_total = 0;
+        while (true) {
+            elapsed_ms = time_ms(fn, n);
+            warmup_total += elapsed_ms;
+            if (elapsed_ms >= options.rep_ms / 4 && warmup_total >= options.warmup_ms)
+                break;
+            if (elapsed_ms < options.rep_ms / 4)
+                n *= 2;
+        }
+        size_t ops = std::max<size_t>(1, size_t(double(n) * options.rep_ms / elapsed_ms));
+
+        std::vector<double> samples;
+        for (int rep = 0; rep < options.repetitions; rep++)
+            samples.push_back(time_ms(fn, ops) * 1e6 / double(ops));
+
+        bench_result result;
+        result.name = name;
+        result.unit = unit;
+        result.ops_per_rep = ops;
+        result.repetitions = options.repetitions;
+        std::sort(samples.begin(), samples.end());
+        size_t mid = samples.size() / 2;
+        result.ns_median = samples.size() % 2 ? samples[mid] : 0.5 * (samples[mid - 1] + samples[mid]);
+        result.ns_min = samples.front();
+        for (double s : samples) result.ns_mean += s;
+        result.ns_mean /= double(samples.size());
+        for (double s : samples) result.ns_stddev += (s - result.ns_mean) * (s - result.ns_mean);
+        result.ns_stddev = samples.size() > 1 ? std::sqrt(result.ns_stddev / double(samples.size() - 1)) : 0;
+
+        print(result);
+        all.push_back(result);
+    }
+
+    const std::vector<bench_result>& results() const { return all; }
+
+    // 表头，和print的列对齐
+    static void print_header() {
+        std::printf("%-36s %12s %10s %10s %18s\n", "benchmark", "ns/op", "+-stddev", "min", "throughput");
+    }
+
+    // 把所有结果写成JSON，label用来区分不同的提交或配置
+    bool write_json(const std::string& path, const std::string& label) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot open " << path << " for writing\n";
+            return false;
+        }
+        out << "{\n";
+        out << "  \"label\": \"" << escape(label) << "\",\n";
+        out << "  \"precision\": \"" << (std::is_same<real, float>::value ? "float" : "double") << "\",\n";
+        out << "  \"compiler\": \"" << escape(compiler_name()) << "\",\n";
+        out << "  \"repetitions\": " << options.repetitions << ",\n";
+        out << "  \"benchmarks\": [\n";
+        for (size_t k = 0; k < all.size(); k++) {
+            const auto& r = all[k];
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                "    {\"name\": \"%s\", \"unit\": \"%s\", \"ops_per_rep\": %zu, "
+                "\"ns_median\": %.4f, \"ns_mean\": %.4f, \"ns_min\": %.4f, \"ns_stddev\": %.4f, "
+                "\"ops_per_sec\": %.1f}%s\n",
+                escape(r.name).c_str(), escape(r.unit).c_str(), r.ops_per_rep,
+                r.ns_median, r.ns_mean, r.ns_min, r.ns_stddev, r.ops_per_sec(),
+                k + 1 < all.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+        return bool(out);
+    }
+
+private:
+    bench_options options;
+    std::vector<bench_result> all;
+
+    template <class F>
+    static double time_ms(F& fn, size_t n) {
+        auto start = std::chrono::steady_clock::now();
+        fn(n);
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    static void print(const bench_result& r) {
+        char throughput[32];
+        std::snprintf(throughput, sizeof(throughput), "%.2f M%s/s", r.ops_per_sec() / 1e6, r.unit.c_str());
+        std::printf("%-36s %12.3f %10.3f %10.3f %18s\n",
+            r.name.c_str(), r.ns_median, r.ns_stddev, r.ns_min, throughput);
+        std::fflush(stdout);
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') out.push_back('\\');
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    static std::string compiler_name() {
+#if defined(__clang__)
+        return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+        return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+        return "msvc " + std::to_string(_MSC_VER);
+#else
+        return "unknown";
+#endif
+    }
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "aabb.hpp"
+#include "bvh_stats.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "primitive_dispatch.hpp"
+#include "render_stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// 层次包围盒(bounding volume hierarchy)
+// 用SAH(表面积启发式)把物体递归地分成两堆，光线先测包围盒，没打中包围盒的那一整堆物体都不用测了
+// 构建完后节点按深度优先顺序平铺在一个数组里，遍历时不用递归，也不用追指针
+// 它本身也是一个hittable，所以可以直接替换掉hittable_list传给camera_rt2::render
+class bvh_node : public hittable {
+public:
+    // 用场景里的物体列表构建BVH，stats不为空时写入构建统计
+    bvh_node(const hittable_list& list, bvh_stats* stats = nullptr)
+        : bvh_node(list.objects, stats) {}
+
+    bvh_node(const std::vector<shared_ptr<hittable>>& src_objects, bvh_stats* stats = nullptr) {
+        auto start = std::chrono::steady_clock::now();
+
+        objects = src_objects;
+        // 先把每个物体的包围盒和中心点算好，构建时会反复用到
+        std::vector<build_item> items(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            items[i].box = objects[i]->bounding_box();
+            items[i].centroid = items[i].box.centroid();
+            items[i].index = i;
+        }
+
+        bvh_stats local;
+        local.primitive_count = objects.size();
+        // n个物体的二叉树最多2n-1个节点
+        nodes.reserve(objects.empty() ? 1 : 2 * objects.size() - 1);
+        nodes.emplace_back();
+        build(0, items, 0, items.size(), 1, local);
+
+        // 按构建后的顺序重新排列物体，这样每个叶子对应objects里连续的一段
+        std::vector<shared_ptr<hittable>> ordered(objects.size());
+        for (size_t i = 0; i < items.size(); i++)
+            ordered[i] = objects[items[i].index];
+        objects.swap(ordered);
+        // 每个物体的类型标记，和objects一一对应，遍历时按它分派(见primitive_dispatch.hpp)
+        kinds.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); i++)
+            kinds[i] = primitive_kind_of(*objects[i]);
+
+        local.node_count = nodes.size();
+        local.build_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        build_stats = local;
+        if (stats)
+            *stats = local;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (dispatch == dispatch_mode::closed_set)
+            return traverse<dispatch_mode::closed_set>(r, ray_t, rec);
+        return traverse<dispatch_mode::virtual_calls>(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override {
+        return nodes.empty() ? aabb::empty : nodes[0].bbox;
+    }
+
+    // 构建统计
+    const bvh_stats& stats() const { return build_stats; }
+
+    // 叶子里物体求交的分派方式，默认按类型标记分派
+    void set_dispatch(dispatch_mode mode) { dispatch = mode; }
+    dispatch_mode dispatch_method() const { return dispatch; }
+
+private:
+    // 遍历，Mode在编译期决定叶子里的调用方式，两种方式各生成一份循环
+    template <dispatch_mode Mode>
+    bool traverse(const ray& r, interval ray_t, hit_record& rec) const {
+        if (objects.empty())
+            return false;
+
+        // 方向的倒数，每个包围盒测试都要用，只算一次
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+        // 方向分量是否为负，用来决定先走哪个子节点
+        bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        bool hit_anything = false;
+        // 用显式的栈代替递归，SAH部分最多64层，之后的中位数分割最多再加32层
+        int stack[128];
+        int stack_size = 0;
+        int current = 0;
+
+        while (true) {
+            const flat_node& node = nodes[current];
+            RTW_STAT(thread_stats().bvh_node_tests++);
+            if (node.bbox.hit(orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    // 叶子：逐个测试里面的物体，打中就缩小ray_t.max，后面只找更近的
+                    for (int i = 0; i < node.count; i++) {
+                        const size_t k = size_t(node.offset + i);
+                        bool hit = Mode == dispatch_mode::closed_set
+                            ? hit_primitive(kinds[k], *objects[k], r, ray_t, rec)
+                            : objects[k]->hit(r, ray_t, rec);
+                        if (hit) {
+                            hit_anything = true;
+                            ray_t.max = rec.t;
+                        }
+                    }
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                }
+                else {
+                    // 内部节点：沿光线方向先走近的子节点，远的压栈
+                    // 左子节点总是紧跟在父节点后面，右子节点的下标存在offset里
+                    if (dir_is_neg[node.axis]) {
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                    }
+                    else {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                    }
+                }
+            }
+            else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        return hit_anything;
+    }
+
+    // 平铺的节点
+    // count > 0 是叶子，offset是叶子里第一个物体在objects里的下标
+    // count == 0 是内部节点，左子节点是当前下标+1，offset是右子节点的下标，axis是分割轴
+    struct flat_node {
+        aabb bbox;
+        int offset = 0;
+        int count = 0;
+        int axis = 0;
+    };
+
+    // 构建时用的临时数据
+    struct build_item {
+        aabb box;
+        point3 centroid;
+        size_t index;
+    };
+
+    // SAH分桶
+    struct bucket {
+        int count = 0;
+        aabb bbox;
+    };
+
+    static constexpr int bucket_count = 12;        // 每个轴上的桶数
+    static constexpr int max_leaf_size = 4;        // 叶子最多放几个物体
+    static constexpr double traversal_cost = 0.125; // 相对于测一次物体，走一个节点的代价
+    static constexpr int max_sah_depth = 64;       // 超过这个深度后只用中位数分割，保证树高不超过遍历栈大小
+
+    std::vector<flat_node> nodes;
+    std::vector<shared_ptr<hittable>> objects;
+    std::vector<primitive_kind> kinds; // objects里每个物体的类型标记
+    dispatch_mode dispatch = dispatch_mode::closed_set;
+    bvh_stats build_stats;
+
+    // 递归构建[start, end)范围内的物体，结果写到nodes[node_index]
+    void build(size_t node_index, std::vector<build_item>& items, size_t start, size_t end,
+        int depth, bvh_stats& st) {
+        // 这一段物体的整体包围盒，以及中心点的包围盒(用来分桶)
+        aabb bounds, centroid_bounds;
+        for (size_t i = start; i < end; i++) {
+            bounds = aabb(bounds, items[i].box);
+            centroid_bounds = aabb(centroid_bounds, aabb(items[i].centroid, items[i].centroid));
+        }
+        nodes[node_index].bbox = bounds;
+        if (depth > st.max_depth)
+            st.max_depth = depth;
+
+        size_t n = end - start;
+        int axis = centroid_bounds.longest_axis();
+        const interval& ax = centroid_bounds.axis_interval(axis);
+
+        // 只有一个物体，直接做成叶子
+        if (n <= 1) {
+            make_leaf(node_index, start, n, st);
+            return;
+        }
+
+        size_t mid = start + n / 2;
+        if (n <= max_leaf_size) {
+            // 少量物体时，比较一下分开和不分开哪个代价更小，中心点全挤在一起分不开时也做成叶子
+            if (!split_by_sah(items, start, end, bounds, ax, axis, mid, true)) {
+                make_leaf(node_index, start, n, st);
+                return;
+            }
+        }
+        else if (depth >= max_sah_depth || !split_by_sah(items, start, end, bounds, ax, axis, mid, false)) {
+            // SAH找不到好的分割，或者树已经太深(遍历栈大小有限)，按中位数分
+            std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+                [axis](const build_item& a, const build_item& b) {
+                    return a.centroid[axis] < b.centroid[axis];
+                });
+        }
+
+        // 左子节点紧挨着父节点，右子节点在整棵左子树之后
+        nodes[node_index].axis = axis;
+        nodes[node_index].count = 0;
+        size_t left = nodes.size();
+        nodes.emplace_back();
+        build(left, items, start, mid, depth + 1, st);
+        size_t right = nodes.size();
+        nodes.emplace_back();
+        nodes[node_index].offset = int(right);
+        build(right, items, mid, end, depth + 1, st);
+    }
+
+    void make_leaf(size_t node_index, size_t start, size_t n, bvh_stats& st) {
+        nodes[node_index].offset = int(start);
+        nodes[node_index].count = int(n);
+        st.leaf_count++;
+    }
+
+    // 在axis轴上按中心点把物体分到桶里，枚举每个桶边界作为分割面，求SAH代价最小的那个
+    // SAH代价 = 遍历代价 + (左包围盒面积*左物体数 + 右包围盒面积*右物体数) / 父包围盒面积
+    // 成功时按分割面重排items，mid是分割的位置
+    // allow_leaf为true时，如果不分割(做成叶子)的代价更低则返回false
+    bool split_by_sah(std::vector<build_item>& items, size_t start, size_t end,
+        const aabb& bounds, const interval& ax, int axis, size_t& mid, bool allow_leaf) const {
+        bucket buckets[bucket_count];
+        auto bucket_of = [&](const build_item& item) {
+            int b = int(bucket_count * ((item.centroid[axis] - ax.min) / ax.size()));
+            return b < bucket_count ? b : bucket_count - 1;
+        };
+        for (size_t i = start; i < end; i++) {
+            auto& b = buckets[bucket_of(items[i])];
+            b.count++;
+            b.bbox = aabb(b.bbox, items[i].box);
+        }
+
+        // 从右往左扫一遍，记录每个分割面右边的面积和数量
+        double right_area[bucket_count - 1];
+        int right_count[bucket_count - 1];
+        aabb acc;
+        int cnt = 0;
+        for (int i = bucket_count - 1; i > 0; i--) {
+            acc = aabb(acc, buckets[i].bbox);
+            cnt += buckets[i].count;
+            right_area[i - 1] = acc.surface_area();
+            right_count[i - 1] = cnt;
+        }
+
+        // 从左往右扫一遍，同时算出代价
+        double best_cost = infinity;
+        int best_split = -1;
+        acc = aabb();
+        cnt = 0;
+        for (int i = 0; i < bucket_count - 1; i++) {
+            acc = aabb(acc, buckets[i].bbox);
+            cnt += buckets[i].count;
+            if (cnt == 0 || right_count[i] == 0)
+                continue;
+            double cost = cnt * acc.surface_area() + right_count[i] * right_area[i];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = i;
+            }
+        }
+        if (best_split < 0)
+            return false;
+
+        double parent_area = bounds.surface_area();
+        best_cost = traversal_cost + (parent_area > 0 ? best_cost / parent_area : 0);
+        if (allow_leaf && best_cost >= double(end - start))
+            return false;
+
+        auto it = std::partition(items.begin() + start, items.begin() + end,
+            [&](const build_item& item) { return bucket_of(item) <= best_split; });
+        mid = size_t(it - items.begin());
+        return mid != start && mid != end;
+    }
+};
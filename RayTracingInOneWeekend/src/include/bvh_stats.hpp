@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+// BVH构建后的统计信息
+// 单独放一个头文件：bvh_node和三角形网格自己的BVH都用它，bvh.hpp又要包含三角形网格(见primitive_dispatch.hpp)
+struct bvh_stats {
+    size_t primitive_count = 0; // 物体个数
+    size_t node_count = 0;      // 节点总数(含叶子)
+    size_t leaf_count = 0;      // 叶子节点个数
+    int max_depth = 0;          // 树的最大深度
+    double build_ms = 0;        // 构建耗时(毫秒)
+};
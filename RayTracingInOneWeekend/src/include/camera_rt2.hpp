@@ -2,8 +2,69 @@
 
 #include "rtweekend.hpp"
 
+#include "accumulation.hpp"
+#include "aov.hpp"
+#include "denoise.hpp"
+#include "framebuffer.hpp"
 #include "hittable.hpp"
+#include "image_writer.hpp"
 #include "material.hpp"
+#include "render_stats.hpp"
+#include "tile_scheduler.hpp"
+#include "wavefront.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 路径追踪的积分器
+enum class integrator_type {
+    recursive, // 递归：每次弹射递归调用一次ray_color，直到最大深度
+    iterative  // 迭代：循环里累乘通量(throughput)，并用俄罗斯轮盘赌提前结束贡献很小的路径
+};
+
+// 按名字(recursive/iterative)取积分器，不认识的名字返回false
+inline bool parse_integrator_type(const std::string& name, integrator_type& type) {
+    if (name == "recursive") type = integrator_type::recursive;
+    else if (name == "iterative") type = integrator_type::iterative;
+    else return false;
+    return true;
+}
+
+// 渲染引擎
+enum class render_engine {
+    megakernel, // 逐像素、逐条路径追踪到底(render_pixel)
+    wavefront   // 波前式：一批路径按阶段整批推进(render_wavefront)
+};
+
+// 渲染过程中路径的统计，每个线程各自累加，最后合并
+struct path_counters {
+    uint64_t paths = 0;         // 追踪的路径数(即采样点数)
+    uint64_t segments = 0;      // 追踪的光线段数(每段都要和场景求一次交)
+    uint64_t rr_terminated = 0; // 被俄罗斯轮盘赌结束的路径数
+
+    path_counters& operator+=(const path_counters& o) {
+        paths += o.paths;
+        segments += o.segments;
+        rr_terminated += o.rr_terminated;
+        return *this;
+    }
+};
+
+// 逐像素渲染路径的编译期配置
+// render_pixel、get_ray、ray_color、trace_path都按它实例化，关掉的功能在内层循环里连判断都没有；
+// 渲染前按camera_rt2的设置选出对应的实例(见camera_rt2::select_pixel_renderer)
+template <bool Defocus, bool Features, bool Adaptive, bool Iterative, int MaxDepth>
+struct render_config {
+    static constexpr bool defocus = Defocus;     // 景深：光线从失焦圆盘上的随机点发出，否则从相机中心发出
+    static constexpr bool features = Features;   // 收集第一次击中处的特征(降噪、AOV)
+    static constexpr bool adaptive = Adaptive;   // 采样数的类别：自适应(收敛就提前停)，否则每个像素采固定的次数
+    static constexpr bool iterative = Iterative; // 迭代积分器，否则递归
+    static constexpr int max_depth = MaxDepth;   // 最大弹射次数，0表示不是常用值，用运行时的camera_rt2::max_depth
+};
 
 class camera_rt2 {
 public:
@@ -18,29 +79,232 @@ public:
     double defocus_angle = 0;  // 失焦的角度(类似fov角)
     double focus_dist = 10;    // 从相机中心到焦距所在平面的距离
 
+    int thread_count = 1;      // 渲染线程数，1是单线程逐行渲染，0表示使用全部硬件线程
+    int tile_size = 16;        // 多线程渲染时，分块的边长(像素)
+    uint64_t seed = 0;         // 随机数种子，种子相同时，不管用几个线程渲染，结果都完全一样
+    rng_mode random_mode = rng_mode::stream; // 随机数模式，counter模式下每次弹射的随机数只由(像素,采样,弹射次数)决定
+    sampler_type sampler = sampler_type::random; // 像素抖动、镜头位置和散射方向的采样器
+
+    image_format output_format = image_format::ppm_ascii; // 输出图像的格式
+    std::string output_path;   // 输出图像的文件路径，为空时写到标准输出
+
+    // 自适应采样：每个像素至少采min_samples次，之后根据样本亮度的方差估计误差，
+    // 误差足够小就提前停止，最多采samples_per_pixel次
+    bool adaptive_sampling = false;
+    int min_samples = 16;            // 每个像素最少的采样次数
+    int adaptive_batch = 8;          // 每采多少次检查一次是否收敛
+    double adaptive_threshold = 0.02; // 相对误差阈值(95%置信区间的半宽 / 亮度均值)
+    std::string sample_map_path;     // 每个像素实际采样次数的图，不为空时写到这个文件
+
+    integrator_type integrator = integrator_type::recursive; // 路径追踪的积分器
+    int rr_min_depth = 3;      // 迭代积分器从第几次弹射后开始俄罗斯轮盘赌，大于等于max_depth时相当于不用
+
+    render_engine engine = render_engine::megakernel; // 渲染引擎
+    int wavefront_batch = 8192; // 波前式引擎一批大约处理多少条路径(不支持自适应采样)
+    bool sort_secondary_rays = false; // 波前式引擎每次弹射求交前按方向的卦限给光线分组(默认关闭，见wavefront_sort_rays)
+    bool sort_by_material = false;    // 波前式引擎着色前按材质类型给路径排序(默认关闭，见wavefront_sort_rays)
+
+    // 材质散射的分派方式(见hittable.hpp的dispatch_mode)；物体求交的分派方式由bvh_node::set_dispatch设置
+    dispatch_mode material_dispatch = dispatch_mode::closed_set;
+
+    std::string stats_path;    // 渲染统计写成JSON的路径，为空则只打印(需要编译时定义RTW_ENABLE_STATS)
+
+    // 检查点：渲染分成若干遍，每遍给每个像素加checkpoint_pass个采样，
+    // 两遍之间距上次写检查点超过checkpoint_interval秒，就把累加缓冲写到checkpoint_path，渲染完再写一次
+    // resume_path不为空时从这个检查点接着渲染，samples_per_pixel比检查点里的大时就接着加采样
+    // (stratified和zsobol的采样点分布由samples_per_pixel决定，这两种采样器续算时不能改采样数，见settings_key)
+    std::string checkpoint_path;
+    double checkpoint_interval = 60;
+    int checkpoint_pass = 16;
+    std::string resume_path;
+    uint64_t scene_key = 0;    // 场景的摘要(见scene_digest)，写进检查点，不同场景的检查点不能续算
+
+    // 降噪：渲染时收集每个像素第一次击中处的反射率、法线和深度，渲染完用它们引导边缘保持的滤波(见denoise.hpp)
+    // collect_features只收集不降噪，渲染完用feature_guides()取出来自己处理
+    bool denoise = false;
+    bool collect_features = false;
+    denoise_settings denoiser;
+
+    // AOV：同一遍渲染顺带输出第一次击中处的深度、法线、反射率、材质编号、物体编号和每个像素的采样次数，
+    // 写到输出图像旁边(见aov.hpp)。不打开时渲染循环里只多一次空指针的判断
+    bool write_aovs = false;
+
+    // 渲染并输出图像，有输出没写成功时返回false
+    bool render(const hittable& world) {
+        framebuffer image = render_image(world);
+        return write_outputs(image, samples_used);
+    }
+
+    // 输出渲染好的图像，设置了sample_map_path时再输出每个像素的采样次数图，打开write_aovs时再输出AOV
+    // 某个输出写失败(原因已经打印出来)也接着写其余的，最后返回false
+    bool write_outputs(const framebuffer& image, const std::vector<int>& spp) const {
+        bool ok = write_image(image, output_format, output_path);
+        if (!sample_map_path.empty())
+            ok = write_sample_map(spp) && ok;
+        if (write_aovs)
+            ok = write_aov_images() && ok;
+        return ok;
+    }
 
-    void render(const hittable& world) {
+    // 只渲染不输出，返回渲染好的图像(比如收敛测试要拿它和参考图比较)
+    // 每个像素实际的采样次数留在samples_used里
+    framebuffer render_image(const hittable& world) {
         initialize();
+        path_counters counters;
 
-        std::cout << "P3\n" << image_width << " " << image_height << "\n255\n";
+        int threads = thread_count > 0 ? thread_count : int(std::thread::hardware_concurrency());
+        threads = std::max(threads, 1);
 
-        for (int j = 0; j < image_height; j++) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i = 0; i < image_width; i++) {
-                // 设置像素初始颜色为黑色
-                color pixel_color(0, 0, 0);
-                // 根据每个像素点需要的采样点数，做循环，为每个采样点生成一个光线，做颜色采样
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    // 从j行i列中取出采样的光线
-                    ray r = get_ray(i, j);
-                    // 把采样的光线的色彩转换后，累加到当前像素的色彩
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                write_color(std::cout, pixel_samples_scale * pixel_color);
+        // 累加缓冲从检查点读回来，或者从头开始
+        const uint64_t key = hash_combine(settings_key(), scene_key);
+        accum.reset(image_width, image_height, features_enabled());
+        if (!resume_path.empty()) {
+            std::string error;
+            if (accum.load(resume_path, image_width, image_height, key, features_enabled(), error))
+                std::clog << "Resumed from " << resume_path << ": " << accum.min_samples()
+                    << " spp or more per pixel, " << accum.total_samples() << " samples in total\n";
+            else
+                std::clog << "Cannot resume from " << resume_path << " (" << error << "), starting over\n";
+        }
+
+        // 只计渲染本身的时间，不含输出图像，方便比较不同精度、不同引擎的速度
+        stage_timer timer;
+        double render_seconds = 0;
+        // 清掉之前残留的统计，这次渲染重新计数
+        RTW_STAT(take_merged_stats(); thread_stats() = render_stats());
+        // 不写检查点时一遍采满；写检查点时每遍加checkpoint_pass个采样，只在两遍之间写，这时没有线程在改累加缓冲
+        const int pass = checkpoint_path.empty() ? samples_per_pixel : std::max(1, checkpoint_pass);
+        stage_timer checkpoint_timer;
+        double since_checkpoint = 0;
+        for (int limit = accum.min_samples(); limit < samples_per_pixel;) {
+            limit = std::min(samples_per_pixel, (limit / pass + 1) * pass);
+            render_pass(world, limit, counters, threads);
+            if (checkpoint_path.empty())
+                continue;
+            checkpoint_timer.lap(since_checkpoint);
+            if (since_checkpoint >= checkpoint_interval || limit >= samples_per_pixel) {
+                write_checkpoint(key, limit);
+                since_checkpoint = 0;
             }
         }
+        timer.lap(render_seconds);
+
+        framebuffer image(image_width, image_height);
+        std::vector<int>& spp = samples_used;
+        spp.assign(size_t(image_width) * image_height, 0);
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++) {
+                image.at(i, j) = resolve_pixel(accum.at(i, j));
+                spp[size_t(j) * image_width + i] = accum.at(i, j).samples;
+            }
 
         std::clog << "\rDone.                 \n";
+        std::clog << "Render time " << render_seconds << " s ("
+            << (std::is_same<real, float>::value ? "float" : "double") << " precision)\n";
+        if (denoise) {
+            denoise_settings settings = denoiser;
+            if (settings.thread_count <= 0)
+                settings.thread_count = threads;
+            double denoise_seconds = 0;
+            image = denoise_image(image, feature_guides(), settings);
+            timer.lap(denoise_seconds);
+            std::clog << "Denoised in " << denoise_seconds * 1000 << " ms (" << settings.iterations << " iterations)\n";
+        }
+        if (adaptive_sampling)
+            report_sample_usage(spp);
+        report_paths(counters);
+        RTW_STAT(report_stats());
+#ifndef RTW_ENABLE_STATS
+        if (!stats_path.empty())
+            std::clog << "Render statistics are disabled, rebuild with RTW_ENABLE_STATS to collect them\n";
+#endif
+        return image;
+    }
+
+    // 决定每个采样点结果的设置(不含自适应采样的参数，续算时可以改)的摘要
+    // 采样数一般也不算在内，续算时可以加；但stratified(相关多重抖动)和zsobol的样本按采样数分层，
+    // 换了采样数前后两段的样本来自两套不同的分层，所以这两种采样器把采样数算进摘要，采样数不同的检查点不能续算
+    // (random和sobol的第n个样本和总采样数无关)
+    uint64_t settings_key() const {
+        double reals[] = { aspect_ratio, vfov, lookfrom.x(), lookfrom.y(), lookfrom.z(),
+            lookat.x(), lookat.y(), lookat.z(), vup.x(), vup.y(), vup.z(), defocus_angle, focus_dist };
+        int64_t ints[] = { image_width, max_depth, int64_t(seed), int64_t(random_mode), int64_t(sampler),
+            int64_t(integrator), rr_min_depth, int64_t(engine), int64_t(sizeof(real)) };
+        const uint64_t key = hash_bytes(ints, sizeof(ints), hash_bytes(reals, sizeof(reals)));
+        if (sampler == sampler_type::stratified || sampler == sampler_type::zsobol)
+            return hash_combine(key, uint64_t(samples_per_pixel));
+        return key;
+    }
+
+    // 上一次渲染收集的降噪引导特征(需要打开denoise或collect_features)，都是每个像素的平均值
+    denoise_guides feature_guides() const {
+        denoise_guides guides;
+        const size_t n = size_t(image_width) * image_height;
+        guides.albedo = framebuffer(image_width, image_height);
+        guides.normal = framebuffer(image_width, image_height);
+        guides.depth.assign(n, 0);
+        guides.variance.assign(n, 0);
+        if (!accum.has_features())
+            return guides;
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++) {
+                const size_t k = size_t(j) * image_width + i;
+                const pixel_features& f = accum.features_at(i, j);
+                const pixel_accumulator& acc = accum.at(i, j);
+                if (f.samples > 0) {
+                    guides.albedo.at(i, j) = f.albedo / f.samples;
+                    guides.normal.at(i, j) = f.normal / f.samples;
+                    guides.depth[k] = f.depth / f.samples;
+                }
+                // 像素均值的方差 = 样本方差 / 采样数，样本方差由统计了亮度的那些采样估计，
+                // 不到两个时估计不了，交给降噪从周围像素估计
+                guides.variance[k] = acc.moment_samples > 1 ? acc.m2 / (acc.moment_samples - 1) / acc.samples : -1;
+            }
+        return guides;
+    }
+
+    // 不渲染、只生成光线时(比如基准测试)，先调用prepare()按当前参数算好视口，
+    // 再用primary_ray(i, j)取第(i,j)个像素的一条随机采样光线
+    void prepare() { initialize(); }
+    ray primary_ray(int i, int j) const { return get_ray(i, j, thread_rng()); }
+    // prepare()之后图像的高
+    int get_image_height() const { return image_height; }
+
+    // 只渲染图像上的region这一块，结果写到整张图像大小的image和spp的对应位置(分布式渲染的工作进程用)
+    // 需要先调用prepare()；每个像素的结果只和种子、像素位置有关，所以和整张渲染时完全一样
+    void render_region(const hittable& world, const tile& region, framebuffer& image, std::vector<int>& spp,
+        path_counters& counters) {
+        if (accum.width() != image_width || accum.height() != image_height || accum.has_features() != features_enabled())
+            accum.reset(image_width, image_height, features_enabled());
+        for (int j = region.y0; j < region.y1; j++)
+            for (int i = region.x0; i < region.x1; i++) {
+                accum.at(i, j) = pixel_accumulator();
+                if (accum.has_features())
+                    accum.features_at(i, j) = pixel_features();
+            }
+
+        int threads = thread_count > 0 ? thread_count : int(std::thread::hardware_concurrency());
+        threads = std::max(threads, 1);
+        std::vector<path_counters> worker_counters(threads);
+        std::vector<wavefront_timings> worker_timings(threads);
+        std::vector<wavefront_queue> queues(engine == render_engine::wavefront ? threads : 0);
+        for_each_tile(region, threads, [&](int id, const tile& t) {
+            if (engine == render_engine::wavefront) {
+                render_wavefront_tile(world, t, samples_per_pixel, queues[id], worker_counters[id], worker_timings[id]);
+                return;
+            }
+            for (int j = t.y0; j < t.y1; j++)
+                for (int i = t.x0; i < t.x1; i++)
+                    render_pixel(i, j, world, accum.at(i, j), samples_per_pixel, worker_counters[id]);
+        }, false);
+        for (const auto& c : worker_counters)
+            counters += c;
+
+        for (int j = region.y0; j < region.y1; j++)
+            for (int i = region.x0; i < region.x1; i++) {
+                image.at(i, j) = resolve_pixel(accum.at(i, j));
+                spp[size_t(j) * image_width + i] = accum.at(i, j).samples;
+            }
     }
 
 private:
@@ -53,6 +317,10 @@ private:
     vec3   u, v, w;              // 相机的右上前定义，注意w与看向的方向相反(右手坐标系)
     vec3   defocus_disk_u;       // 失焦的圆盘水平半径
     vec3   defocus_disk_v;       // 失焦的圆盘垂直半径
+    std::vector<int> samples_used; // 上一次渲染每个像素实际的采样次数
+    accumulation_buffer accum;     // 每个像素的颜色和、采样次数，最后才除以采样次数得到图像
+
+    bool features_enabled() const { return denoise || collect_features || write_aovs; }
 
     // 初始化操作
     void initialize() {
@@ -108,13 +376,467 @@ private:
         defocus_disk_u = u * defocus_radius;
         // 求出失焦圆盘垂直半径
         defocus_disk_v = v * defocus_radius;
+
+        // 按现在的设置选出逐像素渲染的实例
+        pixel_renderer_fn = select_pixel_renderer();
+    }
+
+    // 逐像素渲染的函数，每种render_config一个实例
+    using pixel_renderer = void (camera_rt2::*)(int, int, const hittable&, pixel_accumulator&, int, path_counters&);
+    pixel_renderer pixel_renderer_fn = nullptr;
+
+    // 编译期特化的最大弹射次数：camera_rt2的默认值和场景文件的默认值，其他值走运行时的版本
+    static constexpr int specialized_depths[] = { 10, 50 };
+
+    // 运行时的前端：按max_depth、defocus_angle、是否收集特征、是否自适应采样、积分器选出render_pixel_impl的实例
+    pixel_renderer select_pixel_renderer() const {
+        switch (max_depth) {
+        case specialized_depths[0]: return select_pixel_renderer<specialized_depths[0]>();
+        case specialized_depths[1]: return select_pixel_renderer<specialized_depths[1]>();
+        default: return select_pixel_renderer<0>();
+        }
+    }
+
+    // Flags是已经决定好的开关，按render_config的参数顺序每次多决定一个，四个都定了就取出实例
+    template <int MaxDepth, bool... Flags>
+    pixel_renderer select_pixel_renderer() const {
+        constexpr size_t decided = sizeof...(Flags);
+        if constexpr (decided == 4) {
+            return &camera_rt2::render_pixel_impl<render_config<Flags..., MaxDepth>>;
+        }
+        else {
+            const bool flag = decided == 0 ? defocus_angle > 0
+                : decided == 1 ? features_enabled()
+                : decided == 2 ? adaptive_sampling
+                : integrator == integrator_type::iterative;
+            return flag ? select_pixel_renderer<MaxDepth, Flags..., true>()
+                        : select_pixel_renderer<MaxDepth, Flags..., false>();
+        }
+    }
+
+    // 实例里的最大弹射次数
+    template <class Config>
+    int depth_limit() const { return Config::max_depth > 0 ? Config::max_depth : max_depth; }
+
+    // 一遍渲染：每个像素从已有的采样数接着采，采到limit个为止(自适应采样时收敛了就提前停)
+    void render_pass(const hittable& world, int limit, path_counters& counters, int threads) {
+        if (engine == render_engine::wavefront) {
+            render_wavefront(world, limit, counters, threads);
+        }
+        else if (threads <= 1) {
+            for (int j = 0; j < image_height; j++) {
+                std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
+                for (int i = 0; i < image_width; i++)
+                    render_pixel(i, j, world, accum.at(i, j), limit, counters);
+            }
+            RTW_STAT(flush_thread_stats());
+        }
+        else {
+            render_tiles(world, limit, counters, threads);
+        }
+    }
+
+    // 写检查点，limit是这一遍采到的采样数
+    void write_checkpoint(uint64_t key, int limit) const {
+        stage_timer timer;
+        double seconds = 0;
+        std::string error;
+        bool ok = accum.save(checkpoint_path, key, error);
+        timer.lap(seconds);
+        if (ok)
+            std::clog << "\rCheckpoint at " << limit << " spp written to " << checkpoint_path << " in "
+                << seconds * 1000 << " ms\n";
+        else
+            std::clog << "\rCannot write checkpoint: " << error << "\n";
+    }
+
+    // 累加值换成像素颜色：采满时和原来一样乘以预先算好的倒数，保证非自适应模式下结果不变
+    color resolve_pixel(const pixel_accumulator& acc) const {
+        if (acc.samples == 0)
+            return color(0, 0, 0);
+        if (acc.samples == samples_per_pixel)
+            return pixel_samples_scale * acc.sum;
+        return acc.sum / acc.samples;
     }
 
-    // 根据行列里的第几个像素点，取出采样点的光线
-    ray get_ray(int i, int j) const {
+    // 渲染第j行第i列的像素，从acc里已有的采样数接着采，采到limit个为止，结果累加到acc里
+    // 调用initialize()时选好的实例
+    void render_pixel(int i, int j, const hittable& world, pixel_accumulator& acc, int limit,
+        path_counters& counters) {
+        (this->*pixel_renderer_fn)(i, j, world, acc, limit, counters);
+    }
+
+    template <class Config>
+    void render_pixel_impl(int i, int j, const hittable& world, pixel_accumulator& acc, int limit,
+        path_counters& counters) {
+        // 每个像素用自己的种子，这样像素的结果只和种子、像素位置有关，和渲染顺序、线程无关
+        auto& rng = thread_rng();
+        rng.set_mode(random_mode);
+        rng.set_sampler(sampler, samples_per_pixel, image_width, image_height, seed);
+        const uint64_t pixel_key = hash_combine(seed, uint64_t(j) * image_width + i);
+        rng.begin_pixel(pixel_key, uint32_t(j * image_width + i));
+        // 接着上一遍(或检查点)采样时，顺序流模式要是还从像素的种子开始，会和已有的采样重复，
+        // 所以按(像素, 已有的采样数)重新设种子；counter模式下每个采样点的随机数本来就只和采样序号有关
+        if (random_mode == rng_mode::stream && acc.samples > 0)
+            rng.seed(hash_combine(pixel_key, uint64_t(acc.samples)));
+        int n = acc.samples;
+        // 上一遍已经收敛的像素不再采样，判断条件和下面循环里的一样
+        // 收敛按统计了亮度的采样判断，检查点里的统计作废时(moment_samples为0)不会在这里提前结束
+        if (Config::adaptive && acc.moment_samples >= min_samples && n % adaptive_batch == 0
+            && converged(acc.mean, acc.m2, acc.moment_samples))
+            return;
+        // 根据每个像素点需要的采样点数，做循环，为每个采样点生成一个光线，做颜色采样
+        // 自适应采样和降噪时用Welford算法在线计算样本亮度的均值和方差(m2是离差平方和)
+        // 写检查点时也统计，这样检查点里的统计总是有效的，续算时可以再打开自适应采样或降噪
+        constexpr bool track_variance = Config::adaptive || Config::features;
+        const bool track_moments = track_variance || !checkpoint_path.empty();
+        pixel_features* pf = Config::features ? &accum.features_at(i, j) : nullptr;
+        while (n < limit) {
+            rng.begin_sample(uint32_t(n));
+            // 从j行i列中取出采样的光线
+            ray r = get_ray<Config::defocus>(i, j, rng);
+            RTW_STAT(thread_stats().primary_rays++);
+            // 把采样的光线的色彩转换后，累加到当前像素的色彩
+            sample_features sf;
+            color sample_color;
+            if constexpr (Config::iterative)
+                sample_color = trace_path<Config>(r, world, rng, counters, &sf);
+            else
+                sample_color = ray_color<Config>(r, depth_limit<Config>(), world, rng, counters, &sf);
+            counters.paths++;
+            acc.sum += sample_color;
+            n++;
+            if constexpr (Config::features)
+                add_features(*pf, sf);
+
+            if (track_moments) {
+                const int m = ++acc.moment_samples;
+                double y = luminance(sample_color);
+                double delta = y - acc.mean;
+                acc.mean += delta / m;
+                acc.m2 += delta * (y - acc.mean);
+                if (Config::adaptive && m >= min_samples && n % adaptive_batch == 0
+                    && converged(acc.mean, acc.m2, m))
+                    break;
+            }
+        }
+        acc.samples = n;
+    }
+
+    // 把一个采样点的特征累加到像素上
+    static void add_features(pixel_features& pf, const sample_features& sf) {
+        if (pf.samples == 0) {
+            pf.material_id = sf.material_id;
+            pf.object_id = sf.object_id;
+        }
+        pf.albedo += sf.albedo;
+        pf.normal += sf.normal;
+        pf.depth += sf.depth;
+        pf.samples++;
+    }
+
+    // 记下光线第一次击中处的特征，depth按光线参数t乘以方向的长度换成距离
+    static void record_features(sample_features* features, const ray& r, const hit_record& rec) {
+        if (!features)
+            return;
+        features->albedo = rec.mat->feature_albedo();
+        features->normal = rec.normal;
+        features->depth = rec.t * r.direction().length();
+        features->material_id = rec.mat->id;
+        features->object_id = rec.object_id;
+    }
+
+    // 根据n个样本的亮度均值和离差平方和，判断像素是否已经收敛
+    // 均值的标准误差是sqrt(方差/n)，1.96倍标准误差是95%置信区间的半宽，
+    // 它和均值之比小于阈值就认为收敛；很暗的像素按一个下限算，避免除以接近0的数
+    bool converged(double mean, double m2, int n) const {
+        double variance = m2 / (n - 1);
+        double error = 1.96 * std::sqrt(variance / n);
+        return error <= adaptive_threshold * std::fmax(mean, 0.01);
+    }
+
+    // 输出路径统计：平均路径长度(每条路径求交的次数)，以及俄罗斯轮盘赌结束的路径比例
+    void report_paths(const path_counters& counters) const {
+        if (counters.paths == 0)
+            return;
+        std::clog << "Paths: " << counters.paths << ", rays: " << counters.segments
+            << ", average path length " << double(counters.segments) / counters.paths;
+        if (integrator == integrator_type::iterative)
+            std::clog << ", " << counters.rr_terminated << " paths ("
+                << 100.0 * counters.rr_terminated / counters.paths << "%) ended by russian roulette";
+        std::clog << "\n";
+    }
+
+    // 输出合并后的渲染统计，设置了stats_path时同时写成JSON
+    void report_stats() const {
+        render_stats stats = take_merged_stats();
+        stats.print(std::clog);
+        if (!stats_path.empty())
+            stats.write_json(stats_path);
+    }
+
+    // 输出采样次数的统计，看看相对固定采样省下了多少
+    void report_sample_usage(const std::vector<int>& spp) const {
+        long long total = 0;
+        int lo = samples_per_pixel, hi = 0;
+        for (int n : spp) {
+            total += n;
+            lo = std::min(lo, n);
+            hi = std::max(hi, n);
+        }
+        double average = double(total) / spp.size();
+        std::clog << "Adaptive sampling: " << average << " spp on average (min " << lo << ", max " << hi
+            << "), " << 100.0 * average / samples_per_pixel << "% of the fixed budget\n";
+    }
+
+    // 把每个像素的采样次数写成图像
+    // PFM里存的就是原始的采样次数，其他格式按最大采样次数归一化(写出时会经过gamma)
+    bool write_sample_map(const std::vector<int>& spp) const {
+        auto format = image_format_from_path(sample_map_path);
+        double scale = format == image_format::pfm ? 1.0 : 1.0 / samples_per_pixel;
+        framebuffer map(image_width, image_height);
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++) {
+                double v = scale * spp[size_t(j) * image_width + i];
+                map.at(i, j) = color(v, v, v);
+            }
+        return write_image(map, format, sample_map_path);
+    }
+
+    // 把AOV写到输出图像旁边，格式和输出图像一样，文本PPM没有精度可言，改用PFM
+    bool write_aov_images() const {
+        if (output_path.empty() || !accum.has_features()) {
+            std::clog << "AOVs need an output path and a local render, not written\n";
+            return true;
+        }
+        image_format format = output_format == image_format::ppm_ascii ? image_format::pfm : output_format;
+        bool ok = true;
+        for (const auto& layer : make_aov_layers(accum, format))
+            ok = write_image(layer.image, format, aov_path(output_path, layer.name, format)) && ok;
+        return ok;
+    }
+
+    // 多线程分块渲染，各线程通过工作窃取调度器领取图像块，结果累加到共享的累加缓冲里
+    // 每个像素只会被一个线程写，所以写累加缓冲不需要加锁
+    void render_tiles(const hittable& world, int limit, path_counters& counters, int threads) {
+        // 每个线程先在自己的统计里累加，结束时再合并，避免线程间争抢同一个计数器
+        std::vector<path_counters> worker_counters(threads);
+        for_each_tile(tile{ 0, 0, image_width, image_height }, threads, [&](int id, const tile& t) {
+            for (int j = t.y0; j < t.y1; j++)
+                for (int i = t.x0; i < t.x1; i++)
+                    render_pixel(i, j, world, accum.at(i, j), limit, worker_counters[id]);
+        });
+        for (const auto& c : worker_counters)
+            counters += c;
+    }
+
+    // 启动threads个线程，通过工作窃取调度器把region里的所有图像块分给它们，每块调用一次fn(线程编号, 块)
+    // threads为1时不另开线程，show_progress为false时不打印进度
+    template <class F>
+    void for_each_tile(const tile& region, int threads, F&& fn, bool show_progress = true) const {
+        tile_scheduler scheduler(region, tile_size, threads);
+        std::atomic<size_t> tiles_done{ 0 };
+
+        auto worker = [&](int id) {
+            tile t;
+            while (scheduler.next(id, t)) {
+                fn(id, t);
+                size_t done = ++tiles_done;
+                // 只让0号线程打印进度，避免输出互相穿插
+                if (id == 0 && show_progress)
+                    std::clog << "\rTiles remaining: " << (scheduler.tile_count() - done) << "    " << std::flush;
+            }
+            RTW_STAT(flush_thread_stats());
+        };
+
+        // 当前线程也作为0号线程参与渲染
+        std::vector<std::thread> pool;
+        for (int id = 1; id < threads; id++)
+            pool.emplace_back(worker, id);
+        worker(0);
+        for (auto& th : pool)
+            th.join();
+    }
+
+    // 波前式渲染：每个线程领到一个图像块后，把块内所有像素的一批采样点作为一批路径，
+    // 按阶段整批推进(见wavefront.hpp)，而不是一条路径一条路径地追踪到底
+    // 随机数固定用counter模式，按(像素, 采样, 弹射次数)取数，和处理顺序无关；
+    // 每条路径的结果按采样点顺序累加，所以用迭代积分器、counter模式时，结果和逐像素渲染完全一致
+    void render_wavefront(const hittable& world, int limit, path_counters& counters, int threads) {
+        std::vector<path_counters> worker_counters(threads);
+        std::vector<wavefront_timings> worker_timings(threads);
+        std::vector<wavefront_queue> queues(threads);
+
+        for_each_tile(tile{ 0, 0, image_width, image_height }, threads, [&](int id, const tile& t) {
+            render_wavefront_tile(world, t, limit, queues[id], worker_counters[id], worker_timings[id]);
+        });
+
+        wavefront_timings timings;
+        for (int id = 0; id < threads; id++) {
+            counters += worker_counters[id];
+            timings += worker_timings[id];
+        }
+        double total = timings.generate + timings.intersect + timings.shade + timings.compact + timings.resolve
+            + timings.sort;
+        std::clog << "\rWavefront stages (thread-seconds): generate " << timings.generate
+            << ", intersect " << timings.intersect << ", shade " << timings.shade
+            << ", compact " << timings.compact << ", resolve " << timings.resolve
+            << ", sort " << timings.sort << ", total " << total << "\n";
+    }
+
+    // 块内每个像素从累加缓冲里已有的采样数接着采，采到limit个为止
+    void render_wavefront_tile(const hittable& world, const tile& t, int limit,
+        wavefront_queue& q, path_counters& counters, wavefront_timings& timings) {
+        auto& rng = thread_rng();
+        rng.set_mode(rng_mode::counter);
+        rng.set_sampler(sampler, samples_per_pixel, image_width, image_height, seed);
+
+        const int tile_w = t.x1 - t.x0;
+        const int tile_pixels = tile_w * (t.y1 - t.y0);
+        // 各像素已有的采样数，从检查点接着渲染时可能各不相同
+        std::vector<int> first(tile_pixels);
+        int most = 0;
+        for (int p = 0; p < tile_pixels; p++) {
+            first[p] = accum.at(t.x0 + p % tile_w, t.y0 + p / tile_w).samples;
+            most = std::max(most, limit - first[p]);
+        }
+        // 一批里每个像素的采样点数，让一批的路径数接近wavefront_batch
+        const int samples_per_wave = std::max(1, std::min(most, wavefront_batch / tile_pixels));
+
+        for (int s0 = 0; s0 < most; s0 += samples_per_wave) {
+            const int ns = std::min(samples_per_wave, most - s0);
+            stage_timer timer;
+
+            // 生成：块内每个像素的ns个采样点各生成一条相机光线
+            q.paths.clear();
+            q.radiance.assign(size_t(tile_pixels) * ns, color(0, 0, 0));
+            if (features_enabled())
+                q.features.assign(q.radiance.size(), sample_features());
+            for (int p = 0; p < tile_pixels; p++) {
+                int i = t.x0 + p % tile_w;
+                int j = t.y0 + p / tile_w;
+                uint64_t pixel_key = hash_combine(seed, uint64_t(j) * image_width + i);
+                uint32_t pixel_index = uint32_t(j * image_width + i);
+                rng.begin_pixel(pixel_key, pixel_index);
+                for (int s = 0; s < ns && first[p] + s0 + s < limit; s++) {
+                    rng.begin_sample(uint32_t(first[p] + s0 + s));
+                    q.paths.push_back({ get_ray(i, j, rng), color(1.0, 1.0, 1.0), pixel_key, pixel_index,
+                        uint32_t(first[p] + s0 + s), uint32_t(p * ns + s) });
+                }
+            }
+            counters.paths += q.paths.size();
+            RTW_STAT(thread_stats().primary_rays += q.paths.size());
+            timer.lap(timings.generate);
+
+            // 逐次弹射：整批求交，整批着色，再把结束的路径去掉
+            // 排序只改变处理路径的顺序，结果按slot写回，随机数按路径取，所以排不排序图像都一样
+            for (int bounce = 0; bounce < max_depth && !q.paths.empty(); bounce++) {
+                counters.segments += q.paths.size();
+                // 相机光线按像素顺序生成，本来就是相干的，从第二段开始才排序
+                if (sort_secondary_rays && bounce > 0) {
+                    wavefront_sort_rays(q);
+                    timer.lap(timings.sort);
+                }
+                else
+                    wavefront_identity_order(q);
+                wavefront_intersect(world, q);
+                timer.lap(timings.intersect);
+                if (sort_by_material) {
+                    wavefront_sort_by_material(q);
+                    timer.lap(timings.sort);
+                }
+                wavefront_shade(q, bounce, rng, counters, features_enabled());
+                timer.lap(timings.shade);
+                wavefront_compact(q);
+                timer.lap(timings.compact);
+            }
+            // 走完max_depth次弹射还活着的路径
+            RTW_STAT(for (size_t k = 0; k < q.paths.size(); k++)
+                thread_stats().record_path(max_depth, path_end::max_depth));
+
+            // 汇总：每个像素按采样点顺序累加，和逐像素渲染的累加顺序一样
+            for (int p = 0; p < tile_pixels; p++) {
+                auto& acc = accum.at(t.x0 + p % tile_w, t.y0 + p / tile_w);
+                for (int s = 0; s < ns && first[p] + s0 + s < limit; s++) {
+                    const size_t slot = size_t(p) * ns + s;
+                    acc.sum += q.radiance[slot];
+                    acc.samples++;
+                    if (features_enabled())
+                        add_features(accum.features_at(t.x0 + p % tile_w, t.y0 + p / tile_w), q.features[slot]);
+                    if (!features_enabled() && checkpoint_path.empty())
+                        continue;
+                    const int m = ++acc.moment_samples;
+                    double y = luminance(q.radiance[slot]);
+                    double delta = y - acc.mean;
+                    acc.mean += delta / m;
+                    acc.m2 += delta * (y - acc.mean);
+                }
+            }
+            timer.lap(timings.resolve);
+        }
+    }
+
+    // 着色阶段：没打中的路径加上天空的贡献后结束，打中的调用材质散射，
+    // 更新通量和下一段光线，迭代积分器下再做俄罗斯轮盘赌，和trace_path的每一步一致
+    // with_features为true时，第一次弹射记下击中处的特征
+    void wavefront_shade(wavefront_queue& q, int bounce, rng_state& rng, path_counters& counters,
+        bool with_features) const {
+        size_t n = q.paths.size();
+        q.alive.assign(n, 0);
+        for (uint32_t k : q.order) {
+            wavefront_path& path = q.paths[k];
+            RTW_STAT(if (bounce > 0) thread_stats().secondary_rays++);
+            if (!q.did_hit[k]) {
+                RTW_STAT(thread_stats().record_path(bounce + 1, path_end::escaped));
+                q.radiance[path.slot] = path.throughput * sky_color(path.r);
+                continue;
+            }
+            RTW_STAT(thread_stats().ray_hits++);
+            if (with_features && bounce == 0)
+                record_features(&q.features[path.slot], path.r, q.hits[k]);
+
+            // 恢复这条路径这次弹射的随机数
+            rng.begin_pixel(path.pixel_key, path.pixel_index);
+            rng.begin_sample(path.sample);
+            rng.begin_bounce(uint32_t(bounce + 1));
+
+            const hit_record& rec = q.hits[k];
+            ray scattered;
+            color attenuation;
+            bool did_scatter = scatter_material(*rec.mat, path.r, rec, attenuation, scattered, rng, material_dispatch);
+            RTW_STAT(thread_stats().record_scatter(rec.mat->name(), did_scatter));
+            if (!did_scatter) {
+                RTW_STAT(thread_stats().record_path(bounce + 1, path_end::absorbed));
+                continue;
+            }
+            path.throughput = path.throughput * attenuation;
+            path.r = scattered;
+
+            if (integrator == integrator_type::iterative && bounce + 1 >= rr_min_depth) {
+                double p = std::fmin(std::fmax(path.throughput.x(),
+                    std::fmax(path.throughput.y(), path.throughput.z())), 0.95);
+                if (random_double(rng) >= p) {
+                    counters.rr_terminated++;
+                    RTW_STAT(thread_stats().record_path(bounce + 1, path_end::russian_roulette));
+                    continue;
+                }
+                path.throughput /= p;
+            }
+            q.alive[k] = 1;
+        }
+    }
+
+    // 根据行列里的第几个像素点，取出采样点的光线，随机数取自rng
+    ray get_ray(int i, int j, rng_state& rng) const {
+        return defocus_angle > 0 ? get_ray<true>(i, j, rng) : get_ray<false>(i, j, rng);
+    }
+
+    // Defocus是编译期的景深开关，和运行时版本里defocus_angle > 0的判断一致
+    template <bool Defocus>
+    ray get_ray(int i, int j, rng_state& rng) const {
 
         // 取出基于像素点的偏移量
-        auto offset = sample_square();
+        auto offset = sample_square(rng);
         // 采样点，基于第一个像素点，可以得出第(j,i)个像素点的采样点
         // 使用相邻像素点距离乘(i或j + 随机偏移x或y)
         auto pixel_sample = pixel00_loc
@@ -122,7 +844,9 @@ private:
             + ((j + offset.y()) * pixel_delta_v);
         // 光线的原点，若失焦角小于等于0(就是光线直接打到焦距点上)，视为相机中心发出的光
         // 否则，视为圆盘上随机一点发出的光
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        point3 ray_origin = center;
+        if constexpr (Defocus)
+            ray_origin = defocus_disk_sample(rng);
         // 光线的方向，就是这个采样点的向量 - 光线的原点
         auto ray_direction = pixel_sample - ray_origin;
         // 构造出一个光线ray对象
@@ -130,45 +854,125 @@ private:
     }
 
     // 取像素点左右上下正负0.5的范围内的点
-    vec3 sample_square() const {
+    vec3 sample_square(rng_state& rng) const {
         // x,y的值在[-0.5,0.5)区间（不包括0.5）
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+        // 先取y再取x，和以前GCC从右往左求值构造参数时的顺序一样，已有的图像和检查点不变
+        auto y = random_double(rng) - 0.5;
+        auto x = random_double(rng) - 0.5;
+        return vec3(x, y, 0);
     }
 
     // 失焦圆盘采样
-    point3 defocus_disk_sample() const {
+    point3 defocus_disk_sample(rng_state& rng) const {
         // 从单位圆盘上取出随机点p
-        auto p = random_in_unit_disk();
+        auto p = random_in_unit_disk(rng);
         // 这条光在相机中心的基础上，在水平和垂直圆盘半径内，做随机偏移
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    // 获得光线的颜色结果
-    color ray_color(const ray& r, int depth, const hittable& world) const {
+    // 获得光线的颜色结果，Config::features为true时在features里记下第一次击中处的特征
+    template <class Config>
+    color ray_color(const ray& r, int depth, const hittable& world, rng_state& rng, path_counters& counters,
+        sample_features* features = nullptr) const {
+        const int max_bounces = depth_limit<Config>();
         // 若超过了光线反射递归次数，则不再收集结果，直接返回黑色
-        if (depth <= 0)
+        if (depth <= 0) {
+            RTW_STAT(thread_stats().record_path(max_bounces, path_end::max_depth));
             return color(0, 0, 0);
+        }
+        counters.segments++;
+        RTW_STAT(if (depth < max_bounces) thread_stats().secondary_rays++);
         hit_record rec;
         // 若场景中有物体与光线碰撞
         if (world.hit(r, interval(0.001, infinity), rec)) {
+            RTW_STAT(thread_stats().ray_hits++);
+            if constexpr (Config::features)
+                record_features(features, r, rec);
+            // counter模式下，这次弹射的随机数由弹射次数决定
+            rng.begin_bounce(uint32_t(max_bounces - depth + 1));
             // 反射光
             ray scattered;
             // 光的反射率
             color attenuation;
             // 调用具体材质的散射方法，看是否反射，若是，则用反射光向量填充scattered
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
+            bool did_scatter = scatter_material(*rec.mat, r, rec, attenuation, scattered, rng, material_dispatch);
+            RTW_STAT(thread_stats().record_scatter(rec.mat->name(), did_scatter));
+            if (did_scatter)
                 // 反射率乘以反射的光求得的颜色，同时反射递归次数-1
-                return attenuation * ray_color(scattered, depth - 1, world);
+                return attenuation * ray_color<Config>(scattered, depth - 1, world, rng, counters);
             // 若材质不反射，返回黑色
+            RTW_STAT(thread_stats().record_path(max_bounces - depth + 1, path_end::absorbed));
             return color(0, 0, 0);
         }
-        // 把光线的方向归一化
-        vec3 unit_direction = unit_vector(r.direction());
+        // 没有碰撞，返回天空的颜色
+        RTW_STAT(thread_stats().record_path(max_bounces - depth + 1, path_end::escaped));
+        return sky_color(r);
+    }
+
+    // 迭代版的路径追踪，和ray_color算的是同一个东西，但不递归
+    // throughput是这条路径到目前为止所有衰减的乘积，打到天空时乘上天空颜色就是这条路径的贡献
+    template <class Config>
+    color trace_path(const ray& r, const hittable& world, rng_state& rng, path_counters& counters,
+        sample_features* features = nullptr) const {
+        const int max_bounces = depth_limit<Config>();
+        color throughput(1.0, 1.0, 1.0);
+        ray current = r;
+        for (int bounce = 0; bounce < max_bounces; bounce++) {
+            counters.segments++;
+            RTW_STAT(if (bounce > 0) thread_stats().secondary_rays++);
+            hit_record rec;
+            // 没打中物体，路径结束于天空
+            if (!world.hit(current, interval(0.001, infinity), rec)) {
+                RTW_STAT(thread_stats().record_path(bounce + 1, path_end::escaped));
+                return throughput * sky_color(current);
+            }
+            RTW_STAT(thread_stats().ray_hits++);
+            if constexpr (Config::features)
+                if (bounce == 0)
+                    record_features(features, current, rec);
+
+            // counter模式下，这次弹射的随机数由弹射次数决定，和递归版的编号一致
+            rng.begin_bounce(uint32_t(bounce + 1));
+            ray scattered;
+            color attenuation;
+            // 材质吸收了光线，路径结束
+            bool did_scatter = scatter_material(*rec.mat, current, rec, attenuation, scattered, rng, material_dispatch);
+            RTW_STAT(thread_stats().record_scatter(rec.mat->name(), did_scatter));
+            if (!did_scatter) {
+                RTW_STAT(thread_stats().record_path(bounce + 1, path_end::absorbed));
+                return color(0, 0, 0);
+            }
+            throughput = throughput * attenuation;
+            current = scattered;
+
+            // 俄罗斯轮盘赌：以概率p继续，继续时通量除以p，
+            // 这样期望值不变(无偏)，但通量很小的路径大多会被提前结束，省下后面的求交
+            if (bounce + 1 >= rr_min_depth) {
+                double p = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 0.95);
+                if (random_double(rng) >= p) {
+                    counters.rr_terminated++;
+                    RTW_STAT(thread_stats().record_path(bounce + 1, path_end::russian_roulette));
+                    return color(0, 0, 0);
+                }
+                throughput /= p;
+            }
+        }
+        // 超过最大弹射次数，和递归版一样返回黑色
+        RTW_STAT(thread_stats().record_path(max_bounces, path_end::max_depth));
+        return color(0, 0, 0);
+    }
+
+    // 天空的颜色：按光线方向的y值在白色和浅蓝色之间插值
+    static color sky_color(const ray& r) {
+        // 归一化后的光线方向只用到y值，不用把整个向量归一化
+        // 和unit_vector一样先求模的倒数再乘，结果和归一化整个向量后取y完全相同
+        const vec3& direction = r.direction();
+        auto unit_y = (1 / direction.length()) * direction.y();
         // 把归一化的光线的y值(区间在(-1,1))缩放到[0,1]之间，命名为a
         // + 1.0是把归一化的y从[-1,1]平移到了[0,2]
         // 0.5 * 是把范围进一步缩放一半，到[0,1]
         // 这个a只是用来作为一个比例参数，决定蓝色和白色各占多少的比例(以0看作0%,以1看作100%来算)
-        auto a = 0.5 * (unit_direction.y() + 1.0);
+        auto a = 0.5 * (unit_y + 1.0);
         // 这个a用于在[0,1]之间做插值，实现颜色的过渡效果
         return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
     }
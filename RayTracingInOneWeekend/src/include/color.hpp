@@ -15,8 +15,13 @@ inline double linear_to_gamma(double linear_component)
 	return 0;
 }
 
-// 把[0,1]的RGB值转为[0,255]，并写入输出流里
-void write_color(std::ostream& out, const color& pixel_color) {
+// 线性RGB的亮度(Rec.709的权重)，人眼对绿色最敏感，所以绿色权重最大
+inline double luminance(const color& c) {
+	return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+// 把线性空间[0,1]的RGB值做gamma转换后量化成[0,255]的三个字节
+inline void color_to_bytes(const color& pixel_color, unsigned char rgb[3]) {
 	auto r = pixel_color.x();
 	auto g = pixel_color.y();
 	auto b = pixel_color.z();
@@ -29,9 +34,15 @@ void write_color(std::ostream& out, const color& pixel_color) {
 	// 把r,g,b值控制在[0,1]间
 	// 从255改成了256，因为已经用clamp控制了数的范围
 	static const interval intensity(0.000, 0.999);
-	int rbyte = int(256 * intensity.clamp(r));
-	int gbyte = int(256 * intensity.clamp(g));
-	int bbyte = int(256 * intensity.clamp(b));
+	rgb[0] = (unsigned char)(256 * intensity.clamp(r));
+	rgb[1] = (unsigned char)(256 * intensity.clamp(g));
+	rgb[2] = (unsigned char)(256 * intensity.clamp(b));
+}
+
+// 把[0,1]的RGB值转为[0,255]，并写入输出流里
+inline void write_color(std::ostream& out, const color& pixel_color) {
+	unsigned char rgb[3];
+	color_to_bytes(pixel_color, rgb);
 
-	out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+	out << int(rgb[0]) << ' ' << int(rgb[1]) << ' ' << int(rgb[2]) << '\n';
 }
\ No newline at end of file
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "framebuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// 渲染后的降噪：边缘保持的à-trous小波滤波(Dammertz等2010)，权重的取法参考SVGF(Schied等2017)的空间滤波部分
+//
+// 每次迭代用5x5的B3样条核做一次加权平均，第k次迭代的采样间隔是2^k个像素，
+// n次迭代覆盖±2(2^n - 1)个像素，而每次只读25个像素，比直接用大核快得多
+// 相邻像素q对像素p的权重是几项的乘积，特征相差大(多半隔着物体边缘)的像素几乎不参与平均：
+//   亮度：|亮度差| / (sigma_luminance * p的亮度标准差)，噪声大的地方容忍大的亮度差，噪声小的地方保留细节
+//   法线：max(0, cos夹角)^sigma_normal
+//   深度：|深度差| / (sigma_depth * 较大的深度)
+//   反射率：|反射率差|^2 / sigma_albedo^2
+// 滤波前先把颜色除以反射率(只剩光照)，滤完再乘回去，物体表面颜色的边界不会被抹平
+// 亮度方差每次迭代也按同样的权重传播，噪声随迭代下降，后面几次的亮度权重相应地变严格
+// 每个像素只有一个采样时没法估计方差，改用周围3x3个像素的亮度方差代替(同SVGF历史帧太少时的做法)
+
+// 降噪的引导特征，都是各采样点第一次击中处的值的平均，由相机在渲染时收集(camera_rt2::collect_features)
+struct denoise_guides {
+    framebuffer albedo;           // 反射率，没击中物体的采样按1算
+    framebuffer normal;           // 法线的平均(没有归一化)，没击中物体的采样按0算
+    std::vector<double> depth;    // 到相机的距离，没击中物体的采样按0算
+    std::vector<double> variance; // 像素颜色均值的亮度方差(样本方差 / 采样数)，只有一个采样估计不了时是负数
+};
+
+struct denoise_settings {
+    // 默认值按denoise_eval在随机小球场景上调的：小球只有十几个像素大，
+    // 迭代多了、法线卡得太严(SVGF用5次、128)，偏差反而比去掉的噪声多
+    int iterations = 2;           // 迭代次数
+    double sigma_luminance = 4;   // 亮度差相对于标准差的容忍倍数
+    double sigma_normal = 8;      // 法线权重的指数，越大越不允许跨过法线变化的地方
+    double sigma_depth = 0.1;     // 相对深度差的容忍度
+    double sigma_albedo = 0.1;    // 反射率差的容忍度
+    int thread_count = 0;         // 线程数，0表示使用全部硬件线程
+};
+
+namespace denoise_detail {
+
+// 把[0, height)的行分成小段，threads个线程抢着做，每段调用一次fn(起始行, 结束行)
+template <class F>
+inline void parallel_rows(int height, int threads, F&& fn) {
+    const int block = 8;
+    std::atomic<int> next{ 0 };
+    auto worker = [&]() {
+        for (int y0 = next.fetch_add(block); y0 < height; y0 = next.fetch_add(block))
+            fn(y0, std::min(height, y0 + block));
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool)
+        th.join();
+}
+
+// x^n，n是正整数时用反复平方，比std::pow快
+inline double power(double x, double n) {
+    int k = int(n);
+    if (k != n || k < 1)
+        return std::pow(x, n);
+    double result = 1;
+    for (; k > 0; k >>= 1, x *= x)
+        if (k & 1)
+            result *= x;
+    return result;
+}
+
+}
+
+// 对渲染结果noisy降噪，guides是同一次渲染收集的引导特征
+inline framebuffer denoise_image(const framebuffer& noisy, const denoise_guides& guides,
+    const denoise_settings& settings) {
+    using namespace denoise_detail;
+    const int w = noisy.width();
+    const int h = noisy.height();
+    const size_t n = size_t(w) * h;
+    int threads = settings.thread_count > 0 ? settings.thread_count : int(std::thread::hardware_concurrency());
+    threads = std::max(threads, 1);
+
+    // 去掉反射率只剩光照，法线归一化
+    const double min_albedo = 1e-3;
+    std::vector<color> albedo(n), illumination(n), next(n);
+    std::vector<vec3> normal(n);
+    std::vector<double> variance(n), next_variance(n), deviation(n);
+    parallel_rows(h, threads, [&](int y0, int y1) {
+        for (size_t k = size_t(y0) * w; k < size_t(y1) * w; k++) {
+            const color& a = guides.albedo.data()[k];
+            albedo[k] = color(std::max(double(a.x()), min_albedo), std::max(double(a.y()), min_albedo),
+                std::max(double(a.z()), min_albedo));
+            const color& c = noisy.data()[k];
+            illumination[k] = color(c.x() / albedo[k].x(), c.y() / albedo[k].y(), c.z() / albedo[k].z());
+            double l = luminance(albedo[k]);
+            variance[k] = guides.variance[k] / (l * l);
+            const vec3& nk = guides.normal.data()[k];
+            double length = nk.length();
+            normal[k] = length > 0 ? nk / length : vec3(0, 0, 0);
+        }
+    });
+    parallel_rows(h, threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+            for (int x = 0; x < w; x++) {
+                const size_t k = size_t(y) * w + x;
+                if (guides.variance[k] >= 0)
+                    continue;
+                double sum = 0, sum2 = 0;
+                int count = 0;
+                for (int qy = std::max(0, y - 1); qy <= std::min(h - 1, y + 1); qy++)
+                    for (int qx = std::max(0, x - 1); qx <= std::min(w - 1, x + 1); qx++) {
+                        double l = luminance(illumination[size_t(qy) * w + qx]);
+                        sum += l;
+                        sum2 += l * l;
+                        count++;
+                    }
+                double mean = sum / count;
+                variance[k] = std::max(0.0, sum2 / count - mean * mean);
+            }
+    });
+
+    static const double kernel[5] = { 1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16 };
+    const double inv_sigma_albedo2 = 1.0 / (settings.sigma_albedo * settings.sigma_albedo);
+    for (int iteration = 0; iteration < settings.iterations; iteration++) {
+        const int step = 1 << iteration;
+        // 单个像素的方差估计很不稳定，先做一次3x3的高斯平滑再用
+        parallel_rows(h, threads, [&](int y0, int y1) {
+            static const double gauss[3] = { 0.25, 0.5, 0.25 };
+            for (int y = y0; y < y1; y++)
+                for (int x = 0; x < w; x++) {
+                    double sum = 0, weight = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int qx = x + dx, qy = y + dy;
+                            if (qx < 0 || qy < 0 || qx >= w || qy >= h)
+                                continue;
+                            double g = gauss[dx + 1] * gauss[dy + 1];
+                            sum += g * variance[size_t(qy) * w + qx];
+                            weight += g;
+                        }
+                    deviation[size_t(y) * w + x] = std::sqrt(std::max(0.0, sum / weight));
+                }
+        });
+
+        parallel_rows(h, threads, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++)
+                for (int x = 0; x < w; x++) {
+                    const size_t p = size_t(y) * w + x;
+                    const double lp = luminance(illumination[p]);
+                    const double luminance_scale = 1.0 / (settings.sigma_luminance * deviation[p] + 1e-10);
+                    const double zp = guides.depth[p];
+                    const bool sky_p = zp <= 0;
+                    color sum(0, 0, 0);
+                    double weight_sum = 0, variance_sum = 0;
+                    for (int ky = 0; ky < 5; ky++) {
+                        int qy = y + (ky - 2) * step;
+                        if (qy < 0 || qy >= h)
+                            continue;
+                        for (int kx = 0; kx < 5; kx++) {
+                            int qx = x + (kx - 2) * step;
+                            if (qx < 0 || qx >= w)
+                                continue;
+                            const size_t q = size_t(qy) * w + qx;
+                            const double zq = guides.depth[q];
+                            // 天空和物体之间不混合
+                            if (sky_p != (zq <= 0))
+                                continue;
+                            double e = std::fabs(lp - luminance(illumination[q])) * luminance_scale;
+                            double wn = 1;
+                            // 中心像素自己的权重只有核的系数(法线可能是0，不能参与下面的计算)
+                            if (!sky_p && q != p) {
+                                e += std::fabs(zp - zq) / (settings.sigma_depth * std::max(zp, zq));
+                                vec3 da = albedo[q] - albedo[p];
+                                e += double(da.length_squared()) * inv_sigma_albedo2;
+                                wn = power(std::max(0.0, double(dot(normal[p], normal[q]))), settings.sigma_normal);
+                            }
+                            double weight = kernel[kx] * kernel[ky] * wn * std::exp(-e);
+                            sum += weight * illumination[q];
+                            weight_sum += weight;
+                            variance_sum += weight * weight * variance[q];
+                        }
+                    }
+                    // 中心像素自己的权重是kernel[2]^2 > 0，weight_sum不会是0
+                    next[p] = sum / weight_sum;
+                    next_variance[p] = variance_sum / (weight_sum * weight_sum);
+                }
+        });
+        std::swap(illumination, next);
+        std::swap(variance, next_variance);
+    }
+
+    // 乘回反射率
+    framebuffer result(w, h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            const size_t k = size_t(y) * w + x;
+            const color& a = albedo[k];
+            const color& l = illumination[k];
+            result.at(x, y) = color(l.x() * a.x(), l.y() * a.y(), l.z() * a.z());
+        }
+    return result;
+}
@@ -0,0 +1,625 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "camera_rt2.hpp"
+#include "framebuffer.hpp"
+#include "hash.hpp"
+#include "tile_scheduler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// 多进程(分布式)渲染：协调进程把图像切成块，分给若干工作进程渲染，再把交回来的块拼成整张图
+//
+// 工作进程可以是协调进程fork出来的本机进程(通过socketpair通信)，也可以是别的机器上用--connect
+// 连过来的进程(TCP)。工作进程单线程渲染，一台机器有几个核就起几个工作进程
+// 每个像素的结果只和种子、像素位置有关，所以不管块怎么分、由哪个进程渲染，拼出来的图像和单进程渲染逐位相同
+// (按采样数切分虽然也能合并，但各段的和再相加会改变浮点数的累加顺序，结果不再逐位相同，所以按块切分)
+// 工作进程中途退出(崩溃、被杀、断网)时，它领走还没交回来的块放回队列，分给别的进程；
+// 工作进程卡住(没退出但一块超过tile_timeout秒还没交回来)时也按断开处理，本机的进程直接杀掉；
+// 工作进程全都没了、又没有在监听远程连接时，剩下的块由协调进程自己渲染
+//
+// 协议：每条消息是 [类型 uint32][内容长度 uint32][内容]，整数和浮点数按本机字节序直接发送，
+// 所以所有进程要运行在字节序相同的机器上，用同一个程序、同样的场景和参数
+//   hello   工作进程 -> 协调进程  任务键(uint64)，和协调进程的不一致就断开，不给它分配任务
+//   assign  协调进程 -> 工作进程  块编号(uint32)和像素范围(4个int32)
+//   result  工作进程 -> 协调进程  块编号、路径统计(3个uint64)，然后逐个像素的颜色(3个double)，再逐个像素的采样次数(int32)
+//   quit    协调进程 -> 工作进程  没有任务了，工作进程退出
+
+enum class render_message : uint32_t {
+    hello = 1,
+    assign = 2,
+    result = 3,
+    quit = 4
+};
+
+struct distributed_options {
+    int local_workers = 0;     // fork出来的本机工作进程数
+    int listen_port = 0;       // 不为0时在这个TCP端口上接受远程工作进程的连接
+    int tile_size = 32;        // 分发的块的边长(像素)
+    int tiles_in_flight = 2;   // 每个工作进程最多同时领几块，渲染当前块时下一块已经在路上了
+    double tile_timeout = 600; // 一块从开始渲染起超过这么多秒还没交回来，就认为工作进程卡住了，0表示不限
+    int kill_worker_after = 0; // 测试容错用：第一个本机工作进程交回这么多块后，再领到块时直接退出，0表示不用
+    int hang_worker_after = 0; // 测试超时用：第一个本机工作进程交回这么多块后，再领到块时卡住不动，0表示不用
+};
+
+// 任务键：所有影响像素结果的相机和渲染参数(见camera_rt2::settings_key)，加上采样数、自适应采样的参数
+// 和场景内容的摘要(见scene_digest)，协调进程和工作进程的任务键一致，才能保证拼出来的图像和单进程渲染的相同
+inline uint64_t render_job_key(const camera_rt2& cam, uint64_t scene) {
+    double reals[] = { cam.adaptive_threshold };
+    int64_t ints[] = { cam.samples_per_pixel, cam.adaptive_sampling, cam.min_samples, cam.adaptive_batch };
+    uint64_t h = hash_bytes(reals, sizeof(reals), hash_combine(cam.settings_key(), scene));
+    return hash_bytes(ints, sizeof(ints), h);
+}
+
+namespace distributed_detail {
+
+// 按顺序往消息内容里追加定长的值
+struct message_writer {
+    std::vector<char> bytes;
+
+    template <class T>
+    void put(const T& v) {
+        const char* p = reinterpret_cast<const char*>(&v);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+};
+
+// 按顺序从消息内容里读出定长的值，内容不够长时返回false
+struct message_reader {
+    const std::vector<char>& bytes;
+    size_t offset = 0;
+
+    template <class T>
+    bool get(T& v) {
+        if (bytes.size() - offset < sizeof(T))
+            return false;
+        std::memcpy(&v, bytes.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+};
+
+inline int tile_pixel_count(const tile& t) {
+    return (t.x1 - t.x0) * (t.y1 - t.y0);
+}
+
+}
+
+#ifndef _WIN32
+
+namespace distributed_detail {
+
+// 往已经断开的连接上写时返回错误，而不是让SIGPIPE杀掉进程；不改进程全局的信号处理
+// Linux用MSG_NOSIGNAL，没有这个标志的系统(macOS)在套接字上设置SO_NOSIGPIPE(见set_no_sigpipe)
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+inline void set_no_sigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
+
+inline bool write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, send_flags);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+// 读满size个字节，对方关闭连接或出错时返回false
+inline bool read_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+inline bool send_message(int fd, render_message type, const std::vector<char>& payload) {
+    uint32_t header[2] = { uint32_t(type), uint32_t(payload.size()) };
+    return write_all(fd, header, sizeof(header)) && write_all(fd, payload.data(), payload.size());
+}
+
+inline bool receive_message(int fd, render_message& type, std::vector<char>& payload) {
+    uint32_t header[2];
+    if (!read_all(fd, header, sizeof(header)))
+        return false;
+    // 一块的结果不会超过这个大小，超过了说明连上来的不是工作进程
+    if (header[1] > (1u << 30))
+        return false;
+    type = render_message(header[0]);
+    payload.resize(header[1]);
+    return read_all(fd, payload.data(), payload.size());
+}
+
+// 块的结果都是小消息，关掉Nagle算法，免得攒包增加延迟
+inline void set_no_delay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    set_no_sigpipe(fd);
+}
+
+inline int open_listen_socket(int port, std::string& error) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* list = nullptr;
+    if (getaddrinfo(nullptr, std::to_string(port).c_str(), &hints, &list) != 0) {
+        error = "cannot resolve listen address";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* a = list; a && fd < 0; a = a->ai_next) {
+        fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, a->ai_addr, a->ai_addrlen) != 0 || ::listen(fd, 64) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd < 0)
+        error = "cannot listen on port " + std::to_string(port) + ": " + std::strerror(errno);
+    return fd;
+}
+
+}
+
+// 连接到协调进程，address是"主机:端口"，失败返回-1
+inline int connect_to_coordinator(const std::string& address, std::string& error) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        error = "expected host:port, got " + address;
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* list = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &list) != 0) {
+        error = "cannot resolve " + address;
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* a = list; a && fd < 0; a = a->ai_next) {
+        fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd < 0) {
+        error = "cannot connect to " + address + ": " + std::strerror(errno);
+        return -1;
+    }
+    distributed_detail::set_no_delay(fd);
+    return fd;
+}
+
+// 工作进程：在fd这条连接上领块、渲染、交回结果，直到协调进程发来quit，结束时关闭fd
+// cam的参数和协调进程的一致(由任务键核对)，exit_after大于0时交回这么多块后再领到块就直接返回失败(测试容错用)，
+// hang_after大于0时交回这么多块后再领到块就一直等着不渲染，直到被协调进程杀掉或断开(测试超时用)
+inline bool run_render_worker(int fd, camera_rt2& cam, const hittable& world, uint64_t job_key, int exit_after,
+    std::string& error, int hang_after = 0) {
+    using namespace distributed_detail;
+    cam.prepare();
+    const int width = cam.image_width;
+    const int height = cam.get_image_height();
+    framebuffer image(width, height);
+    std::vector<int> spp(size_t(width) * height, 0);
+
+    message_writer hello;
+    hello.put(job_key);
+    bool ok = send_message(fd, render_message::hello, hello.bytes);
+    int tiles_done = 0;
+    render_message type;
+    std::vector<char> payload;
+    while (ok) {
+        if (!receive_message(fd, type, payload)) {
+            error = "lost connection to coordinator";
+            ok = false;
+            break;
+        }
+        if (type == render_message::quit)
+            break;
+        message_reader in{ payload };
+        uint32_t index;
+        tile t;
+        if (type != render_message::assign || !in.get(index) || !in.get(t.x0) || !in.get(t.y0)
+            || !in.get(t.x1) || !in.get(t.y1)
+            || t.x0 < 0 || t.y0 < 0 || t.x1 > width || t.y1 > height || t.x0 >= t.x1 || t.y0 >= t.y1) {
+            error = "malformed message from coordinator";
+            ok = false;
+            break;
+        }
+        if (exit_after > 0 && tiles_done >= exit_after) {
+            error = "simulated worker failure";
+            ok = false;
+            break;
+        }
+        if (hang_after > 0 && tiles_done >= hang_after) {
+            // 协调进程超时后会关闭连接，读到断开再退出
+            char byte;
+            while (::read(fd, &byte, 1) > 0) {}
+            error = "simulated worker hang";
+            ok = false;
+            break;
+        }
+
+        path_counters counters;
+        cam.render_region(world, t, image, spp, counters);
+
+        message_writer out;
+        out.bytes.reserve(4 + 3 * 8 + size_t(tile_pixel_count(t)) * (3 * sizeof(double) + sizeof(int32_t)));
+        out.put(index);
+        out.put(counters.paths);
+        out.put(counters.segments);
+        out.put(counters.rr_terminated);
+        for (int j = t.y0; j < t.y1; j++)
+            for (int i = t.x0; i < t.x1; i++) {
+                const color& c = image.at(i, j);
+                out.put(double(c.x()));
+                out.put(double(c.y()));
+                out.put(double(c.z()));
+            }
+        for (int j = t.y0; j < t.y1; j++)
+            for (int i = t.x0; i < t.x1; i++)
+                out.put(int32_t(spp[size_t(j) * width + i]));
+        ok = send_message(fd, render_message::result, out.bytes);
+        if (!ok)
+            error = "lost connection to coordinator";
+        tiles_done++;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// 协调进程：fork出options.local_workers个本机工作进程，listen_port不为0时再接受远程工作进程，
+// 把图像按块分给它们，结果拼到image和spp(每个像素实际的采样次数)里
+inline bool render_distributed(camera_rt2& cam, const hittable& world, uint64_t job_key,
+    const distributed_options& options, framebuffer& image, std::vector<int>& spp, std::string& error) {
+    using namespace distributed_detail;
+    cam.prepare();
+    const int width = cam.image_width;
+    const int height = cam.get_image_height();
+    image = framebuffer(width, height);
+    spp.assign(size_t(width) * height, 0);
+
+    // 按行优先切块，块编号就是在这个数组里的下标
+    std::vector<tile> tiles;
+    {
+        tile_scheduler scheduler(width, height, options.tile_size, 1);
+        tile t;
+        while (scheduler.next(0, t))
+            tiles.push_back(t);
+    }
+    std::vector<char> tile_done(tiles.size(), 0);
+    std::deque<uint32_t> pending;
+    for (uint32_t k = 0; k < tiles.size(); k++)
+        pending.push_back(k);
+
+    using clock = std::chrono::steady_clock;
+    struct worker_slot {
+        worker_slot(int fd, pid_t pid, std::string name) : fd(fd), pid(pid), name(std::move(name)) {}
+
+        int fd;
+        pid_t pid;           // 本机工作进程的进程号，远程的为-1
+        std::string name;
+        bool alive = true;
+        bool ready = false;  // 收到并核对过hello
+        std::vector<uint32_t> in_flight;
+        clock::time_point deadline; // in_flight里第一块(正在渲染的那块)应该交回来的时间
+        int tiles_done = 0;
+    };
+    std::vector<worker_slot> workers;
+    const bool use_timeout = options.tile_timeout > 0;
+    const auto tile_timeout = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(use_timeout ? options.tile_timeout : 0));
+
+    std::clog << std::flush;
+    for (int w = 0; w < options.local_workers; w++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            std::clog << "Cannot create worker " << w << ": " << std::strerror(errno) << "\n";
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // 子进程：关掉协调进程这一端和之前的工作进程的连接，渲染完直接退出，不执行父进程的析构和清理
+            ::close(fds[0]);
+            for (const auto& other : workers)
+                ::close(other.fd);
+            cam.thread_count = 1;
+            std::string worker_error;
+            bool ok = run_render_worker(fds[1], cam, world, job_key, w == 0 ? options.kill_worker_after : 0,
+                worker_error, w == 0 ? options.hang_worker_after : 0);
+            _exit(ok ? 0 : 1);
+        }
+        ::close(fds[1]);
+        if (pid < 0) {
+            ::close(fds[0]);
+            std::clog << "Cannot fork worker " << w << ": " << std::strerror(errno) << "\n";
+            break;
+        }
+        set_no_sigpipe(fds[0]);
+        workers.emplace_back(fds[0], pid, "local worker " + std::to_string(w));
+    }
+
+    int listen_fd = -1;
+    if (options.listen_port > 0) {
+        listen_fd = open_listen_socket(options.listen_port, error);
+        if (listen_fd < 0)
+            return false;
+        std::clog << "Listening for workers on port " << options.listen_port << "\n";
+    }
+
+    size_t remaining = tiles.size();
+    size_t reassigned = 0;
+    int lost = 0;
+    path_counters counters;
+    stage_timer timer;
+    double render_seconds = 0;
+
+    // 工作进程断开：收回它手上的块，放到队列前面优先重新分配
+    // 超时的本机工作进程还活着，先杀掉，免得最后waitpid一直等它
+    auto lose_worker = [&](worker_slot& wk, const char* reason) {
+        wk.alive = false;
+        if (wk.pid > 0)
+            kill(wk.pid, SIGKILL);
+        ::close(wk.fd);
+        if (!wk.ready && wk.in_flight.empty() && wk.pid < 0) {
+            std::clog << "\r" << wk.name << " rejected: " << reason << "\n";
+            return;
+        }
+        lost++;
+        reassigned += wk.in_flight.size();
+        for (auto it = wk.in_flight.rbegin(); it != wk.in_flight.rend(); ++it)
+            pending.push_front(*it);
+        std::clog << "\r" << wk.name << " lost (" << reason << ") after " << wk.tiles_done << " tiles, reassigning "
+            << wk.in_flight.size() << " tiles\n";
+        wk.in_flight.clear();
+    };
+
+    // 收下一块的结果，内容不对时返回false
+    auto accept_result = [&](worker_slot& wk, const std::vector<char>& payload) {
+        message_reader in{ payload };
+        uint32_t index;
+        path_counters c;
+        if (!in.get(index) || index >= tiles.size())
+            return false;
+        auto it = std::find(wk.in_flight.begin(), wk.in_flight.end(), index);
+        const tile& t = tiles[index];
+        size_t expected = 4 + 3 * 8 + size_t(tile_pixel_count(t)) * (3 * sizeof(double) + sizeof(int32_t));
+        if (it == wk.in_flight.end() || payload.size() != expected
+            || !in.get(c.paths) || !in.get(c.segments) || !in.get(c.rr_terminated))
+            return false;
+        wk.in_flight.erase(it);
+        wk.tiles_done++;
+        // 下一块从现在开始渲染
+        wk.deadline = clock::now() + tile_timeout;
+        // 同一块可能被重新分配过，只收第一份
+        if (tile_done[index])
+            return true;
+        for (int j = t.y0; j < t.y1; j++)
+            for (int i = t.x0; i < t.x1; i++) {
+                double rgb[3] = { 0, 0, 0 };
+                in.get(rgb[0]);
+                in.get(rgb[1]);
+                in.get(rgb[2]);
+                image.at(i, j) = color(rgb[0], rgb[1], rgb[2]);
+            }
+        for (int j = t.y0; j < t.y1; j++)
+            for (int i = t.x0; i < t.x1; i++) {
+                int32_t n = 0;
+                in.get(n);
+                spp[size_t(j) * width + i] = n;
+            }
+        tile_done[index] = 1;
+        remaining--;
+        counters += c;
+        return true;
+    };
+
+    render_message type;
+    std::vector<char> payload;
+    while (remaining > 0) {
+        // 给核对过的工作进程补满块
+        for (auto& wk : workers) {
+            while (wk.alive && wk.ready && int(wk.in_flight.size()) < options.tiles_in_flight && !pending.empty()) {
+                uint32_t k = pending.front();
+                pending.pop_front();
+                if (tile_done[k])
+                    continue;
+                const tile& t = tiles[k];
+                message_writer out;
+                out.put(k);
+                out.put(t.x0);
+                out.put(t.y0);
+                out.put(t.x1);
+                out.put(t.y1);
+                if (wk.in_flight.empty())
+                    wk.deadline = clock::now() + tile_timeout;
+                wk.in_flight.push_back(k);
+                if (!send_message(wk.fd, render_message::assign, out.bytes))
+                    lose_worker(wk, "write failed");
+            }
+        }
+
+        bool any_alive = std::any_of(workers.begin(), workers.end(), [](const worker_slot& wk) { return wk.alive; });
+        if (!any_alive && listen_fd < 0) {
+            // 没有工作进程了，剩下的块自己渲染
+            std::clog << "\rNo workers left, rendering the remaining " << remaining << " tiles locally\n";
+            for (uint32_t k : pending) {
+                if (tile_done[k])
+                    continue;
+                cam.render_region(world, tiles[k], image, spp, counters);
+                tile_done[k] = 1;
+                remaining--;
+            }
+            pending.clear();
+            break;
+        }
+
+        // 等任意一个工作进程交回结果(或断开)，监听时也等新的连接，最多等到最早的一块超时
+        std::vector<pollfd> fds;
+        std::vector<size_t> owner;
+        int wait_ms = -1;
+        const auto now = clock::now();
+        for (size_t w = 0; w < workers.size(); w++) {
+            if (!workers[w].alive)
+                continue;
+            fds.push_back({ workers[w].fd, POLLIN, 0 });
+            owner.push_back(w);
+            if (use_timeout && !workers[w].in_flight.empty()) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(workers[w].deadline - now).count() + 1;
+                int ms = int(std::max<long long>(0, std::min<long long>(left, 60 * 60 * 1000)));
+                wait_ms = wait_ms < 0 ? ms : std::min(wait_ms, ms);
+            }
+        }
+        if (listen_fd >= 0)
+            fds.push_back({ listen_fd, POLLIN, 0 });
+        if (::poll(fds.data(), fds.size(), wait_ms) < 0) {
+            if (errno == EINTR)
+                continue;
+            error = std::string("poll failed: ") + std::strerror(errno);
+            break;
+        }
+
+        for (size_t f = 0; f < owner.size(); f++) {
+            if (fds[f].revents == 0)
+                continue;
+            worker_slot& wk = workers[owner[f]];
+            if (!receive_message(wk.fd, type, payload)) {
+                lose_worker(wk, "connection closed");
+                continue;
+            }
+            if (type == render_message::hello && !wk.ready) {
+                message_reader in{ payload };
+                uint64_t key = 0;
+                if (!in.get(key) || key != job_key)
+                    lose_worker(wk, "different scene or render settings");
+                else
+                    wk.ready = true;
+            }
+            else if (type != render_message::result || !accept_result(wk, payload)) {
+                lose_worker(wk, "malformed message");
+            }
+        }
+        // 没有按时交回块的工作进程按断开处理，块重新分配
+        if (use_timeout) {
+            const auto checked = clock::now();
+            for (size_t w : owner) {
+                worker_slot& wk = workers[w];
+                if (wk.alive && !wk.in_flight.empty() && checked >= wk.deadline)
+                    lose_worker(wk, "tile timed out");
+            }
+        }
+        if (listen_fd >= 0 && (fds.back().revents & POLLIN)) {
+            sockaddr_storage peer;
+            socklen_t peer_size = sizeof(peer);
+            int fd = ::accept(listen_fd, reinterpret_cast<sockaddr*>(&peer), &peer_size);
+            if (fd >= 0) {
+                char host[NI_MAXHOST] = "?";
+                char port[NI_MAXSERV] = "?";
+                getnameinfo(reinterpret_cast<sockaddr*>(&peer), peer_size, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV);
+                set_no_delay(fd);
+                workers.emplace_back(fd, -1, std::string("worker ") + host + ":" + port);
+                std::clog << "\r" << workers.back().name << " connected\n";
+            }
+        }
+        std::clog << "\rTiles remaining: " << remaining << "    " << std::flush;
+    }
+    timer.lap(render_seconds);
+
+    // 通知还在的工作进程退出，再回收本机的子进程
+    for (auto& wk : workers) {
+        if (!wk.alive)
+            continue;
+        send_message(wk.fd, render_message::quit, {});
+        ::close(wk.fd);
+    }
+    if (listen_fd >= 0)
+        ::close(listen_fd);
+    for (const auto& wk : workers)
+        if (wk.pid > 0)
+            waitpid(wk.pid, nullptr, 0);
+    if (remaining > 0)
+        return false;
+
+    int used = int(std::count_if(workers.begin(), workers.end(), [](const worker_slot& wk) { return wk.tiles_done > 0; }));
+    std::clog << "\rDone.                 \n";
+    std::clog << "Distributed render: " << tiles.size() << " tiles on " << used << " workers, " << lost
+        << " workers lost, " << reassigned << " tiles reassigned, render time " << render_seconds << " s\n";
+    std::clog << "Paths: " << counters.paths << ", rays: " << counters.segments << "\n";
+    return true;
+}
+
+#else
+
+// Windows下没有fork和POSIX套接字，暂不支持分布式渲染
+inline int connect_to_coordinator(const std::string&, std::string& error) {
+    error = "distributed rendering is only supported on POSIX systems";
+    return -1;
+}
+
+inline bool run_render_worker(int, camera_rt2&, const hittable&, uint64_t, int, std::string& error, int = 0) {
+    error = "distributed rendering is only supported on POSIX systems";
+    return false;
+}
+
+inline bool render_distributed(camera_rt2&, const hittable&, uint64_t, const distributed_options&,
+    framebuffer&, std::vector<int>&, std::string& error) {
+    error = "distributed rendering is only supported on POSIX systems";
+    return false;
+}
+
+#endif
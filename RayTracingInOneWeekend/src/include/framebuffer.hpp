@@ -0,0 +1,29 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <vector>
+
+// 整张图像的像素缓冲，按行优先存储，(0,0)是左上角
+// 渲染线程把结果写到各自负责的像素里，全部渲染完后再一次性输出
+class framebuffer {
+public:
+    framebuffer() {}
+    framebuffer(int width, int height)
+        : w(width), h(height), pixels(size_t(width) * height) {}
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    // 取第j行第i列的像素
+    color& at(int i, int j) { return pixels[size_t(j) * w + i]; }
+    const color& at(int i, int j) const { return pixels[size_t(j) * w + i]; }
+
+    // 所有像素，按行优先排列
+    const std::vector<color>& data() const { return pixels; }
+
+private:
+    int w = 0;
+    int h = 0;
+    std::vector<color> pixels;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 整数哈希，用来从(种子, 像素, 采样, 弹射次数, 维度)这样的坐标得到看起来随机的键
+
+// 把一个64位整数打散成另一个看起来随机的64位整数(splitmix64的输出函数)
+inline uint64_t mix_bits(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// 把多个整数合成一个64位的键，用于从(像素, 采样, 弹射次数)这样的坐标生成种子
+inline uint64_t hash_combine(uint64_t a, uint64_t b) {
+    return mix_bits(a ^ (b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2)));
+}
+
+// 一段内存的哈希，每次取8个字节合进去，用来给场景这样的大块数据算摘要(不要求密码学强度)
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = hash_combine(seed, size);
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = hash_combine(h, word);
+    }
+    uint64_t tail = 0;
+    if (size > 0)
+        std::memcpy(&tail, p, size);
+    return hash_combine(h, tail);
+}
@@ -2,6 +2,10 @@
 
 #include "rtweekend.hpp"
 
+#include "aabb.hpp"
+
+#include <string>
+
 // 类前置声明，避免类循环依赖
 class material;
 
@@ -12,9 +16,13 @@ public:
     point3 p;
     // 碰撞点的法线向量
     vec3 normal;
-    shared_ptr<material> mat;
+    // 碰撞点的材质，不持有所有权，材质由场景的material_table持有
+    // 用裸指针而不是shared_ptr，这样拷贝hit_record时不会有引用计数的原子加减
+    const material* mat = nullptr;
+    // 碰撞到的物体的编号(场景文件里球的序号)，输出物体编号的AOV用，没有编号的物体是-1
+    int object_id = -1;
     // 光线的t(r = Q + td中的t),即何时碰撞到的
-    double t;
+    real t;
     // 是否是正面(正面就是说光线是从物体外面碰到的)
     bool front_face;
     // 设置面的法线，若是正面，法线朝向物体外，否则，法线朝向物体内
@@ -35,4 +43,24 @@ public:
     virtual ~hittable() = default;
     // 碰撞检测函数，参数依次为:光线对象ray, tmin, tmax, 碰撞的信息(用来返回)
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
-};
\ No newline at end of file
+    // 返回能包住这个物体的包围盒，用于构建BVH
+    virtual aabb bounding_box() const = 0;
+};
+
+// 求交和散射的分派方式
+// closed_set: 场景里常用的几种物体和材质(见primitive_dispatch.hpp和material.hpp)按类型标记switch到具体的类，
+//             调用是普通的函数调用，编译器可以把它们内联进BVH遍历和着色的循环里；不认识的类型仍然走虚函数
+// virtual_calls: 全部通过虚函数调用，和以前一样
+// 两种方式的结果完全相同，只是调用的方式不同
+enum class dispatch_mode {
+    closed_set,
+    virtual_calls,
+};
+
+// 按名字(closed/virtual)取分派方式，不认识的名字返回false
+inline bool parse_dispatch_mode(const std::string& name, dispatch_mode& mode) {
+    if (name == "closed") mode = dispatch_mode::closed_set;
+    else if (name == "virtual") mode = dispatch_mode::virtual_calls;
+    else return false;
+    return true;
+}
@@ -13,10 +13,15 @@ public:
     // 构造器：可通过一个hittable对象创建，并把这个对象加到objects列表里
     hittable_list(shared_ptr<hittable> object) { add(object); }
     // 清楚objects列表所有内容
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
     // 添加一个hittable对象
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
+        // 每加一个物体，就把整体包围盒扩大到能包住它
+        bbox = aabb(bbox, object->bounding_box());
     }
     // 检测这些物体是否与光线碰撞，若有，则返回objects列表里的最后一个碰撞信息，并且返回true
     bool hit(const ray& r,interval ray_t, hit_record& rec) const override {
@@ -38,4 +43,10 @@ public:
 
         return hit_anything;
     }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    // 列表里所有物体的包围盒
+    aabb bbox;
 };
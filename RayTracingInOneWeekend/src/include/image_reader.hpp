@@ -0,0 +1,115 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "framebuffer.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// 读取image_writer写出的图像(P3、P6、PFM)，用于比较两次渲染的结果
+// PFM读出来是线性的HDR值；PPM读出来是gamma校正后的值除以255，在[0,1]之间
+
+namespace image_reader_detail {
+
+// 跳过空白和#开头的注释，读一个十进制整数或浮点数的文本
+inline bool next_token(const std::vector<char>& data, size_t& pos, std::string& token) {
+    while (pos < data.size()) {
+        char c = data[pos];
+        if (c == '#') {
+            while (pos < data.size() && data[pos] != '\n') pos++;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            pos++;
+        }
+        else {
+            break;
+        }
+    }
+    token.clear();
+    while (pos < data.size()) {
+        char c = data[pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            break;
+        token.push_back(c);
+        pos++;
+    }
+    return !token.empty();
+}
+
+}
+
+// 从文件读图像，失败时在error里写原因并返回false
+inline bool read_image(const std::string& path, framebuffer& image, std::string& error) {
+    using image_reader_detail::next_token;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t pos = 0;
+    std::string magic, width_text, height_text, scale_text;
+    if (!next_token(data, pos, magic) || !next_token(data, pos, width_text)
+        || !next_token(data, pos, height_text) || !next_token(data, pos, scale_text)) {
+        error = path + ": truncated header";
+        return false;
+    }
+    int w = std::atoi(width_text.c_str());
+    int h = std::atoi(height_text.c_str());
+    if (w <= 0 || h <= 0) {
+        error = path + ": bad image size";
+        return false;
+    }
+    image = framebuffer(w, h);
+    const size_t pixel_count = size_t(w) * h;
+
+    if (magic == "P3") {
+        std::string r, g, b;
+        for (size_t k = 0; k < pixel_count; k++) {
+            if (!next_token(data, pos, r) || !next_token(data, pos, g) || !next_token(data, pos, b)) {
+                error = path + ": truncated pixel data";
+                return false;
+            }
+            image.at(int(k % w), int(k / w)) = color(std::atoi(r.c_str()), std::atoi(g.c_str()), std::atoi(b.c_str())) / 255.0;
+        }
+        return true;
+    }
+
+    // 二进制格式的头部后面只跟一个空白字符
+    pos++;
+    if (magic == "P6") {
+        if (data.size() < pos + pixel_count * 3) {
+            error = path + ": truncated pixel data";
+            return false;
+        }
+        const auto* in = reinterpret_cast<const unsigned char*>(data.data() + pos);
+        for (size_t k = 0; k < pixel_count; k++, in += 3)
+            image.at(int(k % w), int(k / w)) = color(in[0], in[1], in[2]) / 255.0;
+        return true;
+    }
+    if (magic == "PF") {
+        if (data.size() < pos + pixel_count * 3 * sizeof(float)) {
+            error = path + ": truncated pixel data";
+            return false;
+        }
+        // 比例因子为负表示小端，image_writer总是写小端；行是从下往上存的
+        const char* in = data.data() + pos;
+        for (int j = h - 1; j >= 0; j--) {
+            for (int i = 0; i < w; i++) {
+                float rgb[3];
+                std::memcpy(rgb, in, sizeof(rgb));
+                in += sizeof(rgb);
+                image.at(i, j) = color(rgb[0], rgb[1], rgb[2]);
+            }
+        }
+        return true;
+    }
+    error = path + ": unsupported format " + magic;
+    return false;
+}
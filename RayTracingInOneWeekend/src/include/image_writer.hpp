@@ -0,0 +1,128 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "framebuffer.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// 图像输出格式
+enum class image_format {
+    ppm_ascii,  // P3：文本PPM，每个像素三个十进制数，兼容以前的输出
+    ppm_binary, // P6：二进制PPM，每个像素3个字节，gamma校正后的8位颜色
+    pfm         // PF：每个通道32位浮点数，不做gamma，保留线性HDR值，方便后期合成
+};
+
+// 按名字取格式，支持 "ppm"/"p3"、"p6"、"pfm"，不认识的名字返回false
+inline bool parse_image_format(const std::string& name, image_format& format) {
+    if (name == "ppm" || name == "p3") format = image_format::ppm_ascii;
+    else if (name == "p6") format = image_format::ppm_binary;
+    else if (name == "pfm") format = image_format::pfm;
+    else return false;
+    return true;
+}
+
+// 按文件后缀推断格式：.pfm是浮点格式，其余都按二进制PPM处理
+inline image_format image_format_from_path(const std::string& path) {
+    auto dot = path.rfind('.');
+    if (dot != std::string::npos && path.substr(dot) == ".pfm")
+        return image_format::pfm;
+    return image_format::ppm_binary;
+}
+
+// 把整张图像按指定格式编码到内存里，调用者再一次性写出去
+// 这样不管图像多大，都只有一次写操作，而不是每个像素都经过一次流的格式化
+inline std::vector<char> encode_image(const framebuffer& image, image_format format) {
+    const int w = image.width();
+    const int h = image.height();
+    std::vector<char> buffer;
+
+    auto append = [&buffer](const std::string& text) {
+        buffer.insert(buffer.end(), text.begin(), text.end());
+    };
+
+    switch (format) {
+    case image_format::ppm_ascii: {
+        append("P3\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n");
+        // 每个像素最多"255 255 255\n"共12个字符
+        buffer.reserve(buffer.size() + size_t(w) * h * 12);
+        char line[16];
+        for (const auto& c : image.data()) {
+            unsigned char rgb[3];
+            color_to_bytes(c, rgb);
+            int n = std::snprintf(line, sizeof(line), "%d %d %d\n", rgb[0], rgb[1], rgb[2]);
+            buffer.insert(buffer.end(), line, line + n);
+        }
+        break;
+    }
+    case image_format::ppm_binary: {
+        append("P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n");
+        size_t header = buffer.size();
+        buffer.resize(header + size_t(w) * h * 3);
+        auto* out = reinterpret_cast<unsigned char*>(buffer.data() + header);
+        for (const auto& c : image.data()) {
+            color_to_bytes(c, out);
+            out += 3;
+        }
+        break;
+    }
+    case image_format::pfm: {
+        // 比例因子为负数表示小端字节序
+        append("PF\n" + std::to_string(w) + " " + std::to_string(h) + "\n-1.0\n");
+        size_t header = buffer.size();
+        buffer.resize(header + size_t(w) * h * 3 * sizeof(float));
+        char* out = buffer.data() + header;
+        // PFM的行是从下往上存的
+        for (int j = h - 1; j >= 0; j--) {
+            for (int i = 0; i < w; i++) {
+                const color& c = image.at(i, j);
+                float rgb[3] = { float(c.x()), float(c.y()), float(c.z()) };
+                std::memcpy(out, rgb, sizeof(rgb));
+                out += sizeof(rgb);
+            }
+        }
+        break;
+    }
+    }
+    return buffer;
+}
+
+// 把图像写到输出流
+inline bool write_image(const framebuffer& image, image_format format, std::ostream& out) {
+    auto buffer = encode_image(image, format);
+    out.write(buffer.data(), std::streamsize(buffer.size()));
+    out.flush();
+    return bool(out);
+}
+
+// 把图像写到文件，path为空或"-"时写到标准输出
+inline bool write_image(const framebuffer& image, image_format format, const std::string& path) {
+    if (path.empty() || path == "-") {
+#ifdef _WIN32
+        // Windows的标准输出默认是文本模式，会把'\n'换成"\r\n"，二进制数据会被破坏
+        if (format != image_format::ppm_ascii)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return write_image(image, format, std::cout);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return false;
+    }
+    if (!write_image(image, format, file)) {
+        std::cerr << "Cannot write " << path << "\n";
+        return false;
+    }
+    return true;
+}
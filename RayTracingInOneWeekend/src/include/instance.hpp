@@ -0,0 +1,42 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "transform.hpp"
+
+// 实例：同一个几何体(原型)按不同的仿射变换在场景里放很多份
+// 每个实例只存一个指向原型的指针和一个变换，原型的数据只有一份，
+// 放一百万份一个复杂的物体，内存也只多一百万个(指针 + 变换)
+//
+// 求交时把光线变换到原型自己的坐标系里(物体空间)，和原型求交，再把结果变换回来：
+// 仿射变换保持直线上的参数，物体空间里光线的t就是世界空间里的t(方向不归一化)，
+// 所以交点直接按世界空间的光线取r.at(t)；法线要用变换矩阵的逆转置来变换，
+// 存的正好是逆变换，取它的转置即可，法线和光线方向的点积符号不变，front_face也不用重新算
+// 实例本身也是hittable，可以放进BVH，原型也可以是一棵BVH(或者另一个实例)
+class instance final : public hittable {
+public:
+    // object是原型，instance不持有它，由调用者保证原型比实例活得久(比如放在场景的一个列表里)
+    // object_to_world把原型放到场景里，必须可逆
+    instance(const hittable* object, const affine_transform& object_to_world)
+        : object(object), world_to_object(object_to_world.inverse()) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        ray local(world_to_object.apply_point(r.origin()), world_to_object.apply_vector(r.direction()));
+        if (!object->hit(local, ray_t, rec))
+            return false;
+        rec.p = r.at(rec.t);
+        rec.normal = unit_vector(world_to_object.apply_transposed(rec.normal));
+        return true;
+    }
+
+    // 包围盒只在建BVH时用到，所以不存，用的时候把逆变换再求一次逆
+    aabb bounding_box() const override {
+        return world_to_object.inverse().apply_box(object->bounding_box());
+    }
+
+private:
+    const hittable* object;            // 原型
+    affine_transform world_to_object;  // 世界空间到物体空间的变换
+};
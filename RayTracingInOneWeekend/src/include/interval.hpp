@@ -1,37 +1,53 @@
 #pragma once
 
-// 描述一对起始值的类，比如tmin,tmax
-class interval {
+// 描述一对起始值的类，比如tmin,tmax，数值类型T在编译期决定
+template <class T>
+class basic_interval {
 public:
-    // 最小，最大值，双精度浮点数
-    double min, max;
+    // 最小，最大值
+    T min, max;
     // 这里最小定义的是正无穷，最大是负无穷
-    // 这里的无穷指的是double的最大值
-    interval() : min(+infinity), max(-infinity) {}
+    // 这里的无穷指的是T的最大值
+    basic_interval() : min(T(+infinity)), max(T(-infinity)) {}
     // 也可以自己定义最小最大值
-    interval(double min, double max) : min(min), max(max) {}
+    basic_interval(T min, T max) : min(min), max(max) {}
+    // 用两个区间构造出能同时包住它们的最小区间
+    basic_interval(const basic_interval& a, const basic_interval& b) {
+        min = a.min <= b.min ? a.min : b.min;
+        max = a.max >= b.max ? a.max : b.max;
+    }
     // 指最大最小值的差
-    double size() const {
+    T size() const {
         return max - min;
     }
     // 一个值是否在[min,max]间
-    bool contains(double x) const {
+    bool contains(T x) const {
         return min <= x && x <= max;
     }
     // 一个值是否在(min,max)间
-    bool surrounds(double x) const {
+    bool surrounds(T x) const {
         return min < x && x < max;
     }
     // 看某数是否超界，若超界，就取离得最近的边界
-    double clamp(double x) const {
+    T clamp(T x) const {
         if (x < min) return min;
         if (x > max) return max;
         return x;
     }
+    // 把区间两边各往外扩delta/2，用于防止包围盒在某个轴上厚度为0
+    basic_interval expand(T delta) const {
+        auto padding = delta / 2;
+        return basic_interval(min - padding, max + padding);
+    }
     // 两个预定义的interval对象
-    static const interval empty, universe;
+    static const basic_interval empty, universe;
 };
 // 空代表正无穷到负无穷，不会有任何数在之间
-const interval interval::empty = interval(+infinity, -infinity);
+template <class T>
+const basic_interval<T> basic_interval<T>::empty = basic_interval<T>(T(+infinity), T(-infinity));
 // 全局，代表负无穷到正无穷，所有数都在里面
-const interval interval::universe = interval(-infinity, +infinity);
\ No newline at end of file
+template <class T>
+const basic_interval<T> basic_interval<T>::universe = basic_interval<T>(T(-infinity), T(+infinity));
+
+// 渲染器使用的区间类型
+using interval = basic_interval<real>;
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hash.hpp"
+
+// 低差异序列的基本构件：Sobol序列的前两维、Owen置乱、相关多重抖动(CMJ)分层采样
+// 都是无状态的函数，给定(采样序号, 种子)直接算出样本，任意顺序、任意线程算出来都一样
+// 用法见random.hpp里rng_state的采样器部分
+
+// 32位整数按位反转
+inline uint32_t reverse_bits32(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// 32位定点小数转成[0,1)的双精度数
+inline double fixed32_to_unit(uint32_t v) {
+    return v * (1.0 / 4294967296.0);
+}
+
+// Sobol序列第0维(就是以2为底的van der Corput序列)
+inline uint32_t sobol_dimension0(uint32_t index) {
+    return reverse_bits32(index);
+}
+
+// Sobol序列第1维，生成矩阵是模2的帕斯卡矩阵：每一列是上一列异或它自己右移一位
+// 前2^k个点在这两维上构成(0,2)网：任意面积为2^-k的二进初等矩形里恰好有一个点
+inline uint32_t sobol_dimension1(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+        if (index & 1u)
+            result ^= v;
+    return result;
+}
+
+// Laine-Karras置换(常数取自Burley 2020和pbrt-v4)：每一位按比它低的所有位决定是否翻转
+// 把按位反转后的数传进来，就变成按更高的位决定，也就是Owen置乱
+inline uint32_t laine_karras_permutation(uint32_t v, uint32_t seed) {
+    v ^= v * 0x3d20adeau;
+    v += seed;
+    v *= (seed >> 16) | 1u;
+    v ^= v * 0x05526c56u;
+    v ^= v * 0x53a22864u;
+    return v;
+}
+
+// 基于哈希的Owen置乱
+// 把v看成二进制小数，每一位按它前面所有更高位的值决定是否翻转，相当于随机地交换二叉树的左右子树，
+// 置乱后前2^k个点仍是(0,2)网，但不同种子之间互不相关，误差也是无偏的
+inline uint32_t owen_scramble(uint32_t v, uint32_t seed) {
+    return reverse_bits32(laine_karras_permutation(reverse_bits32(v), seed));
+}
+
+// Owen置乱的Sobol二维点，种子由调用者按(像素, 维度对)算好
+// shuffle为true时先用Owen置乱打乱采样序号(Burley 2020)，不同的维度对用不同的顺序，互相不相关；
+// ZSobol已经按维度置换过序号，不需要再打乱
+// Sobol的两维都直接按位反转的顺序生成，省掉置乱前的那次反转
+// 序号是64位的(ZSobol的序号是像素的Morton码接上采样序号，大图加上高采样数会超过32位)：
+// 结果只有32位精度，第0维第32位以上的列都是0，第1维的列照常递推，超出32位的行自然丢掉；
+// 打乱顺序只用于32位的采样序号
+inline void sobol_owen_2d(uint64_t index, uint64_t seed, bool shuffle, double& u0, double& u1) {
+    if (shuffle)
+        index = owen_scramble(uint32_t(index), uint32_t(seed));
+    // 反转后的第1维：从最低位开始，每一列是上一列异或它自己左移一位
+    uint32_t reversed1 = 0;
+    uint32_t v = 1u;
+    for (uint64_t i = index; i != 0; i >>= 1, v ^= v << 1)
+        if (i & 1u)
+            reversed1 ^= v;
+    uint64_t scramble = mix_bits(seed);
+    u0 = fixed32_to_unit(reverse_bits32(laine_karras_permutation(uint32_t(index), uint32_t(scramble))));
+    u1 = fixed32_to_unit(reverse_bits32(laine_karras_permutation(reversed1, uint32_t(scramble >> 32))));
+}
+
+// Kensler 2013的相关多重抖动采样(correlated multi-jittered sampling)
+// n个样本分成m列、k行的格子，每个格子一个样本，同时在x、y方向上各自分成n份的细格里也恰好各一个，
+// 采样数不要求是平方数或2的幂
+
+// [0, l)上由p决定的一个随机排列的第i个元素，i也要在[0, l)里
+inline uint32_t cmj_permute(uint32_t i, uint32_t l, uint32_t p) {
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    // 在不小于l的2的幂上做置换，结果超出l就再置换一次，直到落在[0, l)
+    do {
+        i ^= p;
+        i *= 0xe170893du;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3fu;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1u | p >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+    return (i + p) % l;
+}
+
+// 由(i, p)决定的[0,1)上的随机数
+inline double cmj_random(uint32_t i, uint32_t p) {
+    i ^= p;
+    i ^= i >> 17;
+    i ^= i >> 10;
+    i *= 0xb36534e5u;
+    i ^= i >> 12;
+    i ^= i >> 21;
+    i *= 0x93fc4795u;
+    i ^= 0xdf6e307fu;
+    i ^= i >> 17;
+    i *= 1u | p >> 18;
+    return i * (1.0 / 4294967808.0);
+}
+
+// n个样本里的第s个，p是这组样本的种子
+inline void cmj_2d(uint32_t s, uint32_t n, uint32_t p, double& u0, double& u1) {
+    // 列数m取不小于sqrt(n)的整数，行数k = ceil(n/m)
+    uint32_t m = 1;
+    while (m * m < n) m++;
+    uint32_t k = (n + m - 1) / m;
+    // 样本的顺序也打乱，不同的维度对之间不相关
+    s = cmj_permute(s % n, n, p * 0x51633e2du);
+    uint32_t sx = cmj_permute(s % m, m, p * 0x68bc21ebu);
+    uint32_t sy = cmj_permute(s / m, k, p * 0x02e5be93u);
+    double jx = cmj_random(s, p * 0x967a889bu);
+    double jy = cmj_random(s, p * 0x368cc8b7u);
+    u0 = ((s % m) + (sy + jx) / k) / m;
+    u1 = ((s / m) + (sx + jy) / m) / k;
+}
+
+// 二维Morton码：x、y的低16位交错
+inline uint32_t morton_code_2d(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v &= 0xffffu;
+        v = (v | (v << 8)) & 0x00ff00ffu;
+        v = (v | (v << 4)) & 0x0f0f0f0fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+// ZSobol(Ahmed和Wonka 2020，pbrt-v4的ZSobolSampler)：所有像素共用一个Sobol序列，
+// 像素按Morton(Z序)顺序排列，第(像素, 采样)个点在序列里的位置是Morton码接上采样序号，
+// 再把这个位置按4进制逐位随机置换(置换由更高的位决定)；
+// 相邻像素拿到的是同一个(0,2)网里互补的点，误差在屏幕上呈蓝噪声分布，看起来比白噪声平滑
+// morton_index是(像素的Morton码 << log2_spp) | 采样序号，digits是4进制的位数
+inline uint64_t zsobol_index(uint64_t morton_index, int log2_spp, int digits, uint32_t dimension) {
+    // 0..3的全部24种排列
+    static const uint8_t permutations[24][4] = {
+        { 0, 1, 2, 3 }, { 0, 1, 3, 2 }, { 0, 2, 1, 3 }, { 0, 2, 3, 1 }, { 0, 3, 2, 1 }, { 0, 3, 1, 2 },
+        { 1, 0, 2, 3 }, { 1, 0, 3, 2 }, { 1, 2, 0, 3 }, { 1, 2, 3, 0 }, { 1, 3, 2, 0 }, { 1, 3, 0, 2 },
+        { 2, 1, 0, 3 }, { 2, 1, 3, 0 }, { 2, 0, 1, 3 }, { 2, 0, 3, 1 }, { 2, 3, 0, 1 }, { 2, 3, 1, 0 },
+        { 3, 1, 2, 0 }, { 3, 1, 0, 2 }, { 3, 2, 1, 0 }, { 3, 2, 0, 1 }, { 3, 0, 2, 1 }, { 3, 0, 1, 2 } };
+    uint64_t index = 0;
+    // 采样数是2的奇数次幂时，最低一位单独处理(只有两种排列)
+    const bool odd = (log2_spp & 1) != 0;
+    const int last_digit = odd ? 1 : 0;
+    for (int d = digits - 1; d >= last_digit; d--) {
+        int shift = 2 * d - (odd ? 1 : 0);
+        int digit = int((morton_index >> shift) & 3u);
+        uint64_t higher = morton_index >> (shift + 2);
+        int p = int((mix_bits(higher ^ (0x55555555ull * dimension)) >> 24) % 24);
+        index |= uint64_t(permutations[p][digit]) << shift;
+    }
+    if (odd) {
+        uint64_t digit = morton_index & 1u;
+        index |= digit ^ (mix_bits((morton_index >> 1) ^ (0x55555555ull * dimension)) & 1u);
+    }
+    return index;
+}
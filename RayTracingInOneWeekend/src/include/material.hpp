@@ -1,30 +1,112 @@
 #pragma once
 
 #include "hittable.hpp"
+#include "scene_arena.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// 材质的类型标记，按它分派散射(见scatter_material)
+// 这里的几种是封闭的集合，用户自己派生的材质是other，走虚函数
+enum class material_kind : uint8_t {
+    other,
+    lambertian,
+    metal,
+    dielectric,
+};
+
+// material_kind的种类数，加新类型时放在最后并更新这里
+constexpr int material_kind_count = int(material_kind::dielectric) + 1;
 
 class material {
 public:
+    material() : tag(material_kind::other) {}
     virtual ~material() = default;
 
     // 判断光线是否反射的虚函数，参数先后是：光线对象，反射相关的数据，光线衰减的量(rgb), 反射出来的光线ray对象
+    // 随机数取自当前线程的随机数状态(thread_rng)
     virtual bool scatter(
         const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
     ) const {
         return false;
     }
+
+    // 同上，随机数取自显式传入的rng，渲染器调用的是这个版本
+    // 默认转给上面的版本，所以只重写了上面那个的派生类照样能用(随机数仍然来自thread_rng)
+    virtual bool scatter(
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng_state& rng
+    ) const {
+        (void)rng;
+        return scatter(r_in, rec, attenuation, scattered);
+    }
+
+    // 材质类型的名字，用于渲染统计
+    virtual const char* name() const { return "material"; }
+
+    // 表面的反射率，作为降噪的引导特征(见denoise.hpp)和反射率的AOV，透明的材质按1算
+    virtual color feature_albedo() const { return color(1.0, 1.0, 1.0); }
+
+    // 类型标记，scatter_material按它把材质static_cast成具体的类，所以构造后不能再改
+    material_kind kind() const { return tag; }
+
+    // 在material_table里的序号，输出材质编号的AOV用，不在表里的材质是-1
+    int id = -1;
+
+protected:
+    // 只给封闭集合里的几个final材质用，其他派生类用默认构造器，标记是other
+    explicit material(material_kind tag) : tag(tag) {}
+
+private:
+    const material_kind tag;
+};
+
+// 场景的材质表，统一持有场景里所有的材质
+// 物体和hit_record只保存指向材质的裸指针，材质的地址在表的生命周期内不会变
+// 所以表要比用到这些材质的物体活得更久(在场景里先于物体声明即可)
+// 材质放在表自己的内存池里，同类材质连续存放，不用每个材质单独分配一次
+class material_table {
+public:
+    // 创建一个T类型的材质并加入表中，参数原样转给T的构造器
+    template <class T, class... Args>
+    const T* add(Args&&... args) {
+        T* mat = storage.make<T>(std::forward<Args>(args)...);
+        mat->id = int(materials.size());
+        materials.push_back(mat);
+        return mat;
+    }
+
+    // 材质个数
+    size_t size() const { return materials.size(); }
+
+    // 第i个材质
+    const material* operator[](size_t i) const { return materials[i]; }
+
+private:
+    scene_arena storage;
+    std::vector<const material*> materials;
 };
 
 // Lambertian材质
-class lambertian : public material {
+class lambertian final : public material {
 public:
     // 输入反射率来构造此材质
-    lambertian(const color& albedo) : albedo(albedo) {}
+    lambertian(const color& albedo) : material(material_kind::lambertian), albedo(albedo) {}
+
+    const char* name() const override { return "lambertian"; }
+    color feature_albedo() const override { return albedo; }
     
-    // 散射函数，参数依次是：光线对象，碰撞相关数据， 衰减值，散射后的光线对象
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+        const override {
+        return scatter(r_in, rec, attenuation, scattered, thread_rng());
+    }
+
+    // 散射函数，参数依次是：光线对象，碰撞相关数据， 衰减值，散射后的光线对象，随机数状态
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng_state& rng)
         const override {
         // 生成符合lambertian分布的光线散射向量
-        auto scatter_direction = rec.normal + random_unit_vector();
+        auto scatter_direction = rec.normal + random_unit_vector(rng);
         // 处理当生成的随机单位向量与法线非常接近时出现的散射向量过于接近0的问题
         if (scatter_direction.near_zero())
             scatter_direction = rec.normal;
@@ -41,18 +123,26 @@ private:
 };
 
 // 金属材质
-class metal : public material {
+class metal final : public material {
 public:
     // 根据反射率和模糊系数来构造金属材质(模糊系数用来模糊表面的粗糙度)
     // 模糊系数最大为1
-    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
-    // 金属材质的光散射实现
+    metal(const color& albedo, double fuzz) : material(material_kind::metal), albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+
+    const char* name() const override { return "metal"; }
+    color feature_albedo() const override { return albedo; }
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+        const override {
+        return scatter(r_in, rec, attenuation, scattered, thread_rng());
+    }
+
+    // 金属材质的光散射实现
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng_state& rng)
         const override {
         // 求得反射向量
         vec3 reflected = reflect(r_in.direction(), rec.normal);
         // 反射向量做归一化后，加上任意单位向量乘模糊系数
-        reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+        reflected = unit_vector(reflected) + (fuzz * random_unit_vector(rng));
         // 构造反射光对象
         scattered = ray(rec.p, reflected);
         // 反射率赋值
@@ -68,13 +158,20 @@ private:
 };
 
 // 电导体材质
-class dielectric : public material {
+class dielectric final : public material {
 public:
     // 用折射系数定义电导体
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    dielectric(double refraction_index) : material(material_kind::dielectric), refraction_index(refraction_index) {}
+
+    const char* name() const override { return "dielectric"; }
 
-    // 散射时计算逻辑
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+        const override {
+        return scatter(r_in, rec, attenuation, scattered, thread_rng());
+    }
+
+    // 散射时计算逻辑
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng_state& rng)
         const override {
         // 透明，即rgb都不衰减
         attenuation = color(1.0, 1.0, 1.0);
@@ -94,7 +191,7 @@ public:
         // 还有就是模拟光线并不总是完全反射或完全折射的，而是按照一定概率分布来决定是否反射或折射
         // schlick近似是接于0,1之间的数，大于一个0,1之间的随机数是为了模拟反射率越高，反射概率越高
         // 也就是反射概率等于schlick近似值
-        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > random_double(rng))
             // 全反射时，向量是按照反射来算的
             direction = reflect(unit_direction, rec.normal);
         else
@@ -117,4 +214,23 @@ private:
         r0 = r0 * r0;
         return r0 + (1 - r0) * std::pow((1 - cosine), 5);
     }
-};
\ No newline at end of file
+};
+
+// 按分派方式调用材质的散射，随机数取自rng
+// closed_set时按类型标记switch到具体的类，调用可以内联进着色的循环；不认识的类型和virtual_calls一样走虚函数
+inline bool scatter_material(const material& mat, const ray& r_in, const hit_record& rec,
+    color& attenuation, ray& scattered, rng_state& rng, dispatch_mode mode) {
+    if (mode == dispatch_mode::closed_set) {
+        switch (mat.kind()) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(mat).lambertian::scatter(r_in, rec, attenuation, scattered, rng);
+        case material_kind::metal:
+            return static_cast<const metal&>(mat).metal::scatter(r_in, rec, attenuation, scattered, rng);
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(mat).dielectric::scatter(r_in, rec, attenuation, scattered, rng);
+        default:
+            break;
+        }
+    }
+    return mat.scatter(r_in, rec, attenuation, scattered, rng);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "aabb.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+// Morton码(Z序曲线)：把三维坐标的各位交错排列成一个整数
+// 按Morton码排序后，空间上相近的点在数组里也大多挨在一起
+
+// 把21位整数的每两位之间插入两个0
+inline uint64_t morton_spread_bits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffULL;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+    v = (v | (v << 8)) & 0x100f00f00f00f00fULL;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ULL;
+    v = (v | (v << 2)) & 0x1249249249249249ULL;
+    return v;
+}
+
+// v的最高位的1单独留下来，v为0时返回0
+inline uint64_t highest_set_bit(uint64_t v) {
+    v |= v >> 1;
+    v |= v >> 2;
+    v |= v >> 4;
+    v |= v >> 8;
+    v |= v >> 16;
+    v |= v >> 32;
+    return v - (v >> 1);
+}
+
+// 每个轴取21位，交错成63位的Morton码
+inline uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z) {
+    return morton_spread_bits(x) | (morton_spread_bits(y) << 1) | (morton_spread_bits(z) << 2);
+}
+
+// 点p在包围盒bounds里的Morton码
+// 三个轴用同一个缩放(按最长的轴)量化成21位整数，保持各向同比例，
+// 否则很扁的场景(比如所有物体都在一个平面附近)里薄的那个轴会被拉伸，打乱空间上的相邻关系
+inline uint64_t morton_code(const point3& p, const aabb& bounds) {
+    double extent = std::max(bounds.x.size(), std::max(bounds.y.size(), bounds.z.size()));
+    const double scale = extent > 0 ? double((1u << 21) - 1) / extent : 0.0;
+    uint32_t q[3];
+    for (int axis = 0; axis < 3; axis++) {
+        double t = (p[axis] - bounds.axis_interval(axis).min) * scale;
+        t = t < 0 ? 0 : (t > double((1u << 21) - 1) ? double((1u << 21) - 1) : t);
+        q[axis] = uint32_t(t);
+    }
+    return morton_code(q[0], q[1], q[2]);
+}
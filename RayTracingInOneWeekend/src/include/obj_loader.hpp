@@ -0,0 +1,256 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wavefront OBJ模型的读写，只处理几何：顶点位置(v)和面(f)，其他(vt、vn、g、usemtl...)都跳过
+// 多边形的面按扇形拆成三角形；面的顶点可以写成"1"、"1/2"、"1//3"、"1/2/3"，只取位置的下标，
+// 下标从1开始，负数表示从当前已有的最后一个顶点往前数
+//
+// 读取时把文件映射到内存，分几个线程并行解析：
+//   按字节数把文件切成几段，每段的边界挪到下一个换行后面，
+//   第一遍各线程数出自己那段有多少顶点、三角形和行，前缀和得到每段写到输出数组里的起始位置，
+//   第二遍各线程直接把解析结果写到输出数组里自己的位置上，不用再合并
+// 第一遍只找换行和行首的字母，比解析数字快得多，主要的时间花在第二遍
+
+// 读取的统计
+struct obj_load_stats {
+    size_t bytes = 0;          // 文件大小
+    size_t vertex_count = 0;   // 顶点数
+    size_t triangle_count = 0; // 三角形数
+    int thread_count = 0;      // 解析用的线程数
+    double map_ms = 0;         // 映射文件的耗时
+    double count_ms = 0;       // 第一遍(计数)的耗时
+    double parse_ms = 0;       // 第二遍(解析)的耗时
+};
+
+namespace obj_detail {
+
+// 文件里的一段：[begin, end)，以及第一遍数出来的个数和第二遍用的起始位置
+struct chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    size_t vertices = 0, triangles = 0, lines = 0;
+    size_t vertex_base = 0, triangle_base = 0, line_base = 0;
+    std::string error;
+    size_t error_line = 0;
+};
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+inline const char* skip_token(const char* p, const char* end) {
+    while (p < end && !is_space(*p)) p++;
+    return p;
+}
+
+// 行首的关键字是key(后面跟空白)时返回关键字后面的位置，否则返回nullptr
+inline const char* keyword(const char* p, const char* end, char key) {
+    p = skip_spaces(p, end);
+    if (end - p >= 2 && p[0] == key && is_space(p[1]))
+        return p + 2;
+    return nullptr;
+}
+
+// 数一行面里有几个顶点
+inline size_t count_tokens(const char* p, const char* end) {
+    size_t n = 0;
+    for (p = skip_spaces(p, end); p < end; p = skip_spaces(skip_token(p, end), end))
+        n++;
+    return n;
+}
+
+inline void count_chunk(chunk& c) {
+    for (const char* line = c.begin; line < c.end;) {
+        const char* eol = static_cast<const char*>(std::memchr(line, '\n', size_t(c.end - line)));
+        if (!eol) eol = c.end;
+        if (keyword(line, eol, 'v'))
+            c.vertices++;
+        else if (const char* p = keyword(line, eol, 'f')) {
+            size_t n = count_tokens(p, eol);
+            c.triangles += n >= 3 ? n - 2 : 0;
+        }
+        c.lines++;
+        line = eol + 1;
+    }
+}
+
+// 解析一段，顶点写到positions[3 * vertex_base...]，三角形写到indices[3 * triangle_base...]
+inline void parse_chunk(chunk& c, float* positions, uint32_t* indices, size_t total_vertices) {
+    size_t vertex = c.vertex_base;
+    uint32_t* out = indices + 3 * c.triangle_base;
+    size_t line_number = c.line_base;
+    auto fail = [&](const char* message) {
+        c.error = message;
+        c.error_line = line_number + 1;
+    };
+    for (const char* line = c.begin; line < c.end; line_number++) {
+        const char* eol = static_cast<const char*>(std::memchr(line, '\n', size_t(c.end - line)));
+        if (!eol) eol = c.end;
+        if (const char* p = keyword(line, eol, 'v')) {
+            float* v = positions + 3 * vertex;
+            for (int k = 0; k < 3; k++) {
+                p = skip_spaces(p, eol);
+                // from_chars不认正号
+                if (p < eol && *p == '+') p++;
+                auto result = std::from_chars(p, eol, v[k]);
+                if (result.ec != std::errc())
+                    return fail("bad vertex");
+                p = result.ptr;
+            }
+            vertex++;
+        }
+        else if (const char* p = keyword(line, eol, 'f')) {
+            // 扇形三角化：(第一个, 上一个, 当前)
+            uint32_t first = 0, previous = 0;
+            int n = 0;
+            for (p = skip_spaces(p, eol); p < eol; p = skip_spaces(skip_token(p, eol), eol)) {
+                long long index = 0;
+                auto result = std::from_chars(p, eol, index);
+                if (result.ec != std::errc() || index == 0)
+                    return fail("bad face index");
+                // 负数下标相对于这一行之前已经有的顶点
+                long long resolved = index > 0 ? index - 1 : (long long)vertex + index;
+                if (resolved < 0 || resolved >= (long long)total_vertices)
+                    return fail("face index out of range");
+                uint32_t current = uint32_t(resolved);
+                if (n == 0)
+                    first = current;
+                else if (n >= 2) {
+                    out[0] = first;
+                    out[1] = previous;
+                    out[2] = current;
+                    out += 3;
+                }
+                previous = current;
+                n++;
+            }
+        }
+        line = eol + 1;
+    }
+}
+
+} // namespace obj_detail
+
+// 读取OBJ文件，positions每3个数是一个顶点，indices每3个数是一个三角形
+// thread_count为0时用全部硬件线程；失败时返回false，error里是原因(带行号)
+inline bool load_obj(const std::string& path, std::vector<float>& positions, std::vector<uint32_t>& indices,
+    std::string& error, int thread_count = 0, obj_load_stats* stats = nullptr) {
+    using namespace obj_detail;
+    using clock = std::chrono::steady_clock;
+    auto ms_since = [](clock::time_point& start) {
+        auto now = clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+        return ms;
+    };
+    obj_load_stats local;
+    auto start = clock::now();
+
+    mapped_file file;
+    if (!file.open(path)) {
+        error = "cannot open " + path;
+        return false;
+    }
+    const char* data = file.data();
+    const size_t size = file.size();
+    local.bytes = size;
+    local.map_ms = ms_since(start);
+
+    int threads = thread_count > 0 ? thread_count : int(std::thread::hardware_concurrency());
+    // 每段至少1MB，小文件不值得开线程
+    threads = int(std::max<size_t>(1, std::min<size_t>(size_t(std::max(threads, 1)), size / (1 << 20))));
+    local.thread_count = threads;
+
+    std::vector<chunk> chunks(threads);
+    const char* cursor = data;
+    for (int k = 0; k < threads; k++) {
+        chunks[k].begin = cursor;
+        const char* split = k + 1 == threads ? data + size : data + size * (k + 1) / threads;
+        if (split < cursor)
+            split = cursor;
+        if (split < data + size) {
+            const char* eol = static_cast<const char*>(std::memchr(split, '\n', size_t(data + size - split)));
+            split = eol ? eol + 1 : data + size;
+        }
+        chunks[k].end = split;
+        cursor = split;
+    }
+
+    auto run = [&](auto&& fn) {
+        std::vector<std::thread> pool;
+        for (int k = 1; k < threads; k++)
+            pool.emplace_back([&, k]() { fn(chunks[k]); });
+        fn(chunks[0]);
+        for (auto& t : pool)
+            t.join();
+    };
+
+    run([](chunk& c) { count_chunk(c); });
+    size_t vertices = 0, triangles = 0, lines = 0;
+    for (chunk& c : chunks) {
+        c.vertex_base = vertices;
+        c.triangle_base = triangles;
+        c.line_base = lines;
+        vertices += c.vertices;
+        triangles += c.triangles;
+        lines += c.lines;
+    }
+    // 顶点下标存成uint32_t，网格的BVH也用uint32_t记三角形序号
+    if (vertices > UINT32_MAX) {
+        error = path + ": too many vertices";
+        return false;
+    }
+    if (triangles > UINT32_MAX) {
+        error = path + ": too many triangles";
+        return false;
+    }
+    local.count_ms = ms_since(start);
+
+    positions.assign(3 * vertices, 0.0f);
+    indices.assign(3 * triangles, 0);
+    run([&](chunk& c) { parse_chunk(c, positions.data(), indices.data(), vertices); });
+    for (const chunk& c : chunks)
+        if (!c.error.empty()) {
+            error = path + ":" + std::to_string(c.error_line) + ": " + c.error;
+            return false;
+        }
+    local.parse_ms = ms_since(start);
+
+    local.vertex_count = vertices;
+    local.triangle_count = triangles;
+    if (stats)
+        *stats = local;
+    return true;
+}
+
+// 把三角形网格写成OBJ文件
+inline bool save_obj(const std::string& path, const std::vector<float>& positions, const std::vector<uint32_t>& indices) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    char line[128];
+    for (size_t k = 0; k + 2 < positions.size(); k += 3) {
+        int n = std::snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", positions[k], positions[k + 1], positions[k + 2]);
+        out.write(line, n);
+    }
+    for (size_t k = 0; k + 2 < indices.size(); k += 3) {
+        int n = std::snprintf(line, sizeof(line), "f %u %u %u\n", indices[k] + 1, indices[k + 1] + 1, indices[k + 2] + 1);
+        out.write(line, n);
+    }
+    return bool(out);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// 硬件性能计数器，只统计当前线程在用户态的事件
+// 目前只支持Linux(perf_event_open)；其他系统、虚拟机没有透传计数器、或者权限不够时valid()为false，读数总是0
+class perf_counter {
+public:
+    enum class event {
+        cache_misses,    // 最后一级缓存未命中
+        l1d_read_misses, // L1数据缓存读未命中
+    };
+
+    explicit perf_counter(event e) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        if (e == event::cache_misses) {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        else {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)e;
+#endif
+    }
+    perf_counter(const perf_counter&) = delete;
+    perf_counter& operator=(const perf_counter&) = delete;
+    ~perf_counter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool valid() const { return fd >= 0; }
+
+    // 清零并开始计数
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    // 停止计数，返回start以来的事件数
+    uint64_t stop() {
+        uint64_t value = 0;
+#ifdef __linux__
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &value, sizeof(value)) != ssize_t(sizeof(value)))
+            value = 0;
+#endif
+        return value;
+    }
+
+private:
+    int fd = -1;
+};
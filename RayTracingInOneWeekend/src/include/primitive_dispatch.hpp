@@ -0,0 +1,52 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "hittable.hpp"
+#include "instance.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+#include "triangle_mesh.hpp"
+
+#include <cstdint>
+#include <typeinfo>
+
+// 基本物体的封闭集合：场景里的物体几乎都是这几种，BVH建好后给每个物体记一个类型标记，
+// 遍历叶子时按标记switch，直接调用具体类的hit(这几个类都是final的，编译器知道调用的是哪个函数，可以内联)，
+// 不用每个物体都经过一次虚函数表的间接跳转
+// 其他类型(用户自己派生的hittable、嵌套的BVH、hittable_list...)标记为other，照旧走虚函数，
+// 所以hittable的虚接口仍然是扩展新物体的方式，只是不在这个集合里的物体享受不到内联
+enum class primitive_kind : uint8_t {
+    other,
+    sphere,
+    sphere_set,
+    triangle_mesh,
+    instance,
+};
+
+// 物体的类型标记，只认精确的类型
+inline primitive_kind primitive_kind_of(const hittable& object) {
+    const std::type_info& type = typeid(object);
+    if (type == typeid(sphere)) return primitive_kind::sphere;
+    if (type == typeid(sphere_set)) return primitive_kind::sphere_set;
+    if (type == typeid(triangle_mesh)) return primitive_kind::triangle_mesh;
+    if (type == typeid(instance)) return primitive_kind::instance;
+    return primitive_kind::other;
+}
+
+// 按类型标记求交，kind必须是primitive_kind_of(object)的结果
+// 实例内部对原型的求交仍然是虚函数调用(原型可以是任何hittable)
+inline bool hit_primitive(primitive_kind kind, const hittable& object, const ray& r, interval ray_t, hit_record& rec) {
+    switch (kind) {
+    case primitive_kind::sphere:
+        return static_cast<const sphere&>(object).sphere::hit(r, ray_t, rec);
+    case primitive_kind::sphere_set:
+        return static_cast<const sphere_set&>(object).sphere_set::hit(r, ray_t, rec);
+    case primitive_kind::triangle_mesh:
+        return static_cast<const triangle_mesh&>(object).triangle_mesh::hit(r, ray_t, rec);
+    case primitive_kind::instance:
+        return static_cast<const instance&>(object).instance::hit(r, ray_t, rec);
+    default:
+        return object.hit(r, ray_t, rec);
+    }
+}
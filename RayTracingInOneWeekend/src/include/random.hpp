@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "hash.hpp"
+#include "low_discrepancy.hpp"
+
+// 随机数引擎
+// 每个引擎都提供 seed(uint64_t) 和 next_u64()，可以互相替换
+// 默认用xoshiro256++，编译时定义RTW_RNG_PCG32则换成PCG32
+
+// 把64位随机整数转成[0,1)的双精度浮点数：取高53位(double的有效位数)，乘2^-53
+inline double to_unit_double(uint64_t x) {
+    return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// xoshiro256++：256位状态，周期2^256-1，速度很快，统计质量好
+class xoshiro256pp {
+public:
+    void seed(uint64_t s) {
+        // 用splitmix64把一个64位种子展开成4个状态字，保证状态不全为0
+        for (auto& w : state) {
+            s += 0x9e3779b97f4a7c15ULL;
+            w = mix_bits(s);
+        }
+    }
+
+    uint64_t next_u64() {
+        uint64_t result = rotl(state[0] + state[3], 23) + state[0];
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+private:
+    // 默认状态等于seed(0)的结果，这样不调用seed也能直接用
+    uint64_t state[4] = { 0xe220a8397b1dcdafULL, 0x6e789e6aa1b965f4ULL,
+                          0x06c45d188009454fULL, 0xf88bb8a8724c81ecULL };
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+// PCG32：64位状态的线性同余加一个输出置换，状态小，适合需要保存大量独立状态的场合
+class pcg32 {
+public:
+    void seed(uint64_t s) {
+        state = 0;
+        next_u32();
+        state += mix_bits(s);
+        next_u32();
+    }
+
+    uint32_t next_u32() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // 两次32位输出拼成一个64位
+    uint64_t next_u64() {
+        uint64_t hi = next_u32();
+        return (hi << 32) | next_u32();
+    }
+
+private:
+    uint64_t state = 0x853c49e6748fea9bULL;
+    static constexpr uint64_t increment = 0xda3e39cb94b95bdbULL;
+};
+
+// 基于计数器的生成器：第n个随机数 = hash(键, n)，没有需要推进的状态
+// 键由(像素, 采样, 弹射次数)算出，所以某次弹射用到的随机数只由这个坐标决定，
+// 和之前消耗了多少随机数、由哪个线程、按什么顺序渲染都无关
+class counter_rng {
+public:
+    void seed(uint64_t key) {
+        this->key = key;
+        counter = 0;
+    }
+
+    uint64_t next_u64() {
+        return mix_bits(key + (++counter) * 0x9e3779b97f4a7c15ULL);
+    }
+
+private:
+    uint64_t key = 0;
+    uint64_t counter = 0;
+};
+
+#ifdef RTW_RNG_PCG32
+using rng_engine = pcg32;
+#else
+using rng_engine = xoshiro256pp;
+#endif
+
+// 随机数的两种模式
+enum class rng_mode {
+    stream,  // 顺序流：每个像素设置一次种子，之后顺序取数
+    counter  // 计数器：每个采样的每次弹射都用(像素, 采样, 弹射次数)重新设置键
+};
+
+// 采样器：每个像素的采样点在像素抖动、镜头位置和每次弹射的散射方向这些维度上怎么分布
+// 除random外，每次弹射的前sampler_dimensions维(相机光线：像素内位置2维、镜头位置2维；
+// 之后每次弹射：散射方向2维，再加俄罗斯轮盘赌、玻璃反射/折射的选择等)取自低差异的样本，
+// 两维一组，同一组在一个像素的所有采样点上分布得很均匀；超出的维度仍然用伪随机数
+enum class sampler_type {
+    random,     // 独立的伪随机数
+    stratified, // 分层(相关多重抖动)，采样数任意
+    sobol,      // Owen置乱的Sobol序列，采样数是2的幂时最好
+    zsobol      // 按Morton顺序在像素间分配同一个Sobol序列，误差在屏幕上呈蓝噪声分布
+};
+
+// 按名字(random/stratified/sobol/zsobol)取采样器，不认识的名字返回false
+inline bool parse_sampler_type(const std::string& name, sampler_type& type) {
+    if (name == "random") type = sampler_type::random;
+    else if (name == "stratified") type = sampler_type::stratified;
+    else if (name == "sobol") type = sampler_type::sobol;
+    else if (name == "zsobol") type = sampler_type::zsobol;
+    else return false;
+    return true;
+}
+
+// 渲染用的随机数状态，可以每个线程一份(见thread_rng)，也可以自己创建后显式传递
+class rng_state {
+public:
+    // 每次弹射最多从采样器取多少维
+    static constexpr uint32_t sampler_dimensions = 4;
+
+    // 切换模式
+    void set_mode(rng_mode m) { mode = m; }
+    rng_mode get_mode() const { return mode; }
+
+    // 设置采样器，samples_per_pixel是每个像素的采样数，width、height是图像大小，
+    // seed是渲染的种子(ZSobol所有像素共用一个序列，要用全局的种子)
+    void set_sampler(sampler_type type, int samples_per_pixel, int width, int height, uint64_t seed) {
+        sampler = type;
+        sampler_spp = uint32_t(samples_per_pixel > 0 ? samples_per_pixel : 1);
+        image_width = uint32_t(width > 0 ? width : 1);
+        sampler_seed = seed;
+        // ZSobol要求每个像素的采样数和图像边长都按2的幂算
+        log2_spp = 0;
+        while ((1u << log2_spp) < sampler_spp) log2_spp++;
+        int log2_resolution = 0;
+        while ((1 << log2_resolution) < std::max(width, height)) log2_resolution++;
+        zsobol_digits = log2_resolution + (log2_spp + 1) / 2;
+    }
+    sampler_type get_sampler() const { return sampler; }
+
+    // 顺序流模式下直接设置引擎的种子
+    void seed(uint64_t s) {
+        engine.seed(s);
+        counter.seed(s);
+    }
+
+    // 开始渲染某个像素，pixel_key是(种子, 像素位置)算出的键，pixel_index是j * 图像宽度 + i
+    // (只有ZSobol用到像素位置)
+    void begin_pixel(uint64_t pixel_key, uint32_t pixel_index = 0) {
+        this->pixel_key = pixel_key;
+        if (mode == rng_mode::stream)
+            engine.seed(pixel_key);
+        if (sampler == sampler_type::zsobol)
+            pixel_morton = morton_code_2d(pixel_index % image_width, pixel_index / image_width);
+    }
+
+    // 开始像素的第sample个采样点，接下来生成相机光线(算作第0次弹射)
+    void begin_sample(uint32_t sample) {
+        sample_index = sample;
+        sample_key = hash_combine(pixel_key, sample);
+        begin_bounce(0);
+    }
+
+    // 开始当前采样点的第bounce次弹射
+    // 顺序流模式下不重设引擎，只把采样器的维度重新从这次弹射的第0维开始
+    void begin_bounce(uint32_t bounce) {
+        this->bounce = bounce;
+        dimension = 0;
+        if (mode == rng_mode::counter)
+            counter.seed(hash_combine(sample_key, bounce));
+    }
+
+    uint64_t next_u64() {
+        return mode == rng_mode::counter ? counter.next_u64() : engine.next_u64();
+    }
+
+    // 下一个next_double()是否取自采样器的低差异样本
+    bool next_is_sample() const {
+        return sampler != sampler_type::random && dimension < sampler_dimensions;
+    }
+
+    // [0,1)之间的随机数，这次弹射还有采样器的维度时取采样器的样本
+    double next_double() {
+        if (next_is_sample())
+            return next_sample();
+        return to_unit_double(next_u64());
+    }
+
+private:
+    rng_engine engine;
+    counter_rng counter;
+    rng_mode mode = rng_mode::stream;
+    uint64_t pixel_key = 0;
+    uint64_t sample_key = 0;
+
+    sampler_type sampler = sampler_type::random;
+    uint32_t sampler_spp = 1;
+    uint32_t image_width = 1;
+    uint64_t sampler_seed = 0;
+    int log2_spp = 0;
+    int zsobol_digits = 0;
+    uint32_t pixel_morton = 0;
+    uint32_t sample_index = 0;
+    uint32_t bounce = 0;
+    uint32_t dimension = 0;
+    double second = 0; // 一组里的第二维，取第一维时一起算好
+
+    // 采样器的下一维，两维一组，组号是(弹射次数, 组在这次弹射里的序号)
+    double next_sample() {
+        uint32_t d = dimension++;
+        if (d & 1u)
+            return second;
+        uint32_t pair = bounce * (sampler_dimensions / 2) + d / 2;
+        double first = 0;
+        switch (sampler) {
+        case sampler_type::stratified:
+            cmj_2d(sample_index, sampler_spp, uint32_t(hash_combine(pixel_key, pair)), first, second);
+            break;
+        case sampler_type::sobol:
+            sobol_owen_2d(sample_index, hash_combine(pixel_key, pair), true, first, second);
+            break;
+        default: {
+            uint64_t morton_index = (uint64_t(pixel_morton) << log2_spp) | sample_index;
+            uint64_t index = zsobol_index(morton_index, log2_spp, zsobol_digits, pair);
+            sobol_owen_2d(index, hash_combine(sampler_seed, pair), false, first, second);
+            break;
+        }
+        }
+        return first;
+    }
+};
+
+// 当前线程的随机数状态
+// 每个线程一份，不需要加锁，也不会有数据竞争
+inline rng_state& thread_rng() {
+    thread_local rng_state rng;
+    return rng;
+}
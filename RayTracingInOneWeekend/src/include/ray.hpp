@@ -2,23 +2,28 @@
 
 #include "vec3.hpp"
 
-class ray {
+// 光线，坐标精度T与basic_vec3<T>一致
+template <class T>
+class basic_ray {
 public:
-	ray() {}
+	basic_ray() {}
     // 构造器： 输入光的原点和方向，构造ray对象
-	ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {}
+	basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction) : orig(origin), dir(direction) {}
     // 获取光线原点
-    const point3& origin() const { return orig; }
+    const basic_vec3<T>& origin() const { return orig; }
     // 获取光线的传播方向
-    const vec3& direction() const { return dir; }
+    const basic_vec3<T>& direction() const { return dir; }
     // 获取t时间后，光到达的位置的点坐标
-    point3 at(double t) const {
+    basic_vec3<T> at(T t) const {
         return orig + t * dir;
     }
 
 private:
     // 光线原点
-    point3 orig;
+    basic_vec3<T> orig;
     // 光线传播方向
-    vec3 dir;
-};
\ No newline at end of file
+    basic_vec3<T> dir;
+};
+
+// 渲染器使用的光线类型
+using ray = basic_ray<real>;
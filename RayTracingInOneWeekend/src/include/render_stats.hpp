@@ -0,0 +1,203 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 渲染统计：光线数、求交测试次数、各材质的散射结果、路径长度分布等
+// 只有编译时定义了RTW_ENABLE_STATS，RTW_STAT(...)里的语句才会编译进去；
+// 没定义时整条语句都不存在，渲染的代码和没有统计时完全一样
+#ifdef RTW_ENABLE_STATS
+#define RTW_STAT(statement) do { statement; } while (0)
+#else
+#define RTW_STAT(statement) do {} while (0)
+#endif
+
+// 路径结束的原因
+enum class path_end {
+    escaped,          // 没打中物体，飞向天空
+    absorbed,         // 被材质吸收(scatter返回false)
+    max_depth,        // 达到最大弹射次数
+    russian_roulette  // 被俄罗斯轮盘赌结束
+};
+
+// 一份统计数据，每个线程各有一份(见thread_stats)，渲染结束时合并
+struct render_stats {
+    // 某种材质的散射结果
+    struct material_counts {
+        const char* name = nullptr;
+        uint64_t scattered = 0;
+        uint64_t absorbed = 0;
+    };
+    static constexpr int max_material_types = 8;
+    static constexpr int path_end_count = 4;
+
+    uint64_t primary_rays = 0;     // 相机发出的光线
+    uint64_t secondary_rays = 0;   // 散射后继续追踪的光线
+    uint64_t ray_hits = 0;         // 和场景求交时打中物体的光线
+    uint64_t bvh_node_tests = 0;   // BVH节点包围盒的测试次数
+    uint64_t primitive_tests = 0;  // 物体本身(球面等)的求交测试次数
+    uint64_t path_ends[path_end_count] = {};
+    // 下标是路径一共求交了几段，值是这样的路径有多少条
+    std::vector<uint64_t> depth_histogram;
+    material_counts materials[max_material_types];
+    int material_type_count = 0;
+    // 表满了以后新出现的类型都记在这里，不和表里已有的类型混在一起
+    material_counts other_materials = { "other", 0, 0 };
+
+    // 记录一次散射的结果，按材质的类型名分类
+    void record_scatter(const char* material_name, bool scattered) {
+        material_counts& m = material_slot(material_name);
+        if (scattered) m.scattered++;
+        else m.absorbed++;
+    }
+
+    // 记录一条路径结束，segments是它一共求交了几段
+    void record_path(int segments, path_end reason) {
+        if (segments >= int(depth_histogram.size()))
+            depth_histogram.resize(size_t(segments) + 1);
+        depth_histogram[segments]++;
+        path_ends[int(reason)]++;
+    }
+
+    render_stats& operator+=(const render_stats& o) {
+        primary_rays += o.primary_rays;
+        secondary_rays += o.secondary_rays;
+        ray_hits += o.ray_hits;
+        bvh_node_tests += o.bvh_node_tests;
+        primitive_tests += o.primitive_tests;
+        for (int k = 0; k < path_end_count; k++)
+            path_ends[k] += o.path_ends[k];
+        if (o.depth_histogram.size() > depth_histogram.size())
+            depth_histogram.resize(o.depth_histogram.size());
+        for (size_t k = 0; k < o.depth_histogram.size(); k++)
+            depth_histogram[k] += o.depth_histogram[k];
+        for (int k = 0; k < o.material_type_count; k++) {
+            material_counts& m = material_slot(o.materials[k].name);
+            m.scattered += o.materials[k].scattered;
+            m.absorbed += o.materials[k].absorbed;
+        }
+        other_materials.scattered += o.other_materials.scattered;
+        other_materials.absorbed += o.other_materials.absorbed;
+        return *this;
+    }
+
+    uint64_t total_rays() const { return primary_rays + secondary_rays; }
+
+    // 输出可读的汇总
+    void print(std::ostream& out) const {
+        uint64_t rays = total_rays();
+        out << "Stats: " << rays << " rays (" << primary_rays << " primary, " << secondary_rays << " secondary), "
+            << ray_hits << " hits (" << percent(ray_hits, rays) << "%)\n";
+        out << "  intersection tests: " << bvh_node_tests << " BVH nodes ("
+            << ratio(bvh_node_tests, rays) << " per ray), " << primitive_tests << " primitives ("
+            << ratio(primitive_tests, rays) << " per ray)\n";
+        uint64_t paths = 0;
+        for (auto n : path_ends) paths += n;
+        out << "  path ends: escaped " << percent(path_ends[0], paths) << "%, absorbed "
+            << percent(path_ends[1], paths) << "%, max depth " << percent(path_ends[2], paths)
+            << "%, russian roulette " << percent(path_ends[3], paths) << "%\n";
+        for (int k = 0; k < material_type_count; k++) {
+            const auto& m = materials[k];
+            out << "  " << m.name << ": " << m.scattered << " scattered, " << m.absorbed << " absorbed\n";
+        }
+        if (has_other_materials())
+            out << "  other types: " << other_materials.scattered << " scattered, "
+                << other_materials.absorbed << " absorbed\n";
+        out << "  path length histogram (segments: paths):";
+        for (size_t k = 0; k < depth_histogram.size(); k++)
+            if (depth_histogram[k] > 0)
+                out << " " << k << ":" << depth_histogram[k];
+        out << "\n";
+    }
+
+    // 写成JSON
+    bool write_json(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot open " << path << " for writing\n";
+            return false;
+        }
+        out << "{\n"
+            << "  \"primary_rays\": " << primary_rays << ",\n"
+            << "  \"secondary_rays\": " << secondary_rays << ",\n"
+            << "  \"ray_hits\": " << ray_hits << ",\n"
+            << "  \"bvh_node_tests\": " << bvh_node_tests << ",\n"
+            << "  \"primitive_tests\": " << primitive_tests << ",\n"
+            << "  \"path_ends\": {\"escaped\": " << path_ends[0] << ", \"absorbed\": " << path_ends[1]
+            << ", \"max_depth\": " << path_ends[2] << ", \"russian_roulette\": " << path_ends[3] << "},\n"
+            << "  \"materials\": {";
+        for (int k = 0; k < material_type_count; k++)
+            out << (k ? ", " : "") << "\"" << materials[k].name << "\": {\"scattered\": "
+                << materials[k].scattered << ", \"absorbed\": " << materials[k].absorbed << "}";
+        if (has_other_materials())
+            out << (material_type_count ? ", " : "") << "\"" << other_materials.name << "\": {\"scattered\": "
+                << other_materials.scattered << ", \"absorbed\": " << other_materials.absorbed << "}";
+        out << "},\n  \"depth_histogram\": [";
+        for (size_t k = 0; k < depth_histogram.size(); k++)
+            out << (k ? ", " : "") << depth_histogram[k];
+        out << "]\n}\n";
+        return bool(out);
+    }
+
+private:
+    // 按类型名找材质的计数，没有就新建一项；名字是字符串常量，先比指针再比内容
+    material_counts& material_slot(const char* name) {
+        for (int k = 0; k < material_type_count; k++)
+            if (materials[k].name == name || std::strcmp(materials[k].name, name) == 0)
+                return materials[k];
+        if (material_type_count == max_material_types)
+            return other_materials;
+        materials[material_type_count].name = name;
+        return materials[material_type_count++];
+    }
+
+    bool has_other_materials() const {
+        return other_materials.scattered + other_materials.absorbed > 0;
+    }
+
+    static double percent(uint64_t part, uint64_t whole) {
+        return whole ? 100.0 * double(part) / double(whole) : 0.0;
+    }
+
+    static double ratio(uint64_t part, uint64_t whole) {
+        return whole ? double(part) / double(whole) : 0.0;
+    }
+};
+
+// 当前线程的统计，线程自己累加，不需要加锁
+inline render_stats& thread_stats() {
+    thread_local render_stats stats;
+    return stats;
+}
+
+// 所有线程合并后的统计和保护它的锁
+inline std::mutex& merged_stats_mutex() {
+    static std::mutex m;
+    return m;
+}
+
+inline render_stats& merged_stats() {
+    static render_stats stats;
+    return stats;
+}
+
+// 线程干完活后调用：把自己的统计并入总的统计，然后清零
+inline void flush_thread_stats() {
+    std::lock_guard<std::mutex> lock(merged_stats_mutex());
+    merged_stats() += thread_stats();
+    thread_stats() = render_stats();
+}
+
+// 取出合并后的统计并清零，供下一次渲染重新开始计数
+inline render_stats take_merged_stats() {
+    std::lock_guard<std::mutex> lock(merged_stats_mutex());
+    render_stats result = merged_stats();
+    merged_stats() = render_stats();
+    return result;
+}
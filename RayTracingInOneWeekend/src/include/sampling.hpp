@@ -0,0 +1,206 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "simd.hpp"
+
+// 不用拒绝采样的随机方向和圆盘采样
+// 原来的做法是在立方体(正方形)里随机取点，落在球(圆盘)外就重来：
+// 球平均要浪费约48%的随机数，圆盘约21%，而且循环次数不固定，没法向量化
+// 这里改成把[0,1)^2上的两个均匀随机数直接映射过去，映射是保面积的，所以分布和原来一样是均匀的：
+//   圆盘：Shirley-Chiu同心映射，正方形一圈圈的方框对应圆盘上一圈圈的圆环
+//   球面：Clarberg的八面体等面积映射，正方形折成八面体的8个面，再按面积对应到球面
+// 两个映射都只需要[-pi/4, pi/4]上的sin和cos，用多项式算，能写成SIMD版本一次算多个
+// 单个点的圆盘采样例外：拒绝采样反而更快，所以伪随机数时仍用拒绝采样，
+// 同心映射只用在批量版本和采样器的低差异样本上(见random_in_unit_disk)
+
+namespace sampling_detail {
+
+// x在[-pi/4, pi/4]内时同时求sin和cos，泰勒多项式，误差在1e-14以内
+template <class S>
+inline void sincos_quarter(typename S::reg x, typename S::reg& s, typename S::reg& c) {
+    const auto x2 = S::mul(x, x);
+    auto ps = S::set1(1.0 / 6227020800.0);
+    ps = S::sub(S::mul(ps, x2), S::set1(1.0 / 39916800.0));
+    ps = S::add(S::mul(ps, x2), S::set1(1.0 / 362880.0));
+    ps = S::sub(S::mul(ps, x2), S::set1(1.0 / 5040.0));
+    ps = S::add(S::mul(ps, x2), S::set1(1.0 / 120.0));
+    ps = S::sub(S::mul(ps, x2), S::set1(1.0 / 6.0));
+    s = S::add(x, S::mul(S::mul(ps, x2), x));
+
+    auto pc = S::set1(-1.0 / 87178291200.0);
+    pc = S::add(S::mul(pc, x2), S::set1(1.0 / 479001600.0));
+    pc = S::sub(S::mul(pc, x2), S::set1(1.0 / 3628800.0));
+    pc = S::add(S::mul(pc, x2), S::set1(1.0 / 40320.0));
+    pc = S::sub(S::mul(pc, x2), S::set1(1.0 / 720.0));
+    pc = S::add(S::mul(pc, x2), S::set1(1.0 / 24.0));
+    pc = S::sub(S::mul(pc, x2), S::set1(0.5));
+    c = S::add(S::set1(1.0), S::mul(pc, x2));
+}
+
+// 同心映射：u1,u2在[0,1)，输出单位圆盘上的点(x,y)
+// 先变到[-1,1)^2，点(a,b)所在的方框边长的一半就是圆盘上的半径r，
+// 它在方框上的位置(b/a或a/b)线性地对应到角度
+template <class S>
+inline void concentric_disk(typename S::reg u1, typename S::reg u2, typename S::reg& x, typename S::reg& y) {
+    const auto one = S::set1(1.0);
+    const auto a = S::sub(S::add(u1, u1), one);
+    const auto b = S::sub(S::add(u2, u2), one);
+    // |a|>|b|时点在左右两条边上，否则在上下两条边上
+    const auto horizontal = S::cmp_lt(S::abs(b), S::abs(a));
+    const auto r = S::select(horizontal, a, b);
+    const auto other = S::select(horizontal, b, a);
+    // 圆心处r为0，这时other也是0，除数换成1，结果还是原点
+    const auto safe_r = S::select(S::cmp_lt(S::abs(r), S::set1(1e-30)), one, r);
+    const auto phi = S::mul(S::set1(pi / 4), S::div(other, safe_r));
+    typename S::reg s, c;
+    sincos_quarter<S>(phi, s, c);
+    // 左右两条边：角度是phi；上下两条边：角度是pi/2-phi，sin和cos互换
+    const auto rc = S::mul(r, c);
+    const auto rs = S::mul(r, s);
+    x = S::select(horizontal, rc, rs);
+    y = S::select(horizontal, rs, rc);
+}
+
+// 八面体等面积映射：u1,u2在[0,1)，输出单位球面上的点(x,y,z)
+// [-1,1)^2的正方形，中间的菱形对应上半球，四个角折回来对应下半球；
+// 到菱形边的距离决定z，在同一圈上的位置决定方位角
+template <class S>
+inline void octahedral_sphere(typename S::reg u1, typename S::reg u2,
+    typename S::reg& x, typename S::reg& y, typename S::reg& z) {
+    const auto one = S::set1(1.0);
+    const auto u = S::sub(S::add(u1, u1), one);
+    const auto v = S::sub(S::add(u2, u2), one);
+    const auto up = S::abs(u);
+    const auto vp = S::abs(v);
+    // 到菱形边的有向距离，正的在菱形里面(上半球)
+    const auto signed_distance = S::sub(one, S::add(up, vp));
+    const auto r = S::sub(one, S::abs(signed_distance));
+    // 方位角是pi/4 + phi，phi在[-pi/4, pi/4]；r为0时在两极，方位角随便取
+    const auto safe_r = S::select(S::cmp_lt(r, S::set1(1e-30)), one, r);
+    const auto phi = S::mul(S::set1(pi / 4), S::div(S::sub(vp, up), safe_r));
+    typename S::reg s, c;
+    sincos_quarter<S>(phi, s, c);
+    // cos(pi/4+phi) = (cos(phi)-sin(phi))/sqrt(2)，sin(pi/4+phi) = (cos(phi)+sin(phi))/sqrt(2)
+    const auto inv_sqrt2 = S::set1(0.70710678118654752440);
+    const auto cos_phi = S::copysign(S::mul(S::sub(c, s), inv_sqrt2), u);
+    const auto sin_phi = S::copysign(S::mul(S::add(c, s), inv_sqrt2), v);
+    const auto r2 = S::mul(r, r);
+    // 球面上z = 1 - r^2的那一圈，半径是r * sqrt(2 - r^2)
+    const auto ring = S::mul(r, S::sqrt(S::sub(S::set1(2.0), r2)));
+    x = S::mul(cos_phi, ring);
+    y = S::mul(sin_phi, ring);
+    z = S::copysign(S::sub(one, r2), signed_distance);
+}
+
+}
+
+// 把[0,1)^2上的均匀随机数映射成单位球面上均匀分布的方向
+inline vec3 sample_unit_sphere(double u1, double u2) {
+    double x, y, z;
+    sampling_detail::octahedral_sphere<simd_scalar_of<double>>(u1, u2, x, y, z);
+    return vec3(x, y, z);
+}
+
+// 把[0,1)^2上的均匀随机数映射成单位圆盘(z=0)上均匀分布的点
+inline vec3 sample_unit_disk(double u1, double u2) {
+    double x, y;
+    sampling_detail::concentric_disk<simd_scalar_of<double>>(u1, u2, x, y);
+    return vec3(x, y, 0);
+}
+
+// 批量版本：输入n对均匀随机数u1[k],u2[k]，按结构数组输出，用SIMD一次算simd_real::width个
+inline void sample_unit_sphere_batch(const real* u1, const real* u2, size_t n, real* x, real* y, real* z) {
+    using S = simd_real;
+    size_t k = 0;
+    for (; k + S::width <= n; k += S::width) {
+        typename S::reg vx, vy, vz;
+        sampling_detail::octahedral_sphere<S>(S::load(u1 + k), S::load(u2 + k), vx, vy, vz);
+        S::store(x + k, vx);
+        S::store(y + k, vy);
+        S::store(z + k, vz);
+    }
+    for (; k < n; k++)
+        sampling_detail::octahedral_sphere<simd_scalar_of<real>>(u1[k], u2[k], x[k], y[k], z[k]);
+}
+
+inline void sample_unit_disk_batch(const real* u1, const real* u2, size_t n, real* x, real* y) {
+    using S = simd_real;
+    size_t k = 0;
+    for (; k + S::width <= n; k += S::width) {
+        typename S::reg vx, vy;
+        sampling_detail::concentric_disk<S>(S::load(u1 + k), S::load(u2 + k), vx, vy);
+        S::store(x + k, vx);
+        S::store(y + k, vy);
+    }
+    for (; k < n; k++)
+        sampling_detail::concentric_disk<simd_scalar_of<real>>(u1[k], u2[k], x[k], y[k]);
+}
+
+// 单位球面上的随机方向，随机数取自显式传入的rng
+inline vec3 random_unit_vector(rng_state& rng) {
+    // 分两句取随机数，保证u1、u2的先后顺序是确定的
+    auto u1 = random_double(rng);
+    auto u2 = random_double(rng);
+    return sample_unit_sphere(u1, u2);
+}
+
+// 同上，随机数取自当前线程的随机数状态
+inline vec3 random_unit_vector() {
+    return random_unit_vector(thread_rng());
+}
+
+// 取与法线同向的随机半球面向量p
+inline vec3 random_on_hemisphere(const vec3& normal) {
+    // 取出单位球面上随机均匀分布的向量p
+    vec3 on_unit_sphere = random_unit_vector();
+    // p点点乘法线向量，若大于0，则代表p与法线同向，即p在需要的半球面上
+    if (dot(on_unit_sphere, normal) > 0.0)
+        return on_unit_sphere;
+    // 若不在所需半球面，则反转向量就是了
+    else
+        return -on_unit_sphere;
+}
+
+// 圆盘的拒绝采样：正方形里取点，落在圆盘外就重来
+// 圆盘只浪费约21%的随机数，循环体里没有除法和开方，单个点算时比同心映射快(基准测试约11.6ns对18ns)
+inline vec3 random_in_unit_disk_rejection(rng_state& rng) {
+    while (true) {
+        auto x = random_double(rng) * 2 - 1;
+        auto y = random_double(rng) * 2 - 1;
+        vec3 p(x, y, 0);
+        if (p.length_squared() < 1)
+            return p;
+    }
+}
+
+// 从圆盘区域选一个随机点，随机数取自显式传入的rng
+// 伪随机数时用更快的拒绝采样；取的是采样器的低差异样本时用同心映射：
+// 两维样本正好映射成一个点，保持样本在像素的所有采样点上的均匀分布，拒绝采样会打乱它
+inline vec3 random_in_unit_disk(rng_state& rng) {
+    if (!rng.next_is_sample())
+        return random_in_unit_disk_rejection(rng);
+    auto u1 = random_double(rng);
+    auto u2 = random_double(rng);
+    return sample_unit_disk(u1, u2);
+}
+
+// 同上，随机数取自当前线程的随机数状态
+inline vec3 random_in_unit_disk() {
+    return random_in_unit_disk(thread_rng());
+}
+
+// 原来的球面拒绝采样版本，留作基准测试的对比
+inline vec3 random_unit_vector_rejection() {
+    while (true) {
+        auto p = vec3::random(-1, 1);
+        auto lensq = p.length_squared();
+        // 1e-160是为了避免长度太接近0，归一化后变成无穷大
+        if (1e-160 < lensq && lensq <= 1)
+            return p / sqrt(lensq);
+    }
+}
+
+inline vec3 random_in_unit_disk_rejection() {
+    return random_in_unit_disk_rejection(thread_rng());
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 场景的内存池：建场景时的物体、材质都从这里分配，场景用完后一次全部释放
+// 每种类型一个池(所有sphere放在一起，所有lambertian放在一起...)，池由一块块连续的内存组成：
+//   同类对象紧挨着放，遍历时读到的物体在内存里是连续的，不会和别的类型、shared_ptr的控制块交错；
+//   块满了就再分配一块新的(一块比一块大，最大64K个对象)，已有的块不会搬家，对象的地址在池的生命周期内不变；
+//   释放时按块依次析构再整块释放，几十万个对象只要几次free
+// 池持有所有权，物体之间、列表和BVH里都只用指针(见share)，不需要shared_ptr的引用计数
+// 池要比用到它的物体、列表活得更久(在场景里先于它们声明即可)
+class scene_arena {
+public:
+    scene_arena() {}
+    scene_arena(const scene_arena&) = delete;
+    scene_arena& operator=(const scene_arena&) = delete;
+    ~scene_arena() { clear(); }
+
+    // 在T的池里构造一个对象，参数原样转给T的构造器
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        return pool_of<T>().make(std::forward<Args>(args)...);
+    }
+
+    // 不持有所有权的shared_ptr，用来把池里的对象放进只接受shared_ptr的hittable_list、bvh_node
+    // 用shared_ptr的别名构造器，控制块是空的：不分配内存，拷贝和析构时也没有引用计数的原子操作
+    template <class T>
+    static shared_ptr<T> share(T* object) {
+        return shared_ptr<T>(shared_ptr<void>(), object);
+    }
+
+    // 构造一个对象并返回不持有所有权的shared_ptr，相当于池版本的make_shared
+    template <class T, class... Args>
+    shared_ptr<T> make_shared(Args&&... args) {
+        return share(make<T>(std::forward<Args>(args)...));
+    }
+
+    // 析构所有对象并释放所有内存块；各个池按第一次使用的相反顺序清空
+    void clear() {
+        for (auto it = first_use.rbegin(); it != first_use.rend(); ++it)
+            (*it)->clear();
+        first_use.clear();
+        pools.clear();
+    }
+
+    // 对象总数
+    size_t object_count() const {
+        size_t n = 0;
+        for (const pool_base* p : first_use)
+            n += p->count;
+        return n;
+    }
+
+    // 分配的内存块个数(即向系统申请内存的次数)
+    size_t block_count() const {
+        size_t n = 0;
+        for (const pool_base* p : first_use)
+            n += p->blocks.size();
+        return n;
+    }
+
+    // 分配的内存总字节数(含块里还没用的部分)
+    size_t bytes_reserved() const {
+        size_t n = 0;
+        for (const pool_base* p : first_use)
+            n += p->reserved_bytes;
+        return n;
+    }
+
+private:
+    static constexpr size_t first_block_objects = 64;
+    static constexpr size_t max_block_objects = 65536;
+
+    struct pool_base {
+        struct block {
+            void* memory;
+            size_t used;
+            size_t capacity;
+        };
+        std::vector<block> blocks;
+        size_t count = 0;
+        size_t reserved_bytes = 0;
+
+        virtual ~pool_base() = default;
+        virtual void clear() = 0;
+    };
+
+    template <class T>
+    struct pool : pool_base {
+        ~pool() override { clear(); }
+
+        template <class... Args>
+        T* make(Args&&... args) {
+            if (blocks.empty() || blocks.back().used == blocks.back().capacity) {
+                size_t capacity = blocks.empty() ? first_block_objects
+                    : std::min(2 * blocks.back().capacity, max_block_objects);
+                void* memory = ::operator new(capacity * sizeof(T), std::align_val_t(alignof(T)));
+                blocks.push_back({ memory, 0, capacity });
+                reserved_bytes += capacity * sizeof(T);
+            }
+            block& b = blocks.back();
+            // 先构造再计数，构造器抛异常时这个位置不算用掉
+            T* object = new (static_cast<T*>(b.memory) + b.used) T(std::forward<Args>(args)...);
+            b.used++;
+            count++;
+            return object;
+        }
+
+        void clear() override {
+            for (block& b : blocks) {
+                if (!std::is_trivially_destructible<T>::value) {
+                    T* objects = static_cast<T*>(b.memory);
+                    for (size_t i = 0; i < b.used; i++)
+                        objects[i].~T();
+                }
+                ::operator delete(b.memory, std::align_val_t(alignof(T)));
+            }
+            blocks.clear();
+            count = 0;
+            reserved_bytes = 0;
+        }
+    };
+
+    // 每个类型一个编号，第一次用到时分配，作为pools的下标
+    static size_t next_type_slot() {
+        static std::atomic<size_t> next{ 0 };
+        return next++;
+    }
+
+    template <class T>
+    static size_t type_slot() {
+        static const size_t slot = next_type_slot();
+        return slot;
+    }
+
+    template <class T>
+    pool<T>& pool_of() {
+        const size_t slot = type_slot<T>();
+        if (slot >= pools.size())
+            pools.resize(slot + 1);
+        if (!pools[slot]) {
+            pools[slot] = std::make_unique<pool<T>>();
+            first_use.push_back(pools[slot].get());
+        }
+        return static_cast<pool<T>&>(*pools[slot]);
+    }
+
+    std::vector<std::unique_ptr<pool_base>> pools; // 按类型编号存放的池，没用到的类型是空的
+    std::vector<pool_base*> first_use;              // 按第一次使用的顺序排列的池
+};
+
+// arena不为空时在arena里构造(返回不持有所有权的shared_ptr)，为空时就是普通的make_shared
+template <class T, class... Args>
+inline shared_ptr<T> make_shared_in(scene_arena* arena, Args&&... args) {
+    if (arena)
+        return arena->make_shared<T>(std::forward<Args>(args)...);
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
@@ -0,0 +1,503 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "camera_rt2.hpp"
+#include "hittable_list.hpp"
+#include "mapped_file.hpp"
+#include "material.hpp"
+#include "morton.hpp"
+#include "scene_arena.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 场景文件：相机参数、材质(lambertian/metal/dielectric)和球面
+//
+// 文本格式，一行一条，#开头是注释：
+//   aspect_ratio 1.7778        image_width 1200      samples_per_pixel 100
+//   max_depth 50               vfov 20               defocus_angle 0.6
+//   focus_dist 10              lookfrom 13 2 3       lookat 0 0 0        vup 0 1 0
+//   material <名字> lambertian <r> <g> <b>
+//   material <名字> metal <r> <g> <b> <fuzz>
+//   material <名字> dielectric <折射率>
+//   sphere <x> <y> <z> <半径> <材质名字>
+//
+// 二进制格式(本机字节序)：固定大小的文件头(含相机参数)，接着是材质数组，
+// 然后按结构数组存球心x、y、z、半径(都是double)和材质编号(uint32)。
+// 每一段都是8字节对齐的定长数组，加载时映射文件后直接整段拷贝，不需要逐个物体解析
+
+// 材质的类型编号，写在二进制文件里，不要改已有的值
+enum class scene_material_type : uint32_t {
+    lambertian = 0,
+    metal = 1,
+    dielectric = 2
+};
+
+// 相机参数，字段和camera_rt2的同名字段对应
+struct scene_camera {
+    double aspect_ratio = 16.0 / 9.0;
+    double vfov = 20;
+    double lookfrom[3] = { 13, 2, 3 };
+    double lookat[3] = { 0, 0, 0 };
+    double vup[3] = { 0, 1, 0 };
+    double defocus_angle = 0;
+    double focus_dist = 10;
+    int32_t image_width = 1200;
+    int32_t samples_per_pixel = 100;
+    int32_t max_depth = 50;
+    int32_t reserved = 0;
+};
+
+// 一个材质：lambertian和metal的params[0..2]是反射率，metal的params[3]是模糊系数，
+// dielectric的params[0]是折射率
+struct scene_material {
+    uint32_t type = 0;
+    uint32_t reserved = 0;
+    double params[4] = { 0, 0, 0, 0 };
+};
+
+static_assert(sizeof(scene_camera) == 120, "scene_camera is part of the binary format");
+static_assert(sizeof(scene_material) == 40, "scene_material is part of the binary format");
+
+// 二进制文件头
+struct scene_binary_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t material_count;
+    uint64_t sphere_count;
+    scene_camera camera;
+};
+
+static_assert(sizeof(scene_binary_header) == 144, "scene_binary_header is part of the binary format");
+
+static const char scene_binary_magic[8] = { 'R', 'T', 'W', 'S', 'C', 'E', 'N', 'E' };
+static const uint32_t scene_binary_version = 1;
+
+// 内存里的场景描述，球面按结构数组存，和二进制文件的布局一致
+struct scene_data {
+    scene_camera camera;
+    std::vector<scene_material> materials;
+    std::vector<double> cx, cy, cz, radius;
+    std::vector<uint32_t> material;
+
+    size_t sphere_count() const { return cx.size(); }
+
+    uint32_t add_lambertian(const color& albedo) {
+        return add_material(scene_material_type::lambertian, albedo.x(), albedo.y(), albedo.z(), 0);
+    }
+    uint32_t add_metal(const color& albedo, double fuzz) {
+        return add_material(scene_material_type::metal, albedo.x(), albedo.y(), albedo.z(), fuzz);
+    }
+    uint32_t add_dielectric(double refraction_index) {
+        return add_material(scene_material_type::dielectric, refraction_index, 0, 0, 0);
+    }
+
+    void add_sphere(const point3& center, double r, uint32_t mat) {
+        cx.push_back(center.x());
+        cy.push_back(center.y());
+        cz.push_back(center.z());
+        radius.push_back(r);
+        material.push_back(mat);
+    }
+
+private:
+    uint32_t add_material(scene_material_type type, double a, double b, double c, double d) {
+        scene_material m;
+        m.type = uint32_t(type);
+        m.params[0] = a;
+        m.params[1] = b;
+        m.params[2] = c;
+        m.params[3] = d;
+        materials.push_back(m);
+        return uint32_t(materials.size() - 1);
+    }
+};
+
+namespace scene_file_detail {
+
+// 从文本里逐个取以空白分隔的词
+class tokenizer {
+public:
+    tokenizer(const char* begin, const char* end) : p(begin), end(end) {}
+
+    // 取下一个词，行尾返回false
+    bool next(std::string& word) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        const char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+        word.assign(start, p);
+        return !word.empty();
+    }
+
+    bool next_double(double& value) {
+        std::string word;
+        if (!next(word)) return false;
+        char* stop = nullptr;
+        value = std::strtod(word.c_str(), &stop);
+        return stop && *stop == '\0';
+    }
+
+    bool next_doubles(double* values, int n) {
+        for (int k = 0; k < n; k++)
+            if (!next_double(values[k])) return false;
+        return true;
+    }
+
+private:
+    const char* p;
+    const char* end;
+};
+
+inline bool ends_with(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+// 解析文本格式
+inline bool parse_scene_text(const char* data, size_t size, scene_data& scene, std::string& error) {
+    using scene_file_detail::tokenizer;
+    scene = scene_data();
+    std::unordered_map<std::string, uint32_t> names;
+    const char* p = data;
+    const char* end = data + size;
+    int line_number = 0;
+    std::string keyword, name, type;
+
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (!line_end) line_end = end;
+        line_number++;
+        tokenizer tok(p, line_end);
+        p = line_end + 1;
+
+        if (!tok.next(keyword) || keyword[0] == '#')
+            continue;
+
+        bool ok = true;
+        scene_camera& cam = scene.camera;
+        double v[5];
+        if (keyword == "aspect_ratio") ok = tok.next_double(cam.aspect_ratio);
+        else if (keyword == "vfov") ok = tok.next_double(cam.vfov);
+        else if (keyword == "defocus_angle") ok = tok.next_double(cam.defocus_angle);
+        else if (keyword == "focus_dist") ok = tok.next_double(cam.focus_dist);
+        else if (keyword == "lookfrom") ok = tok.next_doubles(cam.lookfrom, 3);
+        else if (keyword == "lookat") ok = tok.next_doubles(cam.lookat, 3);
+        else if (keyword == "vup") ok = tok.next_doubles(cam.vup, 3);
+        else if (keyword == "image_width" || keyword == "samples_per_pixel" || keyword == "max_depth") {
+            // 要求是1到INT32_MAX之间的整数，超出范围转成int32_t是未定义行为
+            ok = tok.next_double(v[0]) && v[0] >= 1 && v[0] <= INT32_MAX && v[0] == std::floor(v[0]);
+            int32_t value = ok ? int32_t(v[0]) : 0;
+            if (keyword == "image_width") cam.image_width = value;
+            else if (keyword == "samples_per_pixel") cam.samples_per_pixel = value;
+            else cam.max_depth = value;
+        }
+        else if (keyword == "material") {
+            ok = tok.next(name) && tok.next(type);
+            if (ok && type == "lambertian" && tok.next_doubles(v, 3))
+                names[name] = scene.add_lambertian(color(v[0], v[1], v[2]));
+            else if (ok && type == "metal" && tok.next_doubles(v, 4))
+                names[name] = scene.add_metal(color(v[0], v[1], v[2]), v[3]);
+            else if (ok && type == "dielectric" && tok.next_doubles(v, 1))
+                names[name] = scene.add_dielectric(v[0]);
+            else
+                ok = false;
+        }
+        else if (keyword == "sphere") {
+            ok = tok.next_doubles(v, 4) && tok.next(name);
+            auto it = ok ? names.find(name) : names.end();
+            if (it == names.end()) {
+                error = "line " + std::to_string(line_number) + ": unknown material '" + name + "'";
+                return false;
+            }
+            scene.add_sphere(point3(v[0], v[1], v[2]), v[3], it->second);
+        }
+        else {
+            error = "line " + std::to_string(line_number) + ": unknown keyword '" + keyword + "'";
+            return false;
+        }
+        if (!ok) {
+            error = "line " + std::to_string(line_number) + ": bad '" + keyword + "' entry";
+            return false;
+        }
+    }
+    return true;
+}
+
+// 解析二进制格式：检查文件头和长度后，各段整块拷贝
+inline bool parse_scene_binary(const char* data, size_t size, scene_data& scene, std::string& error) {
+    scene = scene_data();
+    scene_binary_header header;
+    if (size < sizeof(header)) {
+        error = "truncated header";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, scene_binary_magic, sizeof(header.magic)) != 0 || header.version != scene_binary_version) {
+        error = "not a version " + std::to_string(scene_binary_version) + " binary scene";
+        return false;
+    }
+
+    // 个数来自文件，不可信：先用剩余的字节数除以每个的大小检查个数，再做乘法，免得乘积溢出后绕过长度检查
+    const size_t sphere_size = 4 * sizeof(double) + sizeof(uint32_t);
+    size_t remaining = size - sizeof(header);
+    if (header.material_count > remaining / sizeof(scene_material)) {
+        error = "truncated data";
+        return false;
+    }
+    const size_t m = header.material_count;
+    const size_t material_bytes = m * sizeof(scene_material);
+    remaining -= material_bytes;
+    if (header.sphere_count > remaining / sphere_size) {
+        error = "truncated data";
+        return false;
+    }
+    const size_t n = size_t(header.sphere_count);
+
+    scene.camera = header.camera;
+    const char* p = data + sizeof(header);
+    scene.materials.resize(m);
+    std::memcpy(scene.materials.data(), p, material_bytes);
+    p += material_bytes;
+
+    auto copy_doubles = [&p, n](std::vector<double>& out) {
+        out.resize(n);
+        std::memcpy(out.data(), p, n * sizeof(double));
+        p += n * sizeof(double);
+    };
+    copy_doubles(scene.cx);
+    copy_doubles(scene.cy);
+    copy_doubles(scene.cz);
+    copy_doubles(scene.radius);
+    scene.material.resize(n);
+    std::memcpy(scene.material.data(), p, n * sizeof(uint32_t));
+
+    // 不认识的材质类型和文本格式里不认识的材质一样拒绝加载，不要悄悄当成别的材质
+    for (size_t k = 0; k < m; k++)
+        if (scene.materials[k].type > uint32_t(scene_material_type::dielectric)) {
+            error = "material " + std::to_string(k) + " has unknown type " + std::to_string(scene.materials[k].type);
+            return false;
+        }
+
+    // 材质编号越界的文件是坏的，拒绝加载，免得建场景时越界访问
+    uint32_t max_index = 0;
+    for (uint32_t id : scene.material)
+        max_index = std::max(max_index, id);
+    if (n > 0 && max_index >= m) {
+        error = "sphere references material " + std::to_string(max_index) + " of " + std::to_string(m);
+        return false;
+    }
+    return true;
+}
+
+// 加载场景文件，按文件开头的魔数区分二进制和文本格式
+inline bool load_scene(const std::string& path, scene_data& scene, std::string& error) {
+    mapped_file file;
+    if (!file.open(path)) {
+        error = "cannot open " + path;
+        return false;
+    }
+    bool ok;
+    if (file.size() >= sizeof(scene_binary_magic) && std::memcmp(file.data(), scene_binary_magic, sizeof(scene_binary_magic)) == 0)
+        ok = parse_scene_binary(file.data(), file.size(), scene, error);
+    else
+        ok = parse_scene_text(file.data(), file.size(), scene, error);
+    if (!ok)
+        error = path + ": " + error;
+    return ok;
+}
+
+// 写成文本格式，浮点数用17位有效数字，读回来和原来的值完全一样
+inline bool write_scene_text(const scene_data& scene, std::ostream& out) {
+    char line[256];
+    const scene_camera& cam = scene.camera;
+    std::snprintf(line, sizeof(line), "aspect_ratio %.17g\nimage_width %d\nsamples_per_pixel %d\nmax_depth %d\nvfov %.17g\n",
+        cam.aspect_ratio, cam.image_width, cam.samples_per_pixel, cam.max_depth, cam.vfov);
+    out << line;
+    std::snprintf(line, sizeof(line), "lookfrom %.17g %.17g %.17g\nlookat %.17g %.17g %.17g\nvup %.17g %.17g %.17g\n",
+        cam.lookfrom[0], cam.lookfrom[1], cam.lookfrom[2], cam.lookat[0], cam.lookat[1], cam.lookat[2],
+        cam.vup[0], cam.vup[1], cam.vup[2]);
+    out << line;
+    std::snprintf(line, sizeof(line), "defocus_angle %.17g\nfocus_dist %.17g\n", cam.defocus_angle, cam.focus_dist);
+    out << line;
+
+    for (size_t k = 0; k < scene.materials.size(); k++) {
+        const scene_material& m = scene.materials[k];
+        switch (scene_material_type(m.type)) {
+        case scene_material_type::lambertian:
+            std::snprintf(line, sizeof(line), "material m%zu lambertian %.17g %.17g %.17g\n", k, m.params[0], m.params[1], m.params[2]);
+            break;
+        case scene_material_type::metal:
+            std::snprintf(line, sizeof(line), "material m%zu metal %.17g %.17g %.17g %.17g\n", k, m.params[0], m.params[1], m.params[2], m.params[3]);
+            break;
+        case scene_material_type::dielectric:
+            std::snprintf(line, sizeof(line), "material m%zu dielectric %.17g\n", k, m.params[0]);
+            break;
+        default:
+            return false;
+        }
+        out << line;
+    }
+    for (size_t k = 0; k < scene.sphere_count(); k++) {
+        std::snprintf(line, sizeof(line), "sphere %.17g %.17g %.17g %.17g m%u\n",
+            scene.cx[k], scene.cy[k], scene.cz[k], scene.radius[k], scene.material[k]);
+        out << line;
+    }
+    return bool(out);
+}
+
+inline bool write_scene_binary(const scene_data& scene, std::ostream& out) {
+    scene_binary_header header = {};
+    std::memcpy(header.magic, scene_binary_magic, sizeof(header.magic));
+    header.version = scene_binary_version;
+    header.material_count = uint32_t(scene.materials.size());
+    header.sphere_count = scene.sphere_count();
+    header.camera = scene.camera;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(scene.materials.data()), std::streamsize(scene.materials.size() * sizeof(scene_material)));
+    for (const auto* column : { &scene.cx, &scene.cy, &scene.cz, &scene.radius })
+        out.write(reinterpret_cast<const char*>(column->data()), std::streamsize(column->size() * sizeof(double)));
+    out.write(reinterpret_cast<const char*>(scene.material.data()), std::streamsize(scene.material.size() * sizeof(uint32_t)));
+    return bool(out);
+}
+
+// 保存场景，后缀是.bin时写二进制格式，否则写文本格式
+inline bool save_scene(const std::string& path, const scene_data& scene) {
+    bool binary = scene_file_detail::ends_with(path, ".bin");
+    std::ofstream out(path, binary ? std::ios::binary : std::ios::out);
+    if (!out || !(binary ? write_scene_binary(scene, out) : write_scene_text(scene, out))) {
+        std::cerr << "Cannot write scene " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// 场景内容(材质和球面，不含相机)的摘要，分布式渲染时用来确认各个进程加载的是同一个场景
+inline uint64_t scene_digest(const scene_data& scene) {
+    uint64_t h = hash_bytes(scene.materials.data(), scene.materials.size() * sizeof(scene_material));
+    h = hash_bytes(scene.cx.data(), scene.cx.size() * sizeof(double), h);
+    h = hash_bytes(scene.cy.data(), scene.cy.size() * sizeof(double), h);
+    h = hash_bytes(scene.cz.data(), scene.cz.size() * sizeof(double), h);
+    h = hash_bytes(scene.radius.data(), scene.radius.size() * sizeof(double), h);
+    return hash_bytes(scene.material.data(), scene.material.size() * sizeof(uint32_t), h);
+}
+
+// 把场景描述里的相机参数设置到相机上
+inline void apply_scene_camera(const scene_camera& sc, camera_rt2& cam) {
+    cam.aspect_ratio = sc.aspect_ratio;
+    cam.image_width = sc.image_width;
+    cam.samples_per_pixel = sc.samples_per_pixel;
+    cam.max_depth = sc.max_depth;
+    cam.vfov = sc.vfov;
+    cam.lookfrom = point3(sc.lookfrom[0], sc.lookfrom[1], sc.lookfrom[2]);
+    cam.lookat = point3(sc.lookat[0], sc.lookat[1], sc.lookat[2]);
+    cam.vup = vec3(sc.vup[0], sc.vup[1], sc.vup[2]);
+    cam.defocus_angle = sc.defocus_angle;
+    cam.focus_dist = sc.focus_dist;
+}
+
+namespace scene_file_detail {
+
+// build_scene_world的实现，arena不为空时物体从arena里分配，否则各自make_shared
+inline void build_world(const scene_data& scene, material_table& materials, hittable_list& world,
+    size_t group_size, scene_arena* arena) {
+    std::vector<const material*> mats;
+    mats.reserve(scene.materials.size());
+    for (const auto& m : scene.materials) {
+        color albedo(m.params[0], m.params[1], m.params[2]);
+        switch (scene_material_type(m.type)) {
+        case scene_material_type::metal: mats.push_back(materials.add<metal>(albedo, m.params[3])); break;
+        case scene_material_type::dielectric: mats.push_back(materials.add<dielectric>(m.params[0])); break;
+        // 加载时已经拒绝了不认识的类型
+        default: mats.push_back(materials.add<lambertian>(albedo)); break;
+        }
+    }
+
+    const size_t n = scene.sphere_count();
+    if (n == 0)
+        return;
+    aabb centers;
+    for (size_t k = 0; k < n; k++) {
+        point3 c(scene.cx[k], scene.cy[k], scene.cz[k]);
+        centers = aabb(centers, aabb(c, c));
+    }
+    double extent = std::max(centers.x.size(), std::max(centers.y.size(), centers.z.size()));
+
+    // 直径超过全部球心范围5%的算大球；Morton码只按小球的球心范围量化，
+    // 免得地面这种球心很远的大球把小球都挤到同几个格子里
+    std::vector<uint32_t> small;
+    small.reserve(n);
+    aabb small_centers;
+    for (size_t k = 0; k < n; k++) {
+        point3 c(scene.cx[k], scene.cy[k], scene.cz[k]);
+        if (2 * scene.radius[k] > 0.05 * extent) {
+            world.add(make_shared_in<sphere>(arena, c, scene.radius[k], mats[scene.material[k]], int(k)));
+        } else {
+            small.push_back(uint32_t(k));
+            small_centers = aabb(small_centers, aabb(c, c));
+        }
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> keyed;
+    keyed.reserve(small.size());
+    for (uint32_t k : small)
+        keyed.emplace_back(morton_code(point3(scene.cx[k], scene.cy[k], scene.cz[k]), small_centers), k);
+    std::sort(keyed.begin(), keyed.end());
+
+    // 按Morton码的最高不同位递归二分，直到每段不超过group_size个球，
+    // 每段对应Z序曲线上一个完整的子块，比直接每group_size个切一刀更紧凑
+    // (全是大球时没有小球要分组，不能加一个空的sphere_set，它的包围盒是空的，建BVH时会出错)
+    std::vector<std::pair<size_t, size_t>> pending;
+    if (!keyed.empty())
+        pending.push_back({ size_t(0), keyed.size() });
+    while (!pending.empty()) {
+        size_t lo = pending.back().first;
+        size_t hi = pending.back().second;
+        pending.pop_back();
+        if (hi - lo > group_size) {
+            size_t mid = lo + (hi - lo) / 2;
+            uint64_t diff = keyed[lo].first ^ keyed[hi - 1].first;
+            if (diff != 0) {
+                uint64_t top_bit = highest_set_bit(diff);
+                uint64_t prefix = keyed[hi - 1].first & ~(top_bit - 1);
+                mid = size_t(std::lower_bound(keyed.begin() + lo, keyed.begin() + hi, std::make_pair(prefix, uint32_t(0))) - keyed.begin());
+            }
+            pending.push_back({ mid, hi });
+            pending.push_back({ lo, mid });
+            continue;
+        }
+        auto group = make_shared_in<sphere_set>(arena);
+        for (size_t g = lo; g < hi; g++) {
+            uint32_t k = keyed[g].second;
+            group->add(point3(scene.cx[k], scene.cy[k], scene.cz[k]), scene.radius[k], mats[scene.material[k]], int(k));
+        }
+        world.add(group);
+    }
+}
+
+}
+
+// 按场景描述创建材质和物体，加到world里(之后一般再套一层BVH)
+// 大球(比如当地面的球)单独作为sphere加入；其余的球按球心的Morton码排序，
+// 每group_size个空间上相邻的球放进一个sphere_set，包围盒紧凑，又能用SIMD一次测多个
+inline void build_scene_world(const scene_data& scene, material_table& materials, hittable_list& world,
+    size_t group_size = 16) {
+    scene_file_detail::build_world(scene, materials, world, group_size, nullptr);
+}
+
+// 同上，但物体都从arena里分配，由arena持有，world里只是不持有所有权的引用
+// arena要比world和之后建的BVH活得更久
+inline void build_scene_world(const scene_data& scene, material_table& materials, hittable_list& world,
+    scene_arena& arena, size_t group_size = 16) {
+    scene_file_detail::build_world(scene, materials, world, group_size, &arena);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "scene_file.hpp"
+
+// 内置场景
+
+// 书上最后一章的场景：一个大球当地面，地面上是随机材质的小球，中间三个大球
+// 小球的球心在[-half_extent, half_extent)的整数格子里随机偏移，half_extent为11时就是书上的场景，
+// 调大可以生成几十万、上百万个球的场景，用来测试加载和求交的性能
+inline scene_data random_spheres_scene(int half_extent = 11) {
+    scene_data scene;
+    scene.camera.aspect_ratio = 16.0 / 9.0;
+    scene.camera.image_width = 1200;
+    scene.camera.samples_per_pixel = 100;
+    scene.camera.max_depth = 50;
+    scene.camera.vfov = 20;
+    scene.camera.defocus_angle = 0.6;
+    scene.camera.focus_dist = 10.0;
+
+    // 生成一个哑光材质，灰白色，在场景里加一个非常大的球作为地面
+    auto ground_material = scene.add_lambertian(color(0.5, 0.5, 0.5));
+    scene.add_sphere(point3(0, -1000, 0), 1000, ground_material);
+
+    // 这里2层循环是为了随机取球心的坐标，生成各种材质的球
+    for (int a = -half_extent; a < half_extent; a++) {
+        for (int b = -half_extent; b < half_extent; b++) {
+            // 选取一个随机数，用于材质抽奖
+            auto choose_mat = random_double();
+            // 给出一个球心的位置，可以看到y固定0.2，xz是用a,b再加随机数的0.9倍得到的
+            // 这里为了保证这些随机球心的球体不会重合
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            // 球心不能在这个范围内(留出一些空间生成特殊球体)
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                uint32_t sphere_material;
+                // 如果随机数小于0.8,生成哑光材质小球，颜色也随机
+                if (choose_mat < 0.8) {
+                    auto albedo = color::random() * color::random();
+                    sphere_material = scene.add_lambertian(albedo);
+                }
+                // [0.8,0.95)金属材质小球，粗糙度和颜色(深色范围)随机
+                else if (choose_mat < 0.95) {
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = scene.add_metal(albedo, fuzz);
+                }
+                // [0.95,1) 玻璃球
+                else {
+                    sphere_material = scene.add_dielectric(1.5);
+                }
+                // 半径都是0.2
+                scene.add_sphere(center, 0.2, sphere_material);
+            }
+        }
+    }
+
+    // 单独加3个球，放在刚刚空出来的位置，三种材质下，半径为1的球
+    scene.add_sphere(point3(0, 1, 0), 1.0, scene.add_dielectric(1.5));
+    scene.add_sphere(point3(-4, 1, 0), 1.0, scene.add_lambertian(color(0.4, 0.2, 0.1)));
+    scene.add_sphere(point3(4, 1, 0), 1.0, scene.add_metal(color(0.7, 0.6, 0.5), 0.0));
+    return scene;
+}
+
+// 测试用的三角形网格：以原点为球心、表面带起伏的经纬球，封闭，相邻三角形共用顶点
+// 纬线分segments段，经线分2 * segments段，一共约4 * segments^2个三角形，segments为700时约200万个
+// positions、indices的格式同triangle_mesh
+inline void bumpy_sphere_mesh(int segments, std::vector<float>& positions, std::vector<uint32_t>& indices) {
+    const int rows = std::max(segments, 2);
+    const int columns = 2 * rows;
+    auto radius = [](double theta, double phi) { return 1 + 0.05 * std::sin(8 * theta) * std::sin(8 * phi); };
+    auto add_vertex = [&](double theta, double phi) {
+        double r = radius(theta, phi);
+        positions.push_back(float(r * std::sin(theta) * std::cos(phi)));
+        positions.push_back(float(r * std::cos(theta)));
+        positions.push_back(float(r * std::sin(theta) * std::sin(phi)));
+    };
+    positions.clear();
+    indices.clear();
+    // 北极、中间rows - 1圈、南极
+    add_vertex(0, 0);
+    for (int i = 1; i < rows; i++)
+        for (int j = 0; j < columns; j++)
+            add_vertex(pi * i / rows, 2 * pi * j / columns);
+    add_vertex(pi, 0);
+    const uint32_t south = uint32_t(positions.size() / 3 - 1);
+    auto ring = [&](int i, int j) { return uint32_t(1 + (i - 1) * columns + (j % columns)); };
+    // 从外面看是逆时针
+    for (int j = 0; j < columns; j++) {
+        indices.insert(indices.end(), { 0, ring(1, j + 1), ring(1, j) });
+        for (int i = 1; i + 1 < rows; i++) {
+            indices.insert(indices.end(), { ring(i, j), ring(i, j + 1), ring(i + 1, j) });
+            indices.insert(indices.end(), { ring(i, j + 1), ring(i + 1, j + 1), ring(i + 1, j) });
+        }
+        indices.insert(indices.end(), { ring(rows - 1, j), ring(rows - 1, j + 1), south });
+    }
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+// 各指令集的SIMD包装，提供同样的一组操作，核心循环写成模板，按编译选项和浮点类型选其中一个
+// 双精度的包装名字以_pd结尾，单精度的以_ps结尾，和intrinsic的命名一致
+// 每个包装里：reg是一组数，mask是比较的结果，width是一次算几个数
+
+// 没有SIMD时一次算一个，T是double或float
+template <class T>
+struct simd_scalar_of {
+    using reg = T;
+    using mask = bool;
+    static constexpr size_t width = 1;
+    static reg set1(T x) { return x; }
+    static reg load(const T* p) { return *p; }
+    static void store(T* p, reg x) { *p = x; }
+    static reg add(reg x, reg y) { return x + y; }
+    static reg sub(reg x, reg y) { return x - y; }
+    static reg mul(reg x, reg y) { return x * y; }
+    static reg div(reg x, reg y) { return x / y; }
+    static reg sqrt(reg x) { return std::sqrt(x); }
+    static reg abs(reg x) { return std::fabs(x); }
+    static reg copysign(reg x, reg s) { return std::copysign(x, s); }
+    static mask cmp_lt(reg x, reg y) { return x < y; }
+    static mask cmp_ge(reg x, reg y) { return x >= y; }
+    static mask mask_and(mask x, mask y) { return x && y; }
+    static mask mask_or(mask x, mask y) { return x || y; }
+    static reg select(mask m, reg x, reg y) { return m ? x : y; }
+    static bool any(mask m) { return m; }
+    static unsigned bits(mask m) { return m ? 1u : 0u; }
+};
+
+using simd_scalar = simd_scalar_of<real>;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+struct simd_sse2_pd {
+    using reg = __m128d;
+    using mask = __m128d;
+    static constexpr size_t width = 2;
+    static reg set1(double x) { return _mm_set1_pd(x); }
+    static reg load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, reg x) { _mm_storeu_pd(p, x); }
+    static reg add(reg x, reg y) { return _mm_add_pd(x, y); }
+    static reg sub(reg x, reg y) { return _mm_sub_pd(x, y); }
+    static reg mul(reg x, reg y) { return _mm_mul_pd(x, y); }
+    static reg div(reg x, reg y) { return _mm_div_pd(x, y); }
+    static reg sqrt(reg x) { return _mm_sqrt_pd(x); }
+    static reg abs(reg x) { return _mm_andnot_pd(_mm_set1_pd(-0.0), x); }
+    static reg copysign(reg x, reg s) { return _mm_or_pd(abs(x), _mm_and_pd(_mm_set1_pd(-0.0), s)); }
+    static mask cmp_lt(reg x, reg y) { return _mm_cmplt_pd(x, y); }
+    static mask cmp_ge(reg x, reg y) { return _mm_cmpge_pd(x, y); }
+    static mask mask_and(mask x, mask y) { return _mm_and_pd(x, y); }
+    static mask mask_or(mask x, mask y) { return _mm_or_pd(x, y); }
+    // SSE2没有blend指令，用与、或、与非拼出来
+    static reg select(mask m, reg x, reg y) { return _mm_or_pd(_mm_and_pd(m, x), _mm_andnot_pd(m, y)); }
+    static bool any(mask m) { return _mm_movemask_pd(m) != 0; }
+    static unsigned bits(mask m) { return unsigned(_mm_movemask_pd(m)); }
+};
+
+struct simd_sse2_ps {
+    using reg = __m128;
+    using mask = __m128;
+    static constexpr size_t width = 4;
+    static reg set1(float x) { return _mm_set1_ps(x); }
+    static reg load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, reg x) { _mm_storeu_ps(p, x); }
+    static reg add(reg x, reg y) { return _mm_add_ps(x, y); }
+    static reg sub(reg x, reg y) { return _mm_sub_ps(x, y); }
+    static reg mul(reg x, reg y) { return _mm_mul_ps(x, y); }
+    static reg div(reg x, reg y) { return _mm_div_ps(x, y); }
+    static reg sqrt(reg x) { return _mm_sqrt_ps(x); }
+    static reg abs(reg x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), x); }
+    static reg copysign(reg x, reg s) { return _mm_or_ps(abs(x), _mm_and_ps(_mm_set1_ps(-0.0f), s)); }
+    static mask cmp_lt(reg x, reg y) { return _mm_cmplt_ps(x, y); }
+    static mask cmp_ge(reg x, reg y) { return _mm_cmpge_ps(x, y); }
+    static mask mask_and(mask x, mask y) { return _mm_and_ps(x, y); }
+    static mask mask_or(mask x, mask y) { return _mm_or_ps(x, y); }
+    static reg select(mask m, reg x, reg y) { return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y)); }
+    static bool any(mask m) { return _mm_movemask_ps(m) != 0; }
+    static unsigned bits(mask m) { return unsigned(_mm_movemask_ps(m)); }
+};
+#endif
+
+#if defined(__AVX2__)
+struct simd_avx2_pd {
+    using reg = __m256d;
+    using mask = __m256d;
+    static constexpr size_t width = 4;
+    static reg set1(double x) { return _mm256_set1_pd(x); }
+    static reg load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, reg x) { _mm256_storeu_pd(p, x); }
+    static reg add(reg x, reg y) { return _mm256_add_pd(x, y); }
+    static reg sub(reg x, reg y) { return _mm256_sub_pd(x, y); }
+    static reg mul(reg x, reg y) { return _mm256_mul_pd(x, y); }
+    static reg div(reg x, reg y) { return _mm256_div_pd(x, y); }
+    static reg sqrt(reg x) { return _mm256_sqrt_pd(x); }
+    static reg abs(reg x) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x); }
+    static reg copysign(reg x, reg s) { return _mm256_or_pd(abs(x), _mm256_and_pd(_mm256_set1_pd(-0.0), s)); }
+    static mask cmp_lt(reg x, reg y) { return _mm256_cmp_pd(x, y, _CMP_LT_OQ); }
+    static mask cmp_ge(reg x, reg y) { return _mm256_cmp_pd(x, y, _CMP_GE_OQ); }
+    static mask mask_and(mask x, mask y) { return _mm256_and_pd(x, y); }
+    static mask mask_or(mask x, mask y) { return _mm256_or_pd(x, y); }
+    static reg select(mask m, reg x, reg y) { return _mm256_blendv_pd(y, x, m); }
+    static bool any(mask m) { return _mm256_movemask_pd(m) != 0; }
+    static unsigned bits(mask m) { return unsigned(_mm256_movemask_pd(m)); }
+};
+
+struct simd_avx2_ps {
+    using reg = __m256;
+    using mask = __m256;
+    static constexpr size_t width = 8;
+    static reg set1(float x) { return _mm256_set1_ps(x); }
+    static reg load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, reg x) { _mm256_storeu_ps(p, x); }
+    static reg add(reg x, reg y) { return _mm256_add_ps(x, y); }
+    static reg sub(reg x, reg y) { return _mm256_sub_ps(x, y); }
+    static reg mul(reg x, reg y) { return _mm256_mul_ps(x, y); }
+    static reg div(reg x, reg y) { return _mm256_div_ps(x, y); }
+    static reg sqrt(reg x) { return _mm256_sqrt_ps(x); }
+    static reg abs(reg x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x); }
+    static reg copysign(reg x, reg s) { return _mm256_or_ps(abs(x), _mm256_and_ps(_mm256_set1_ps(-0.0f), s)); }
+    static mask cmp_lt(reg x, reg y) { return _mm256_cmp_ps(x, y, _CMP_LT_OQ); }
+    static mask cmp_ge(reg x, reg y) { return _mm256_cmp_ps(x, y, _CMP_GE_OQ); }
+    static mask mask_and(mask x, mask y) { return _mm256_and_ps(x, y); }
+    static mask mask_or(mask x, mask y) { return _mm256_or_ps(x, y); }
+    static reg select(mask m, reg x, reg y) { return _mm256_blendv_ps(y, x, m); }
+    static bool any(mask m) { return _mm256_movemask_ps(m) != 0; }
+    static unsigned bits(mask m) { return unsigned(_mm256_movemask_ps(m)); }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct simd_avx512_pd {
+    using reg = __m512d;
+    using mask = __mmask8;
+    static constexpr size_t width = 8;
+    static reg set1(double x) { return _mm512_set1_pd(x); }
+    static reg load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, reg x) { _mm512_storeu_pd(p, x); }
+    static reg add(reg x, reg y) { return _mm512_add_pd(x, y); }
+    static reg sub(reg x, reg y) { return _mm512_sub_pd(x, y); }
+    static reg mul(reg x, reg y) { return _mm512_mul_pd(x, y); }
+    static reg div(reg x, reg y) { return _mm512_div_pd(x, y); }
+    static reg sqrt(reg x) { return _mm512_sqrt_pd(x); }
+    // AVX-512F没有浮点的按位与，借用整数指令
+    static reg abs(reg x) {
+        return _mm512_castsi512_pd(_mm512_and_epi64(_mm512_castpd_si512(x), _mm512_set1_epi64(0x7fffffffffffffffLL)));
+    }
+    static reg copysign(reg x, reg s) {
+        __m512i sign = _mm512_and_epi64(_mm512_castpd_si512(s), _mm512_set1_epi64(int64_t(0x8000000000000000ULL)));
+        return _mm512_castsi512_pd(_mm512_or_epi64(_mm512_castpd_si512(abs(x)), sign));
+    }
+    static mask cmp_lt(reg x, reg y) { return _mm512_cmp_pd_mask(x, y, _CMP_LT_OQ); }
+    static mask cmp_ge(reg x, reg y) { return _mm512_cmp_pd_mask(x, y, _CMP_GE_OQ); }
+    static mask mask_and(mask x, mask y) { return mask(x & y); }
+    static mask mask_or(mask x, mask y) { return mask(x | y); }
+    static reg select(mask m, reg x, reg y) { return _mm512_mask_blend_pd(m, y, x); }
+    static bool any(mask m) { return m != 0; }
+    static unsigned bits(mask m) { return unsigned(m); }
+};
+
+struct simd_avx512_ps {
+    using reg = __m512;
+    using mask = __mmask16;
+    static constexpr size_t width = 16;
+    static reg set1(float x) { return _mm512_set1_ps(x); }
+    static reg load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, reg x) { _mm512_storeu_ps(p, x); }
+    static reg add(reg x, reg y) { return _mm512_add_ps(x, y); }
+    static reg sub(reg x, reg y) { return _mm512_sub_ps(x, y); }
+    static reg mul(reg x, reg y) { return _mm512_mul_ps(x, y); }
+    static reg div(reg x, reg y) { return _mm512_div_ps(x, y); }
+    static reg sqrt(reg x) { return _mm512_sqrt_ps(x); }
+    static reg abs(reg x) {
+        return _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(x), _mm512_set1_epi32(0x7fffffff)));
+    }
+    static reg copysign(reg x, reg s) {
+        __m512i sign = _mm512_and_epi32(_mm512_castps_si512(s), _mm512_set1_epi32(int32_t(0x80000000u)));
+        return _mm512_castsi512_ps(_mm512_or_epi32(_mm512_castps_si512(abs(x)), sign));
+    }
+    static mask cmp_lt(reg x, reg y) { return _mm512_cmp_ps_mask(x, y, _CMP_LT_OQ); }
+    static mask cmp_ge(reg x, reg y) { return _mm512_cmp_ps_mask(x, y, _CMP_GE_OQ); }
+    static mask mask_and(mask x, mask y) { return mask(x & y); }
+    static mask mask_or(mask x, mask y) { return mask(x | y); }
+    static reg select(mask m, reg x, reg y) { return _mm512_mask_blend_ps(m, y, x); }
+    static bool any(mask m) { return m != 0; }
+    static unsigned bits(mask m) { return unsigned(m); }
+};
+#endif
+
+// 按指令集和类型选出包装：simd_of<double>、simd_of<float>是本机最宽的双精度、单精度包装，
+// simd_real是real对应的那个
+template <class Pd, class Ps, class T>
+using simd_by_precision = typename std::conditional<std::is_same<T, float>::value, Ps, Pd>::type;
+#if defined(__AVX512F__)
+template <class T>
+using simd_of = simd_by_precision<simd_avx512_pd, simd_avx512_ps, T>;
+#elif defined(__AVX2__)
+template <class T>
+using simd_of = simd_by_precision<simd_avx2_pd, simd_avx2_ps, T>;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+template <class T>
+using simd_of = simd_by_precision<simd_sse2_pd, simd_sse2_ps, T>;
+#else
+template <class T>
+using simd_of = simd_scalar_of<T>;
+#endif
+
+using simd_real = simd_of<real>;
@@ -2,14 +2,42 @@
 
 #include "rtweekend.hpp"
 
+#include "hittable.hpp"
+#include "render_stats.hpp"
+
+#include <type_traits>
+
+// 把求出来的交点重新投影到球面上
+// 交点是沿光线走t算出来的，单精度下误差可能让它落在球面里面一点，
+// 从这里发出的下一条光线又会打中同一个球面(自相交，图像上表现为暗斑)
+// 双精度的误差小得多，不做这一步，保持和以前完全一样的结果
+inline point3 project_to_sphere(const point3& p, const point3& center, real radius) {
+    if (!std::is_same<real, float>::value)
+        return p;
+    vec3 offset = p - center;
+    return center + offset * (radius / offset.length());
+}
+
 // hittable的派生类：球面
-class sphere : public hittable {
+class sphere final : public hittable {
 public:
     // 球面构造器:通过球心点坐标，和半径,加上材质来构造
-    sphere(const point3& center, double radius, shared_ptr<material> mat)
-        : center(center), radius(std::fmax(0, radius)), mat(mat) {}
+    // 材质由material_table持有，球面只记一个指针；object_id是输出AOV时的物体编号
+    sphere(const point3& center, real radius, const material* mat, int object_id = -1)
+        : center(center), radius(std::fmax(0, radius)), mat(mat), object_id(object_id) {
+        // 包围盒就是以球心为中心、边长为2倍半径的立方体
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
+    // 兼容用shared_ptr创建材质的写法(前面几章的代码)，球面自己保留一份所有权
+    // 求交时仍然只用裸指针，不会有引用计数的开销
+    sphere(const point3& center, real radius, shared_ptr<material> mat)
+        : sphere(center, radius, mat.get()) {
+        mat_owner = std::move(mat);
+    }
     // 重写抽象类的碰撞检测函数，与之前的hit_sphere函数大致相同
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RTW_STAT(thread_stats().primitive_tests++);
         vec3 oc = center - r.origin();
         auto a = r.direction().length_squared();
         auto h = dot(r.direction(), oc);
@@ -34,20 +62,29 @@ public:
         // 走到这里说明至少有1个根(值小的根优先)符合条件，填充碰撞结果
         rec.t = root;
         // 碰撞点,就是Q+td
-        rec.p = r.at(rec.t);
+        rec.p = project_to_sphere(r.at(rec.t), center, radius);
         // 法线，即交点 - 圆心坐标，除以半径(向量的模)就是为了归一化
         vec3 outward_normal = (rec.p - center) / radius;
         // 根据光线是从物体外部穿入还是内部穿出，来设置法线方向
         rec.set_face_normal(r, outward_normal);
         rec.mat = mat;
+        rec.object_id = object_id;
         return true;
     }
 
+    aabb bounding_box() const override { return bbox; }
+
 private:
     // 球面的球心坐标
     point3 center;
     // 球面的半径
-    double radius;
+    real radius;
     // 球面的材质
-    shared_ptr<material> mat;
+    const material* mat;
+    // 物体编号
+    int object_id;
+    // 用shared_ptr构造时持有的材质所有权
+    shared_ptr<material> mat_owner;
+    // 球面的包围盒
+    aabb bbox;
 };
\ No newline at end of file
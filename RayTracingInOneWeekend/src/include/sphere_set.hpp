@@ -0,0 +1,171 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "sphere.hpp"
+
+#include "simd.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// 一组球面，按结构数组(SoA)存储：球心的x、y、z、半径和材质编号各自是一个连续的数组
+// 和一个个单独new出来的sphere相比，数据在内存里是挨着的，也不用每个球都走一次虚函数
+// 求交时用SIMD一次算多个球(SSE2一次2个，AVX2一次4个，AVX-512一次8个双精度数；
+// 单精度构建(RTW_USE_FLOAT)下通道数翻倍，分别是4、8、16个)，
+// 每个球的计算步骤和sphere::hit完全一样，所以结果也和逐个调用sphere::hit完全一样
+class sphere_set final : public hittable {
+public:
+    sphere_set() {}
+
+    // 加一个球面，参数和sphere的构造器一样
+    void add(const point3& center, real radius, const material* mat, int object_id = -1) {
+        radius = std::fmax(0, radius);
+        // 去掉为了对齐SIMD宽度补上的空位，加完新球后再补上
+        trim_padding();
+        cx.push_back(center.x());
+        cy.push_back(center.y());
+        cz.push_back(center.z());
+        rad.push_back(radius);
+        material_ids.push_back(material_index(mat));
+        object_ids.push_back(object_id);
+        count++;
+        pad_to_width();
+
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(bbox, aabb(center - rvec, center + rvec));
+    }
+
+    // 球面个数
+    size_t size() const { return count; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RTW_STAT(thread_stats().primitive_tests += count);
+        int best = -1;
+        real best_t = ray_t.max;
+        hit_kernel<simd>(r, ray_t, best, best_t);
+        if (best < 0)
+            return false;
+
+        // 只为最近的那个球填充碰撞信息，和sphere::hit里的写法保持一致
+        point3 center(cx[best], cy[best], cz[best]);
+        rec.t = best_t;
+        rec.p = project_to_sphere(r.at(rec.t), center, rad[best]);
+        vec3 outward_normal = (rec.p - center) / rad[best];
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = materials[material_ids[best]];
+        rec.object_id = object_ids[best];
+        return true;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    std::vector<real> cx, cy, cz, rad;  // 球心坐标和半径
+    std::vector<uint32_t> material_ids;    // 每个球的材质在materials里的下标
+    std::vector<int> object_ids;           // 每个球的物体编号(不参与求交，不用补齐)
+    std::vector<const material*> materials; // 这组球用到的材质，相同的材质只存一份
+    std::unordered_map<const material*, uint32_t> material_lookup;
+    size_t count = 0; // 实际的球数(不含补齐的空位)
+    aabb bbox;
+
+    uint32_t material_index(const material* mat) {
+        auto it = material_lookup.find(mat);
+        if (it != material_lookup.end())
+            return it->second;
+        uint32_t id = uint32_t(materials.size());
+        materials.push_back(mat);
+        material_lookup.emplace(mat, id);
+        return id;
+    }
+
+    // 补齐的空位用NaN作球心，NaN参与的比较全是false，所以永远不会被判定为碰撞
+    void pad_to_width() {
+        const real nan = std::numeric_limits<real>::quiet_NaN();
+        while (cx.size() % lane_width != 0) {
+            cx.push_back(nan);
+            cy.push_back(nan);
+            cz.push_back(nan);
+            rad.push_back(0);
+            material_ids.push_back(0);
+        }
+    }
+
+    void trim_padding() {
+        cx.resize(count);
+        cy.resize(count);
+        cz.resize(count);
+        rad.resize(count);
+        material_ids.resize(count);
+    }
+
+    // 求交的核心循环，S是某种指令集的包装(见simd.hpp)
+    // 每次取S::width个球，按sphere::hit的公式算出判别式和两个根，
+    // 用掩码代替if分支，再从打中的球里挑t最小的
+    template <class S>
+    void hit_kernel(const ray& r, interval ray_t, int& best, real& best_t) const {
+        const point3& o = r.origin();
+        const vec3& d = r.direction();
+        // a对所有球都一样，和sphere::hit一样用length_squared求
+        const real a_scalar = d.length_squared();
+
+        const auto ox = S::set1(o.x()), oy = S::set1(o.y()), oz = S::set1(o.z());
+        const auto dx = S::set1(d.x()), dy = S::set1(d.y()), dz = S::set1(d.z());
+        const auto a = S::set1(a_scalar);
+        const auto zero = S::set1(0.0);
+        const auto tmin = S::set1(ray_t.min);
+
+        for (size_t k = 0; k < cx.size(); k += S::width) {
+            // 区间上限是目前最近的t，后面只找更近的
+            const auto tmax = S::set1(best_t);
+            // oc = center - r.origin()
+            auto ocx = S::sub(S::load(&cx[k]), ox);
+            auto ocy = S::sub(S::load(&cy[k]), oy);
+            auto ocz = S::sub(S::load(&cz[k]), oz);
+            auto radius = S::load(&rad[k]);
+            // h = dot(r.direction(), oc)
+            auto h = S::add(S::add(S::mul(dx, ocx), S::mul(dy, ocy)), S::mul(dz, ocz));
+            // c = oc.length_squared() - radius * radius
+            auto c = S::sub(S::add(S::add(S::mul(ocx, ocx), S::mul(ocy, ocy)), S::mul(ocz, ocz)),
+                S::mul(radius, radius));
+            // discriminant = h * h - a * c，小于0的没打中
+            auto discriminant = S::sub(S::mul(h, h), S::mul(a, c));
+            auto has_root = S::cmp_ge(discriminant, zero);
+            if (!S::any(has_root))
+                continue;
+
+            auto sqrtd = S::sqrt(discriminant);
+            // 先看小的根，不在(tmin, tmax)里再看大的根
+            auto root1 = S::div(S::sub(h, sqrtd), a);
+            auto root2 = S::div(S::add(h, sqrtd), a);
+            auto ok1 = S::mask_and(S::cmp_lt(tmin, root1), S::cmp_lt(root1, tmax));
+            auto ok2 = S::mask_and(S::cmp_lt(tmin, root2), S::cmp_lt(root2, tmax));
+            auto hit_mask = S::mask_and(has_root, S::mask_or(ok1, ok2));
+            if (!S::any(hit_mask))
+                continue;
+
+            auto t = S::select(ok1, root1, root2);
+            // 把这一组的结果取出来，找最小的t，t一样时取下标小的，这和依次调用sphere::hit的结果一致
+            alignas(64) real ts[S::width];
+            S::store(ts, t);
+            unsigned bits = S::bits(hit_mask);
+            for (size_t lane = 0; lane < S::width; lane++) {
+                if ((bits >> lane) & 1u) {
+                    if (ts[lane] < best_t) {
+                        best_t = ts[lane];
+                        best = int(k + lane);
+                    }
+                }
+            }
+        }
+    }
+
+    // 求交用的SIMD包装，按编译选项和real的类型选(见simd.hpp)
+    using simd = simd_real;
+
+    // 一次能算几个球，数组长度补齐到它的整数倍
+    static constexpr size_t lane_width = simd::width;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 图像上的一个矩形块，像素范围是[x0,x1) x [y0,y1)
+struct tile {
+    int x0, y0, x1, y1;
+};
+
+// 工作窃取(work stealing)的分块调度器
+// 图像切成tile_size x tile_size的小块，先按顺序平均分给每个线程各自的队列
+// 线程从自己队列的头部取块；自己的做完了，就从别的线程队列的尾部偷一块
+// 这样负载不均(比如某些块全是玻璃球，特别慢)时，空闲的线程会自动帮忙
+class tile_scheduler {
+public:
+    tile_scheduler(int width, int height, int tile_size, int worker_count)
+        : tile_scheduler(tile{ 0, 0, width, height }, tile_size, worker_count) {}
+
+    // 只切图像上的region这一块(比如分布式渲染时一个工作进程领到的一大块)
+    tile_scheduler(const tile& region, int tile_size, int worker_count) {
+        if (tile_size < 1) tile_size = 1;
+        if (worker_count < 1) worker_count = 1;
+
+        std::vector<tile> tiles;
+        for (int y = region.y0; y < region.y1; y += tile_size)
+            for (int x = region.x0; x < region.x1; x += tile_size)
+                tiles.push_back({ x, y, std::min(x + tile_size, region.x1), std::min(y + tile_size, region.y1) });
+        total = tiles.size();
+
+        // 连续的一段块分给同一个线程，相邻的块访问的场景数据也相近，缓存更友好
+        for (int w = 0; w < worker_count; w++)
+            queues.push_back(std::make_unique<queue>());
+        for (size_t k = 0; k < tiles.size(); k++)
+            queues[k * worker_count / tiles.size()]->tiles.push_back(tiles[k]);
+    }
+
+    // 块的总数
+    size_t tile_count() const { return total; }
+
+    // 给第worker个线程取下一块，所有块都取完了返回false
+    bool next(int worker, tile& out) {
+        int n = int(queues.size());
+        // 先从自己的队列头部取
+        if (pop(*queues[worker], out, true))
+            return true;
+        // 再依次从别的线程的队列尾部偷
+        for (int k = 1; k < n; k++) {
+            if (pop(*queues[(worker + k) % n], out, false))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    struct queue {
+        std::mutex m;
+        std::deque<tile> tiles;
+    };
+
+    std::vector<std::unique_ptr<queue>> queues;
+    size_t total = 0;
+
+    static bool pop(queue& q, tile& out, bool front) {
+        std::lock_guard<std::mutex> lock(q.m);
+        if (q.tiles.empty())
+            return false;
+        if (front) {
+            out = q.tiles.front();
+            q.tiles.pop_front();
+        }
+        else {
+            out = q.tiles.back();
+            q.tiles.pop_back();
+        }
+        return true;
+    }
+};
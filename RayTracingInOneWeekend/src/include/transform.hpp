@@ -0,0 +1,141 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "aabb.hpp"
+
+#include <cmath>
+
+// 仿射变换：p' = A p + b，A是3x3矩阵(旋转、缩放、错切)，b是平移
+// 按3行4列存，每行是A的一行加上b的一个分量，一共12个real
+// 组合变换时右边的先做：translate(...) * rotate(...) 是先旋转再平移
+class affine_transform {
+public:
+    // 默认是恒等变换
+    affine_transform() {
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++)
+                m[i][j] = i == j ? 1 : 0;
+    }
+
+    // 平移
+    static affine_transform translate(const vec3& offset) {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            t.m[i][3] = offset[i];
+        return t;
+    }
+
+    // 沿三个轴分别缩放
+    static affine_transform scale(const vec3& factor) {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            t.m[i][i] = factor[i];
+        return t;
+    }
+
+    // 等比缩放
+    static affine_transform scale(double factor) { return scale(vec3(factor, factor, factor)); }
+
+    // 绕过原点的axis轴旋转degrees度(右手定则)，Rodrigues公式
+    static affine_transform rotate(const vec3& axis, double degrees) {
+        vec3 k = unit_vector(axis);
+        double theta = degrees_to_radians(degrees);
+        double c = std::cos(theta), s = std::sin(theta), one_c = 1 - c;
+        double x = k.x(), y = k.y(), z = k.z();
+        affine_transform t;
+        t.m[0][0] = real(c + x * x * one_c);
+        t.m[0][1] = real(x * y * one_c - z * s);
+        t.m[0][2] = real(x * z * one_c + y * s);
+        t.m[1][0] = real(y * x * one_c + z * s);
+        t.m[1][1] = real(c + y * y * one_c);
+        t.m[1][2] = real(y * z * one_c - x * s);
+        t.m[2][0] = real(z * x * one_c - y * s);
+        t.m[2][1] = real(z * y * one_c + x * s);
+        t.m[2][2] = real(c + z * z * one_c);
+        return t;
+    }
+
+    // 组合：先做rhs，再做this
+    affine_transform operator*(const affine_transform& rhs) const {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++) {
+                double sum = j == 3 ? m[i][3] : 0;
+                for (int k = 0; k < 3; k++)
+                    sum += double(m[i][k]) * rhs.m[k][j];
+                t.m[i][j] = real(sum);
+            }
+        return t;
+    }
+
+    // 逆变换：A^-1 (p - b)，A用伴随矩阵除以行列式求逆
+    // A不可逆(比如某个方向缩放成0)时没有逆变换，调用前要自己保证
+    affine_transform inverse() const {
+        double a[3][3];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                a[i][j] = m[i][j];
+        double cof[3][3];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) {
+                int i1 = (i + 1) % 3, i2 = (i + 2) % 3, j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                cof[i][j] = a[i1][j1] * a[i2][j2] - a[i1][j2] * a[i2][j1];
+            }
+        double det = a[0][0] * cof[0][0] + a[0][1] * cof[0][1] + a[0][2] * cof[0][2];
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                t.m[i][j] = real(cof[j][i] / det);
+        for (int i = 0; i < 3; i++) {
+            double sum = 0;
+            for (int k = 0; k < 3; k++)
+                sum -= double(t.m[i][k]) * m[k][3];
+            t.m[i][3] = real(sum);
+        }
+        return t;
+    }
+
+    // 变换一个点(带平移)
+    point3 apply_point(const point3& p) const {
+        return point3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+            m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+            m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+    }
+
+    // 变换一个方向(不带平移)
+    vec3 apply_vector(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+            m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+            m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    // A的转置乘v。法线要用A^-T变换，所以手里是逆变换时，用它的转置就能变换法线，不用再求一次逆
+    vec3 apply_transposed(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+            m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+            m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+    }
+
+    // 变换后的包围盒：每个轴上，A这一行的每一项乘以原包围盒在对应轴上的两端，取小的加起来是下界，大的加起来是上界
+    // (Arvo 1990，和变换8个角点再取包围盒的结果一样，但不用算8个点)
+    aabb apply_box(const aabb& box) const {
+        if (box.x.size() < 0 || box.y.size() < 0 || box.z.size() < 0)
+            return aabb();
+        interval out[3];
+        for (int i = 0; i < 3; i++) {
+            double lo = m[i][3], hi = m[i][3];
+            for (int j = 0; j < 3; j++) {
+                const interval& axis = box.axis_interval(j);
+                double a = m[i][j] * axis.min, b = m[i][j] * axis.max;
+                lo += std::fmin(a, b);
+                hi += std::fmax(a, b);
+            }
+            out[i] = interval(real(lo), real(hi));
+        }
+        return aabb(out[0], out[1], out[2]);
+    }
+
+private:
+    real m[3][4];
+};
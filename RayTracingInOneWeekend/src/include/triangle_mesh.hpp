@@ -0,0 +1,426 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "bvh_stats.hpp"
+#include "hittable.hpp"
+#include "render_stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// hittable的派生类：三角形网格
+// 几百万个三角形如果每个都做成一个hittable放进hittable_list/bvh_node，
+// 光是每个对象的虚表指针、shared_ptr和控制块就要上百字节，所以整个网格是一个hittable：
+//   顶点坐标统一存在一个float数组里(每个顶点12字节，多个三角形共用一个顶点)，
+//   三角形只存三个顶点下标(12字节)，
+//   网格自己建一棵紧凑的BVH(每个节点32字节，float的包围盒)，叶子直接对应下标数组里连续的一段，
+// 封闭网格平均每个三角形约50字节(顶点6、下标12、BVH节点约34)
+//
+// 光线和三角形求交用水密(watertight)算法(Woop, Benthin, Wald 2013)：
+// 把光线方向变换成+z轴，三角形投影到xy平面上，用三条边的有向面积判断光线是否穿过三角形
+// 相邻两个三角形共用的边，两边算出的有向面积严格互为相反数，光线打在边上或顶点上时至少有一个三角形算打中，
+// 不会从网格的缝里漏过去(普通的Möller-Trumbore算法会漏)
+// 求交在双精度下算，顶点是float，转换成double没有误差
+class triangle_mesh final : public hittable {
+public:
+    // positions每3个数是一个顶点的x,y,z，indices每3个数是一个三角形三个顶点的下标
+    // 三角形的正面按右手定则由顶点顺序(逆时针)决定；材质由material_table持有，object_id是输出AOV时的物体编号
+    // 构造时建BVH，下标数组会按BVH的叶子顺序重新排列
+    // 下标超出顶点个数的三角形直接丢掉(个数见dropped_triangle_count)，BVH的叶子用uint32_t记三角形序号，
+    // 超过UINT32_MAX个三角形时多出来的也丢掉
+    triangle_mesh(std::vector<float> positions, std::vector<uint32_t> indices, const material* mat,
+        int object_id = -1)
+        : positions(std::move(positions)), indices(std::move(indices)), mat(mat), object_id(object_id) {
+        this->positions.resize(this->positions.size() / 3 * 3);
+        drop_invalid_triangles();
+        build_bvh();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+        bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+        const ray_setup setup(r);
+
+        uint32_t hit_triangle = 0;
+        double hit_u = 0, hit_v = 0, hit_w = 0;
+        bool hit_anything = false;
+        int stack[128];
+        int stack_size = 0;
+        int current = 0;
+        while (true) {
+            const node& nd = nodes[current];
+            RTW_STAT(thread_stats().bvh_node_tests++);
+            if (box_hit(nd, orig, inv_dir, ray_t)) {
+                if (nd.count > 0) {
+                    for (uint32_t k = nd.offset; k < nd.offset + nd.count; k++) {
+                        double t, u, v, w;
+                        if (intersect(setup, k, ray_t, t, u, v, w)) {
+                            hit_anything = true;
+                            ray_t.max = real(t);
+                            hit_triangle = k;
+                            hit_u = u;
+                            hit_v = v;
+                            hit_w = w;
+                        }
+                    }
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                }
+                else if (dir_is_neg[nd.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = int(nd.offset);
+                }
+                else {
+                    stack[stack_size++] = int(nd.offset);
+                    current = current + 1;
+                }
+            }
+            else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+        if (!hit_anything)
+            return false;
+
+        // 交点用重心坐标在三角形上插值，而不是沿光线走t，这样交点一定落在三角形所在的平面上
+        point3 a = vertex(indices[3 * hit_triangle]);
+        point3 b = vertex(indices[3 * hit_triangle + 1]);
+        point3 c = vertex(indices[3 * hit_triangle + 2]);
+        rec.t = ray_t.max;
+        rec.p = hit_u * a + hit_v * b + hit_w * c;
+        rec.set_face_normal(r, unit_vector(cross(b - a, c - a)));
+        rec.mat = mat;
+        rec.object_id = object_id;
+        return true;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t vertex_count() const { return positions.size() / 3; }
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    // 构造时因为下标越界(或三角形太多)丢掉的三角形个数
+    size_t dropped_triangle_count() const { return dropped_triangles; }
+
+    // 网格占用的内存(顶点、下标和BVH节点)，不含对象本身
+    size_t memory_bytes() const {
+        return positions.capacity() * sizeof(float) + indices.capacity() * sizeof(uint32_t)
+            + nodes.capacity() * sizeof(node);
+    }
+
+    // BVH的构建统计
+    const bvh_stats& stats() const { return build_stats; }
+
+private:
+    // BVH节点，和bvh_node一样按深度优先顺序平铺：
+    // count > 0 是叶子，offset是叶子里第一个三角形的序号；count == 0 是内部节点，左子节点紧跟在后面，offset是右子节点的下标
+    struct node {
+        float lo[3], hi[3];
+        uint32_t offset = 0;
+        uint16_t count = 0;
+        uint16_t axis = 0;
+    };
+
+    // 构建时每个三角形的包围盒
+    struct build_item {
+        float lo[3], hi[3];
+        uint32_t triangle;
+        float centroid(int axis) const { return 0.5f * (lo[axis] + hi[axis]); }
+    };
+
+    struct bucket {
+        int count = 0;
+        float lo[3] = { float_infinity, float_infinity, float_infinity };
+        float hi[3] = { -float_infinity, -float_infinity, -float_infinity };
+    };
+
+    // 一条光线求交时只算一次的量：方向绝对值最大的轴作为z轴，另外两个轴的剪切系数
+    struct ray_setup {
+        int kx, ky, kz;
+        double sx, sy, sz;
+        double ox, oy, oz;
+
+        explicit ray_setup(const ray& r) {
+            const vec3& d = r.direction();
+            kz = std::fabs(d.x()) > std::fabs(d.y()) ? (std::fabs(d.x()) > std::fabs(d.z()) ? 0 : 2)
+                                                     : (std::fabs(d.y()) > std::fabs(d.z()) ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            // 保持投影后三角形的环绕方向不变
+            if (d[kz] < 0)
+                std::swap(kx, ky);
+            sx = double(d[kx]) / d[kz];
+            sy = double(d[ky]) / d[kz];
+            sz = 1.0 / d[kz];
+            ox = r.origin()[kx];
+            oy = r.origin()[ky];
+            oz = r.origin()[kz];
+        }
+    };
+
+    static constexpr float float_infinity = std::numeric_limits<float>::infinity();
+    static constexpr int bucket_count = 12;
+    static constexpr int max_leaf_size = 4;
+    static constexpr double traversal_cost = 1;
+    static constexpr int max_sah_depth = 64;
+
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    std::vector<node> nodes;
+    const material* mat;
+    int object_id;
+    aabb bbox;
+    bvh_stats build_stats;
+    size_t dropped_triangles = 0;
+
+    // 去掉不完整的、下标越界的三角形，之后求交和建BVH都不用再检查下标
+    void drop_invalid_triangles() {
+        const size_t vertices = vertex_count();
+        const size_t given = indices.size() / 3;
+        const size_t limit = std::min<size_t>(given, std::numeric_limits<uint32_t>::max());
+        size_t kept = 0;
+        for (size_t k = 0; k < limit; k++) {
+            const uint32_t* tri = &indices[3 * k];
+            if (tri[0] >= vertices || tri[1] >= vertices || tri[2] >= vertices)
+                continue;
+            if (kept != k)
+                std::copy(tri, tri + 3, &indices[3 * kept]);
+            kept++;
+        }
+        indices.resize(3 * kept);
+        dropped_triangles = given - kept;
+    }
+
+    point3 vertex(uint32_t v) const {
+        const float* p = &positions[3 * size_t(v)];
+        return point3(p[0], p[1], p[2]);
+    }
+
+    // slab法测包围盒。包围盒没有像aabb那样往外扩，三角形的顶点正好在盒子的角上，
+    // 光线又正好穿过这个顶点时，各轴算出的t的舍入误差可能让进入的t比离开的t大一点点，
+    // 所以离开的t放大几个ulp(Ize 2013，pbrt里的1 + 2 * gamma(3))，保证这种光线不会被包围盒漏掉
+    static bool box_hit(const node& nd, const point3& orig, const vec3& inv_dir, interval ray_t) {
+        static constexpr real slack = 1 + 4 * std::numeric_limits<real>::epsilon();
+        for (int axis = 0; axis < 3; axis++) {
+            auto t0 = (nd.lo[axis] - orig[axis]) * inv_dir[axis];
+            auto t1 = (nd.hi[axis] - orig[axis]) * inv_dir[axis];
+            if (t0 > t1) std::swap(t0, t1);
+            t1 *= slack;
+            ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+            ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
+            if (ray_t.max < ray_t.min)
+                return false;
+        }
+        return true;
+    }
+
+    // 第k个三角形的水密求交，打中时返回t和三个顶点的重心坐标
+    bool intersect(const ray_setup& s, uint32_t k, const interval& ray_t, double& t, double& u, double& v,
+        double& w) const {
+        RTW_STAT(thread_stats().primitive_tests++);
+        const float* a = &positions[3 * size_t(indices[3 * k])];
+        const float* b = &positions[3 * size_t(indices[3 * k + 1])];
+        const float* c = &positions[3 * size_t(indices[3 * k + 2])];
+        // 顶点平移到以光线起点为原点，再剪切成光线沿+z方向
+        const double az = a[s.kz] - s.oz, bz = b[s.kz] - s.oz, cz = c[s.kz] - s.oz;
+        const double ax = a[s.kx] - s.ox - s.sx * az, ay = a[s.ky] - s.oy - s.sy * az;
+        const double bx = b[s.kx] - s.ox - s.sx * bz, by = b[s.ky] - s.oy - s.sy * bz;
+        const double cx = c[s.kx] - s.ox - s.sx * cz, cy = c[s.ky] - s.oy - s.sy * cz;
+        // 三条边的有向面积，符号都相同(或为0)时光线穿过三角形
+        u = cx * by - cy * bx;
+        v = ax * cy - ay * cx;
+        w = bx * ay - by * ax;
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+            return false;
+        const double det = u + v + w;
+        if (det == 0)
+            return false;
+        t = (u * az + v * bz + w * cz) * s.sz / det;
+        if (!ray_t.surrounds(t))
+            return false;
+        u /= det;
+        v /= det;
+        w /= det;
+        return true;
+    }
+
+    void build_bvh() {
+        auto start = std::chrono::steady_clock::now();
+        const size_t n = triangle_count();
+        std::vector<build_item> items(n);
+        for (size_t k = 0; k < n; k++) {
+            build_item& item = items[k];
+            item.triangle = uint32_t(k);
+            for (int axis = 0; axis < 3; axis++) {
+                float p0 = positions[3 * size_t(indices[3 * k]) + axis];
+                float p1 = positions[3 * size_t(indices[3 * k + 1]) + axis];
+                float p2 = positions[3 * size_t(indices[3 * k + 2]) + axis];
+                item.lo[axis] = std::min(p0, std::min(p1, p2));
+                item.hi[axis] = std::max(p0, std::max(p1, p2));
+            }
+        }
+
+        bvh_stats local;
+        local.primitive_count = n;
+        if (n > 0) {
+            nodes.reserve(2 * n - 1);
+            nodes.emplace_back();
+            build(0, items, 0, n, 1, local);
+            nodes.shrink_to_fit();
+            bbox = aabb(point3(nodes[0].lo[0], nodes[0].lo[1], nodes[0].lo[2]),
+                point3(nodes[0].hi[0], nodes[0].hi[1], nodes[0].hi[2]));
+        }
+
+        // 按构建后的顺序重新排列三角形，每个叶子对应连续的一段
+        std::vector<uint32_t> ordered(indices.size());
+        for (size_t k = 0; k < n; k++)
+            for (int j = 0; j < 3; j++)
+                ordered[3 * k + j] = indices[3 * size_t(items[k].triangle) + j];
+        indices.swap(ordered);
+
+        local.node_count = nodes.size();
+        local.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        build_stats = local;
+    }
+
+    static double half_area(const float lo[3], const float hi[3]) {
+        double dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        if (dx < 0 || dy < 0 || dz < 0)
+            return 0;
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    static void grow(float lo[3], float hi[3], const float other_lo[3], const float other_hi[3]) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = std::min(lo[axis], other_lo[axis]);
+            hi[axis] = std::max(hi[axis], other_hi[axis]);
+        }
+    }
+
+    // 递归构建[start, end)范围内的三角形，做法和bvh_node::build一样：
+    // 物体少时比较分开和不分开的SAH代价，多时按SAH分，找不到好的分割或者树太深时按中位数分
+    void build(size_t node_index, std::vector<build_item>& items, size_t start, size_t end, int depth,
+        bvh_stats& st) {
+        float lo[3] = { float_infinity, float_infinity, float_infinity };
+        float hi[3] = { -float_infinity, -float_infinity, -float_infinity };
+        float clo[3] = { float_infinity, float_infinity, float_infinity };
+        float chi[3] = { -float_infinity, -float_infinity, -float_infinity };
+        for (size_t i = start; i < end; i++) {
+            grow(lo, hi, items[i].lo, items[i].hi);
+            for (int axis = 0; axis < 3; axis++) {
+                clo[axis] = std::min(clo[axis], items[i].centroid(axis));
+                chi[axis] = std::max(chi[axis], items[i].centroid(axis));
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            nodes[node_index].lo[axis] = lo[axis];
+            nodes[node_index].hi[axis] = hi[axis];
+        }
+        if (depth > st.max_depth)
+            st.max_depth = depth;
+
+        const size_t n = end - start;
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (chi[a] - clo[a] > chi[axis] - clo[axis])
+                axis = a;
+        const float extent = chi[axis] - clo[axis];
+
+        // 中心点全挤在一起时分桶没有意义：物体少就做成叶子，多就从中间随便切开
+        if (n <= 1 || (extent <= 0 && n <= max_leaf_size)) {
+            make_leaf(node_index, start, n, st);
+            return;
+        }
+        size_t mid = start + n / 2;
+        if (extent > 0) {
+            if (n <= max_leaf_size) {
+                if (!split_by_sah(items, start, end, lo, hi, clo[axis], extent, axis, mid, true)) {
+                    make_leaf(node_index, start, n, st);
+                    return;
+                }
+            }
+            else if (depth >= max_sah_depth || !split_by_sah(items, start, end, lo, hi, clo[axis], extent, axis, mid, false)) {
+                std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+                    [axis](const build_item& a, const build_item& b) { return a.centroid(axis) < b.centroid(axis); });
+            }
+        }
+
+        nodes[node_index].axis = uint16_t(axis);
+        nodes[node_index].count = 0;
+        size_t left = nodes.size();
+        nodes.emplace_back();
+        build(left, items, start, mid, depth + 1, st);
+        size_t right = nodes.size();
+        nodes.emplace_back();
+        nodes[node_index].offset = uint32_t(right);
+        build(right, items, mid, end, depth + 1, st);
+    }
+
+    void make_leaf(size_t node_index, size_t start, size_t n, bvh_stats& st) {
+        nodes[node_index].offset = uint32_t(start);
+        nodes[node_index].count = uint16_t(n);
+        st.leaf_count++;
+    }
+
+    bool split_by_sah(std::vector<build_item>& items, size_t start, size_t end, const float lo[3], const float hi[3],
+        float axis_min, float extent, int axis, size_t& mid, bool allow_leaf) const {
+        bucket buckets[bucket_count];
+        auto bucket_of = [&](const build_item& item) {
+            int b = int(bucket_count * ((item.centroid(axis) - axis_min) / extent));
+            return b < bucket_count ? b : bucket_count - 1;
+        };
+        for (size_t i = start; i < end; i++) {
+            bucket& b = buckets[bucket_of(items[i])];
+            b.count++;
+            grow(b.lo, b.hi, items[i].lo, items[i].hi);
+        }
+
+        double right_area[bucket_count - 1];
+        int right_count[bucket_count - 1];
+        bucket acc;
+        for (int i = bucket_count - 1; i > 0; i--) {
+            grow(acc.lo, acc.hi, buckets[i].lo, buckets[i].hi);
+            acc.count += buckets[i].count;
+            right_area[i - 1] = half_area(acc.lo, acc.hi);
+            right_count[i - 1] = acc.count;
+        }
+
+        double best_cost = infinity;
+        int best_split = -1;
+        acc = bucket();
+        for (int i = 0; i < bucket_count - 1; i++) {
+            grow(acc.lo, acc.hi, buckets[i].lo, buckets[i].hi);
+            acc.count += buckets[i].count;
+            if (acc.count == 0 || right_count[i] == 0)
+                continue;
+            double cost = acc.count * half_area(acc.lo, acc.hi) + right_count[i] * right_area[i];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = i;
+            }
+        }
+        if (best_split < 0)
+            return false;
+
+        double parent_area = half_area(lo, hi);
+        best_cost = traversal_cost + (parent_area > 0 ? best_cost / parent_area : 0);
+        if (allow_leaf && best_cost >= double(end - start))
+            return false;
+
+        auto it = std::partition(items.begin() + start, items.begin() + end,
+            [&](const build_item& item) { return bucket_of(item) <= best_split; });
+        mid = size_t(it - items.begin());
+        return mid != start && mid != end;
+    }
+};
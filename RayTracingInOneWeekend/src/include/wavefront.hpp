@@ -0,0 +1,152 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include "accumulation.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// 波前(wavefront)式路径追踪用到的数据结构和通用的阶段
+// 和一次把一条路径追踪到底不同，波前式把一批路径放在队列里，按阶段整批处理：
+// 生成 -> 求交 -> 着色(散射) -> 压缩(去掉结束的路径) -> 下一次弹射的求交 ...
+// 同一阶段连续执行同一段代码、访问同一批场景数据，对指令缓存和数据缓存都更友好，
+// 两个可选的排序阶段(见wavefront_sort_rays和wavefront_sort_by_material)让同一批里相邻的路径更相似
+
+// 队列中一条正在追踪的路径
+struct wavefront_path {
+    ray r;               // 下一段要追踪的光线
+    color throughput;    // 到目前为止的衰减乘积
+    uint64_t pixel_key;  // 像素的随机数键，用来在任何阶段恢复这条路径的随机数
+    uint32_t pixel_index; // 像素的位置(j * 图像宽度 + i)，采样器要用
+    uint32_t sample;     // 这是像素的第几个采样点
+    uint32_t slot;       // 这条路径的结果写到radiance数组的哪个位置
+};
+
+// 一批路径在各阶段的状态
+struct wavefront_queue {
+    std::vector<wavefront_path> paths;   // 当前活着的路径
+    std::vector<wavefront_path> next;    // 压缩后下一次弹射的路径
+    std::vector<hit_record> hits;        // 和paths一一对应的求交结果
+    std::vector<unsigned char> did_hit;  // 是否打中物体
+    std::vector<unsigned char> alive;    // 着色后是否继续追踪
+    std::vector<color> radiance;         // 每条路径最终的贡献，按slot存放
+    std::vector<sample_features> features; // 每条路径第一次击中处的特征，按slot存放(收集特征时才用)
+
+    // 这次弹射处理路径的顺序(paths的下标)，求交、着色、压缩都按这个顺序走
+    // 排序阶段只重排这个数组，不搬动路径和求交结果本身
+    std::vector<uint32_t> order;
+    // 排序阶段的临时数据，放在队列里反复使用，不用每次弹射都重新分配
+    std::vector<uint16_t> sort_groups;
+    std::vector<uint32_t> sorted_order;
+};
+
+// 各阶段的累计耗时(秒)
+struct wavefront_timings {
+    double generate = 0;
+    double intersect = 0;
+    double shade = 0;
+    double compact = 0;
+    double resolve = 0;
+    double sort = 0;
+
+    wavefront_timings& operator+=(const wavefront_timings& o) {
+        generate += o.generate;
+        intersect += o.intersect;
+        shade += o.shade;
+        compact += o.compact;
+        resolve += o.resolve;
+        sort += o.sort;
+        return *this;
+    }
+};
+
+// 计时的小工具：记录从构造到调用lap()经过的秒数，累加到目标上后重新开始计时
+class stage_timer {
+public:
+    stage_timer() : start(std::chrono::steady_clock::now()) {}
+
+    void lap(double& target) {
+        auto now = std::chrono::steady_clock::now();
+        target += std::chrono::duration<double>(now - start).count();
+        start = now;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// 按队列里的原顺序处理
+inline void wavefront_identity_order(wavefront_queue& q) {
+    q.order.resize(q.paths.size());
+    for (size_t k = 0; k < q.order.size(); k++)
+        q.order[k] = uint32_t(k);
+}
+
+// 求交阶段：整批光线按order的顺序依次和场景求交，结果和paths一一对应
+inline void wavefront_intersect(const hittable& world, wavefront_queue& q) {
+    size_t n = q.paths.size();
+    q.hits.resize(n);
+    q.did_hit.resize(n);
+    for (uint32_t k : q.order)
+        q.did_hit[k] = world.hit(q.paths[k].r, interval(0.001, infinity), q.hits[k]) ? 1 : 0;
+}
+
+// 压缩阶段：把还活着的路径按order的顺序挪到队列前面，作为下一次弹射的输入
+inline void wavefront_compact(wavefront_queue& q) {
+    q.next.clear();
+    for (uint32_t k : q.order)
+        if (q.alive[k])
+            q.next.push_back(q.paths[k]);
+    q.paths.swap(q.next);
+}
+
+// 把order按key_of(路径下标)给出的组号([0, GroupCount))稳定地排序，计数排序，O(n)
+// key_of可能要读路径、求交结果指向的内存，只调用一遍，组号记下来给第二遍用
+template <int GroupCount, class KeyFn>
+inline void wavefront_group_order(wavefront_queue& q, KeyFn key_of) {
+    const size_t n = q.order.size();
+    q.sort_groups.resize(n);
+    size_t start[GroupCount + 1] = {};
+    for (size_t i = 0; i < n; i++) {
+        const uint16_t group = uint16_t(key_of(q.order[i]));
+        q.sort_groups[i] = group;
+        start[group + 1]++;
+    }
+    for (int g = 0; g < GroupCount; g++)
+        start[g + 1] += start[g];
+    q.sorted_order.resize(n);
+    for (size_t i = 0; i < n; i++)
+        q.sorted_order[start[q.sort_groups[i]]++] = q.order[i];
+    q.order.swap(q.sorted_order);
+}
+
+// 光线排序阶段：求交之前把路径按光线方向的卦限(三个分量的正负)分组
+// 只是按卦限分组，不是完整的相干排序：排序键里没有起点
+// 弹射之后的光线方向是随机的，BVH遍历时每个内部节点先走哪个子节点由方向的正负决定，
+// 分组后连续的光线走的顺序相同，分支好预测，访问的节点也更接近
+// 一批路径来自同一个图像块，压缩后又保持着生成时的顺序，起点本来就挨在一起；
+// 试过再加上起点或方向的Morton码(每轴1~4位)，多出来的算键和排序的开销比遍历省下的还多，整体更慢
+// 实测(scene_tool sort)只按卦限分组也没有稳定的收益：在单核机器上和不排序相比在-10%~+20%之间波动，
+// 分不出噪声，所以默认关闭(camera_rt2::sort_secondary_rays)，留着做对比实验用
+inline void wavefront_sort_rays(wavefront_queue& q) {
+    wavefront_identity_order(q);
+    wavefront_group_order<8>(q, [&](uint32_t k) {
+        const vec3& d = q.paths[k].r.direction();
+        return (d.x() < 0 ? 1 : 0) | (d.y() < 0 ? 2 : 0) | (d.z() < 0 ? 4 : 0);
+    });
+}
+
+// 材质排序阶段：求交之后、着色之前把路径按材质的类型分组，没打中的放最前面
+// 同一类材质的散射连续执行，switch的分支总是走同一边，一段时间里只用到一种材质的代码
+// 和光线排序一样默认关闭(camera_rt2::sort_by_material)，测量结果见wavefront_sort_rays
+// 分组是稳定的，同一组里保持光线排序后的相对顺序
+inline void wavefront_sort_by_material(wavefront_queue& q) {
+    // 0是没打中，其余是1 + material_kind
+    wavefront_group_order<1 + material_kind_count>(q, [&](uint32_t k) {
+        return q.did_hit[k] ? 1 + int(q.hits[k].mat->kind()) : 0;
+    });
+}
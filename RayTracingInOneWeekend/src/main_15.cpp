@@ -42,5 +42,5 @@ int main() {
     cam.defocus_angle = 10.0;
     cam.focus_dist = 3.4;
 
-    cam.render(world);
+    return cam.render(world) ? 0 : 1;
 }
\ No newline at end of file
@@ -1,82 +1,259 @@
 #include "rtweekend.hpp"
 
+#include "bvh.hpp"
 #include "camera_rt2.hpp"
+#include "distributed.hpp"
 #include "hittable.hpp"
 #include "hittable_list.hpp"
 #include "material.hpp"
-#include "sphere.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
 
-int main() {
-    hittable_list world;
-
-    // 生成一个哑光材质，灰白色
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    // 在场景里加一个球，非常大的球，作为地面
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
-    // 这里2层循环是为了随机取球心的坐标，生成各种材质的球
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            // 选取一个随机数，用于材质抽奖
-            auto choose_mat = random_double();
-            // 给出一个球心的位置，可以看到y固定0.2，xz是用a,b再加随机数的0.9倍得到的
-            // 这里为了保证这些随机球心的球体不会重合
-            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-            // 球心不能在这个范围内(留出一些空间生成特殊球体)
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
-                // 如果随机数小于0.8,生成哑光材质小球，颜色也随机
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    // 半径为0.2
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-                // 如果随机数小于0.95其实是[0.8,0.95)),金属材质小球，粗糙度和颜色(深色范围)随机，半径0.2
-                else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-                // [0.95,1) 玻璃球，电导体材质，半径0.2
-                else {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
+int main(int argc, char* argv[]) {
+    // 命令行参数：-o 输出文件路径，-f 输出格式(ppm/p6/pfm)
+    // --adaptive 打开自适应采样，--sample-map 输出每个像素的采样次数图
+    // --integrator 选择积分器(recursive/iterative)，--rr-depth 迭代积分器开始俄罗斯轮盘赌的深度
+    // --wavefront 使用波前式渲染引擎，--counter-rng 使用基于计数器的随机数
+    // --sort-rays 波前式引擎求交前把弹射后的光线按方向的卦限分组，--sort-materials 波前式引擎着色前按材质类型排序
+    // (这两个都是对比实验用的，测量结果见wavefront.hpp的wavefront_sort_rays)
+    // --width 图像宽度，--spp 每个像素的采样点数(缩小规模做对比测试用)
+    // --stats 渲染统计写成JSON的路径(需要用RTW_ENABLE_STATS编译)
+    // --scene 从场景文件加载场景(文本或二进制格式)，不指定则用内置的随机小球场景
+    // --save-scene 把场景保存成文件，后缀是.bin时写二进制格式
+    // --sampler 采样器(random/stratified/sobol/zsobol)
+    // --workers 分成多个本机工作进程渲染，--listen 在端口上接受远程工作进程，
+    // --connect 作为工作进程连接到协调进程(主机:端口)，--kill-worker-after 测试容错用，让第一个工作进程中途退出
+    // --tile-timeout 一块超过这么多秒没交回来就认为工作进程卡住了(0表示不限)，--hang-worker-after 测试超时用，让第一个工作进程中途卡住
+    // --checkpoint 定期把累加缓冲写成检查点，--checkpoint-interval 写检查点的间隔(秒)，
+    // --resume 从检查点接着渲染(没指定--checkpoint时继续写回同一个文件)，
+    // 用stratified和zsobol采样器时续算不能改--spp
+    // --denoise 渲染完用第一次击中处的反射率、法线和深度引导降噪
+    // --aov 同一遍渲染输出深度、法线、反射率、材质编号、物体编号和采样次数，写到输出图像旁边
+    // --dispatch 物体求交和材质散射的分派方式：closed按类型标记直接调用(默认)，virtual全部走虚函数
+    std::string output_path;
+    std::string format_name;
+    bool adaptive = false;
+    std::string sample_map_path;
+    std::string integrator_name = "recursive";
+    int rr_depth = 3;
+    bool wavefront = false;
+    bool sort_rays = false;
+    bool sort_materials = false;
+    bool counter_rng = false;
+    int image_width = 0;
+    int samples_per_pixel = 0;
+    std::string stats_path;
+    std::string scene_path;
+    std::string save_scene_path;
+    std::string sampler_name = "random";
+    distributed_options distributed;
+    std::string connect_address;
+    std::string checkpoint_path;
+    double checkpoint_interval = 60;
+    std::string resume_path;
+    bool denoise = false;
+    bool aovs = false;
+    std::string dispatch_name = "closed";
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "-o" && k + 1 < argc)
+            output_path = argv[++k];
+        else if (arg == "-f" && k + 1 < argc)
+            format_name = argv[++k];
+        else if (arg == "--adaptive")
+            adaptive = true;
+        else if (arg == "--sample-map" && k + 1 < argc)
+            sample_map_path = argv[++k];
+        else if (arg == "--integrator" && k + 1 < argc)
+            integrator_name = argv[++k];
+        else if (arg == "--rr-depth" && k + 1 < argc)
+            rr_depth = std::atoi(argv[++k]);
+        else if (arg == "--wavefront")
+            wavefront = true;
+        else if (arg == "--sort-rays")
+            sort_rays = true;
+        else if (arg == "--sort-materials")
+            sort_materials = true;
+        else if (arg == "--counter-rng")
+            counter_rng = true;
+        else if (arg == "--width" && k + 1 < argc)
+            image_width = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--spp" && k + 1 < argc)
+            samples_per_pixel = std::max(1, std::atoi(argv[++k]));
+        else if (arg == "--stats" && k + 1 < argc)
+            stats_path = argv[++k];
+        else if (arg == "--scene" && k + 1 < argc)
+            scene_path = argv[++k];
+        else if (arg == "--save-scene" && k + 1 < argc)
+            save_scene_path = argv[++k];
+        else if (arg == "--sampler" && k + 1 < argc)
+            sampler_name = argv[++k];
+        else if (arg == "--workers" && k + 1 < argc)
+            distributed.local_workers = std::max(0, std::atoi(argv[++k]));
+        else if (arg == "--listen" && k + 1 < argc)
+            distributed.listen_port = std::max(0, std::atoi(argv[++k]));
+        else if (arg == "--connect" && k + 1 < argc)
+            connect_address = argv[++k];
+        else if (arg == "--kill-worker-after" && k + 1 < argc)
+            distributed.kill_worker_after = std::max(0, std::atoi(argv[++k]));
+        else if (arg == "--tile-timeout" && k + 1 < argc)
+            distributed.tile_timeout = std::max(0.0, std::atof(argv[++k]));
+        else if (arg == "--hang-worker-after" && k + 1 < argc)
+            distributed.hang_worker_after = std::max(0, std::atoi(argv[++k]));
+        else if (arg == "--checkpoint" && k + 1 < argc)
+            checkpoint_path = argv[++k];
+        else if (arg == "--checkpoint-interval" && k + 1 < argc)
+            checkpoint_interval = std::atof(argv[++k]);
+        else if (arg == "--resume" && k + 1 < argc)
+            resume_path = argv[++k];
+        else if (arg == "--denoise")
+            denoise = true;
+        else if (arg == "--aov")
+            aovs = true;
+        else if (arg == "--dispatch" && k + 1 < argc)
+            dispatch_name = argv[++k];
+        else {
+            std::cerr << "Usage: " << argv[0]
+                << " [-o output_path] [-f ppm|p6|pfm] [--adaptive] [--sample-map path]"
+                << " [--integrator recursive|iterative] [--rr-depth n] [--wavefront] [--sort-rays] [--sort-materials] [--counter-rng]"
+                << " [--width n] [--spp n] [--stats path] [--scene path] [--save-scene path]"
+                << " [--sampler random|stratified|sobol|zsobol]"
+                << " [--workers n] [--listen port] [--connect host:port] [--kill-worker-after n]"
+                << " [--tile-timeout seconds] [--hang-worker-after n]"
+                << " [--checkpoint path] [--checkpoint-interval seconds] [--resume path]"
+                << " [--denoise] [--aov] [--dispatch closed|virtual]\n";
+            return 1;
         }
     }
+    // 没指定格式时，写文件按后缀推断，写标准输出则保持文本PPM
+    image_format format = output_path.empty() ? image_format::ppm_ascii : image_format_from_path(output_path);
+    if (!format_name.empty() && !parse_image_format(format_name, format)) {
+        std::cerr << "Unknown image format: " << format_name << "\n";
+        return 1;
+    }
+    sampler_type sampler = sampler_type::random;
+    if (!parse_sampler_type(sampler_name, sampler)) {
+        std::cerr << "Unknown sampler: " << sampler_name << "\n";
+        return 1;
+    }
+    integrator_type integrator = integrator_type::recursive;
+    if (!parse_integrator_type(integrator_name, integrator)) {
+        std::cerr << "Unknown integrator: " << integrator_name << "\n";
+        return 1;
+    }
+    dispatch_mode dispatch = dispatch_mode::closed_set;
+    if (!parse_dispatch_mode(dispatch_name, dispatch)) {
+        std::cerr << "Unknown dispatch mode: " << dispatch_name << "\n";
+        return 1;
+    }
 
-    // 单独加3个球，放在刚刚空出来的位置
-    // 三种材质下，半径为1的球
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    // 场景描述：从文件加载，或者生成内置的场景
+    scene_data scene;
+    if (!scene_path.empty()) {
+        stage_timer timer;
+        double load_seconds = 0;
+        std::string error;
+        if (!load_scene(scene_path, scene, error)) {
+            std::cerr << "Cannot load scene: " << error << "\n";
+            return 1;
+        }
+        timer.lap(load_seconds);
+        std::clog << "Scene: " << scene.materials.size() << " materials, " << scene.sphere_count()
+            << " spheres, loaded in " << load_seconds * 1000 << " ms\n";
+    }
+    else {
+        scene = random_spheres_scene();
+    }
+    if (!save_scene_path.empty() && !save_scene(save_scene_path, scene))
+        return 1;
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    // 场景里所有的材质都由材质表持有，物体和BVH由arena持有，world和BVH里只记录指针
+    // 大球单独加入，小球按空间位置分组放进sphere_set，用SIMD一次测多个球
+    material_table materials;
+    scene_arena arena;
+    hittable_list world;
+    {
+        stage_timer timer;
+        double build_seconds = 0;
+        build_scene_world(scene, materials, world, arena);
+        timer.lap(build_seconds);
+        std::clog << "World: " << world.objects.size() << " objects, built in " << build_seconds * 1000 << " ms\n";
+    }
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    // 用BVH把场景里的物体组织起来，代替逐个物体测试的线性遍历
+    bvh_stats stats;
+    auto bvh = arena.make_shared<bvh_node>(world, &stats);
+    bvh->set_dispatch(dispatch);
+    world = hittable_list(bvh);
+    std::clog << "BVH: " << stats.primitive_count << " primitives, "
+        << stats.node_count << " nodes (" << stats.leaf_count << " leaves), depth "
+        << stats.max_depth << ", built in " << stats.build_ms << " ms\n";
 
     camera_rt2 cam;
-    // 视口宽高比，图像宽度，每个像素采样点个数，光线最大迭代次数设置
-    cam.aspect_ratio = 16.0 / 9.0;
-    cam.image_width = 1200;
-    cam.samples_per_pixel = 100;
-    cam.max_depth = 50;
-    // 相机视场角，位置，朝向设置
-    cam.vfov = 20;
-    cam.lookfrom = point3(13, 2, 3);
-    cam.lookat = point3(0, 0, 0);
-    cam.vup = vec3(0, 1, 0);
-    // 景深参数
-    // 失焦角度
-    cam.defocus_angle = 0.6;
-    // 焦点距离
-    cam.focus_dist = 10.0;
+    // 视口宽高比，图像宽度，每个像素采样点个数，光线最大迭代次数，视场角，位置，朝向，景深参数都来自场景描述
+    apply_scene_camera(scene.camera, cam);
+    // 命令行指定的图像宽度和采样数优先
+    if (image_width > 0)
+        cam.image_width = image_width;
+    if (samples_per_pixel > 0)
+        cam.samples_per_pixel = samples_per_pixel;
+    // 渲染线程数，0表示用上所有的CPU核心
+    cam.thread_count = 0;
+    // 输出格式和路径
+    cam.output_format = format;
+    cam.output_path = output_path;
+    // 自适应采样：samples_per_pixel作为上限，每个像素至少采16次
+    cam.adaptive_sampling = adaptive;
+    cam.min_samples = 16;
+    cam.sample_map_path = sample_map_path;
+    // 积分器
+    cam.integrator = integrator;
+    cam.rr_min_depth = rr_depth;
+    // 渲染引擎和随机数模式
+    cam.engine = wavefront ? render_engine::wavefront : render_engine::megakernel;
+    cam.sort_secondary_rays = sort_rays;
+    cam.sort_by_material = sort_materials;
+    cam.random_mode = counter_rng ? rng_mode::counter : rng_mode::stream;
+    cam.sampler = sampler;
+    cam.material_dispatch = dispatch;
+    // 渲染统计
+    cam.stats_path = stats_path;
+    // 检查点和续算
+    cam.checkpoint_path = checkpoint_path.empty() ? resume_path : checkpoint_path;
+    cam.checkpoint_interval = checkpoint_interval;
+    cam.resume_path = resume_path;
+    cam.scene_key = scene_digest(scene);
+    // 降噪和AOV，要整张图第一次击中处的特征，工作进程不回传这些，所以分布式渲染时不支持
+    const bool distributed_render = !connect_address.empty() || distributed.local_workers > 0
+        || distributed.listen_port > 0;
+    cam.denoise = denoise && !distributed_render;
+    cam.write_aovs = aovs && !distributed_render;
+    if ((denoise || aovs) && distributed_render)
+        std::clog << "--denoise and --aov are not supported with distributed rendering, ignored\n";
+
+    // 分布式渲染：协调进程和所有工作进程的任务键必须一致
+    uint64_t job_key = render_job_key(cam, cam.scene_key);
+    if (!connect_address.empty()) {
+        // 工作进程：单线程渲染协调进程分来的块
+        cam.thread_count = 1;
+        std::string error;
+        int fd = connect_to_coordinator(connect_address, error);
+        if (fd < 0 || !run_render_worker(fd, cam, world, job_key, 0, error)) {
+            std::cerr << "Worker failed: " << error << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (distributed.local_workers > 0 || distributed.listen_port > 0) {
+        framebuffer image;
+        std::vector<int> spp;
+        std::string error;
+        if (!render_distributed(cam, world, job_key, distributed, image, spp, error)) {
+            std::cerr << "Distributed render failed: " << error << "\n";
+            return 1;
+        }
+        return cam.write_outputs(image, spp) ? 0 : 1;
+    }
 
-    cam.render(world);
+    return cam.render(world) ? 0 : 1;
 }
\ No newline at end of file
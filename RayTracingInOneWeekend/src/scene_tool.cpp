@@ -0,0 +1,621 @@
+#include "rtweekend.hpp"
+
+#include "benchmark.hpp"
+#include "bvh.hpp"
+#include "camera_rt2.hpp"
+#include "instance.hpp"
+#include "obj_loader.hpp"
+#include "perf_counter.hpp"
+#include "scene_arena.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
+#include "triangle_mesh.hpp"
+#include "wavefront.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 场景文件工具
+// 用法:
+//   scene_tool random <half_extent> <输出文件>  生成随机小球场景，约(2*half_extent)^2个球，
+//                                              half_extent为500时约100万个球
+//   scene_tool convert <输入文件> <输出文件>    文本和二进制格式互相转换(输出后缀是.bin时写二进制)
+//   scene_tool info <输入文件>                  加载场景，输出物体个数、加载和建场景的耗时
+//   scene_tool instances <个数> [输出图像]       把一个由小球堆成的原型按随机的旋转、缩放摆放很多份，
+//                                              输出每个实例的内存、建BVH的耗时和光线求交的速度，
+//                                              给了输出图像时再渲染一张小图看摆放的结果
+//   scene_tool obj <segments> <输出文件>        生成一个测试用的三角形网格(带起伏的球，约4*segments^2个三角形)，写成OBJ
+//   scene_tool mesh <OBJ文件> [输出图像]         读取OBJ，输出读取、建BVH的耗时、每个三角形占的内存和光线求交的速度，
+//                                              给了输出图像时再渲染一张小图
+//   scene_tool arena <half_extent>              同一个随机小球场景，物体各自make_shared和放进scene_arena两种做法，
+//                                              比较建场景、建BVH、求交(和缓存未命中)、释放的耗时
+//   scene_tool sort <half_extent>               随机小球场景(每个球一个材质)用波前式引擎渲染，
+//                                              比较弹射后的光线排序、按材质排序打开和关闭时的渲染耗时
+//   scene_tool check                            用构造出来的坏文件(截断、个数溢出、越界、超范围的整数)检查场景文件的解析，
+//                                              每一个都应该报错而不是崩溃或加载成功；再检查三角形网格丢掉越界的下标
+
+// instances命令：原型是一团64个小球，放在半径1的球里，自己建一棵BVH
+static int instances_command(int count, const std::string& image_path) {
+    rng_state rng;
+    rng.seed(0x1ce);
+    scene_data prototype_scene;
+    uint32_t mats[3] = { prototype_scene.add_lambertian(color(0.8, 0.3, 0.2)),
+        prototype_scene.add_metal(color(0.8, 0.8, 0.9), 0.1), prototype_scene.add_lambertian(color(0.2, 0.5, 0.8)) };
+    for (int k = 0; k < 64; k++) {
+        vec3 p;
+        do
+            p = vec3(random_double(rng), random_double(rng), random_double(rng)) * 2 - vec3(1, 1, 1);
+        while (p.length_squared() > 1);
+        prototype_scene.add_sphere(0.8 * p, 0.08 + 0.12 * random_double(rng), mats[k % 3]);
+    }
+    material_table materials;
+    hittable_list prototype_spheres;
+    build_scene_world(prototype_scene, materials, prototype_spheres);
+    bvh_node prototype(prototype_spheres);
+
+    // 实例摆在地面上的网格里，每格随机旋转、缩放，间距3
+    stage_timer timer;
+    double place_seconds = 0, build_seconds = 0;
+    const int side = int(std::ceil(std::sqrt(double(count))));
+    std::vector<affine_transform> placements;
+    std::vector<double> scales;
+    hittable_list world;
+    world.objects.reserve(size_t(count) + 1);
+    for (int k = 0; k < count; k++) {
+        double x = 3.0 * (k % side - 0.5 * side), z = 3.0 * (k / side - 0.5 * side);
+        double s = 0.6 + 0.6 * random_double(rng);
+        vec3 axis(random_double(rng) - 0.5, random_double(rng) - 0.5, random_double(rng) - 0.5);
+        auto placement = affine_transform::translate(vec3(x, s, z)) * affine_transform::rotate(axis, 360 * random_double(rng))
+            * affine_transform::scale(s);
+        world.add(make_shared<instance>(&prototype, placement));
+        placements.push_back(placement);
+        scales.push_back(s);
+    }
+    timer.lap(place_seconds);
+    auto ground = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground.get()));
+    bvh_stats stats;
+    auto bvh = make_shared<bvh_node>(world, &stats);
+    timer.lap(build_seconds);
+
+    // 从网格上方随机射向网格的光线，每次用同一组光线
+    const double extent = 1.5 * side;
+    const int ray_count = 1 << 18;
+    auto trace = [&](const hittable& target, std::vector<double>& t_hit) {
+        rng_state ray_rng;
+        ray_rng.seed(0x4a7);
+        t_hit.assign(ray_count, -1);
+        stage_timer trace_timer;
+        hit_record rec;
+        for (int k = 0; k < ray_count; k++) {
+            point3 from(extent * (2 * random_double(ray_rng) - 1), 20, extent * (2 * random_double(ray_rng) - 1));
+            point3 to(extent * (2 * random_double(ray_rng) - 1), 0, extent * (2 * random_double(ray_rng) - 1));
+            if (target.hit(ray(from, to - from), interval(0.001, infinity), rec))
+                t_hit[k] = rec.t;
+        }
+        double seconds = 0;
+        trace_timer.lap(seconds);
+        return seconds;
+    };
+    std::vector<double> instanced_t;
+    double trace_seconds = trace(*bvh, instanced_t);
+
+    const size_t prototype_size = prototype_scene.sphere_count();
+    std::cout << count << " instances of " << prototype_size << " spheres (" << double(count) * prototype_size
+        << " spheres in the scene)\n"
+        << "  instance object " << sizeof(instance) << " bytes (+ " << 2 * sizeof(shared_ptr<hittable>)
+        << " bytes of references in the list and the bvh), placed in " << place_seconds * 1000 << " ms\n"
+        << "  bvh " << stats.node_count << " nodes, built in " << build_seconds * 1000 << " ms\n"
+        << "  " << ray_count << " rays in " << trace_seconds * 1000 << " ms, "
+        << ray_count / trace_seconds / 1e6 << " Mrays/s\n";
+
+    // 实例不多时，把所有球按同样的变换直接展开成一个普通场景(等比缩放下球还是球)，
+    // 用同一组光线比较：击中的t应该和实例的一样，耗时的差别就是实例多出来的开销
+    if (size_t(count) * prototype_size <= 2000000) {
+        scene_data flat;
+        flat.materials = prototype_scene.materials;
+        for (int k = 0; k < count; k++)
+            for (size_t q = 0; q < prototype_size; q++) {
+                point3 c = placements[k].apply_point(point3(prototype_scene.cx[q], prototype_scene.cy[q], prototype_scene.cz[q]));
+                flat.add_sphere(c, scales[k] * prototype_scene.radius[q], prototype_scene.material[q]);
+            }
+        flat.add_sphere(point3(0, -1000, 0), 1000, flat.add_lambertian(color(0.5, 0.5, 0.5)));
+        material_table flat_materials;
+        hittable_list flat_world;
+        build_scene_world(flat, flat_materials, flat_world);
+        bvh_node flat_bvh(flat_world);
+        std::vector<double> flat_t;
+        double flat_seconds = trace(flat_bvh, flat_t);
+        int mismatched = 0;
+        for (int k = 0; k < ray_count; k++)
+            if (std::fabs(instanced_t[k] - flat_t[k]) > 1e-6 * std::fmax(1.0, std::fabs(flat_t[k])))
+                mismatched++;
+        std::cout << "  flattened: " << ray_count / flat_seconds / 1e6 << " Mrays/s, instancing costs "
+            << 100 * (trace_seconds / flat_seconds - 1) << "% more time, " << mismatched << " rays hit differently\n";
+    }
+
+    if (!image_path.empty()) {
+        camera_rt2 cam;
+        cam.aspect_ratio = 16.0 / 9.0;
+        cam.image_width = 400;
+        cam.samples_per_pixel = 16;
+        cam.max_depth = 8;
+        cam.vfov = 30;
+        cam.lookfrom = point3(0, 4 + 0.8 * side, 2.0 * side + 6);
+        cam.lookat = point3(0, 0, 0);
+        cam.thread_count = 0;
+        cam.output_format = image_format_from_path(image_path);
+        hittable_list scene(bvh);
+        framebuffer image = cam.render_image(scene);
+        if (!write_image(image, cam.output_format, image_path))
+            return 1;
+    }
+    return 0;
+}
+
+// mesh命令：读取OBJ，建成一个triangle_mesh，从包围球上随机射向包围盒里的光线测求交速度
+static int mesh_command(const std::string& path, const std::string& image_path) {
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    std::string error;
+    obj_load_stats load;
+    if (!load_obj(path, positions, indices, error, 0, &load)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    material_table materials;
+    const material* mat = materials.add<lambertian>(color(0.7, 0.5, 0.3));
+    auto mesh = make_shared<triangle_mesh>(std::move(positions), std::move(indices), mat, 0);
+    const bvh_stats& stats = mesh->stats();
+    const size_t triangles = mesh->triangle_count();
+    double load_ms = load.map_ms + load.count_ms + load.parse_ms;
+    std::cout << path << ": " << load.vertex_count << " vertices, " << triangles << " triangles\n"
+        << "  load " << load_ms << " ms with " << load.thread_count << " threads (map " << load.map_ms << ", count "
+        << load.count_ms << ", parse " << load.parse_ms << "), " << load.bytes / 1e6 / (load_ms / 1000) << " MB/s\n"
+        << "  bvh " << stats.node_count << " nodes, depth " << stats.max_depth << ", built in " << stats.build_ms
+        << " ms\n"
+        << "  " << mesh->memory_bytes() << " bytes, " << double(mesh->memory_bytes()) / std::max<size_t>(triangles, 1)
+        << " bytes per triangle\n";
+    if (triangles == 0)
+        return 0;
+
+    aabb box = mesh->bounding_box();
+    point3 center = box.centroid();
+    vec3 half(0.5 * box.x.size(), 0.5 * box.y.size(), 0.5 * box.z.size());
+    rng_state rng;
+    rng.seed(0x3e5);
+    const int ray_count = 1 << 18;
+    std::vector<ray> rays;
+    rays.reserve(ray_count);
+    for (int k = 0; k < ray_count; k++) {
+        point3 from = center + 3 * half.length() * sample_unit_sphere(random_double(rng), random_double(rng));
+        point3 to = center + vec3(half.x() * (2 * random_double(rng) - 1), half.y() * (2 * random_double(rng) - 1),
+            half.z() * (2 * random_double(rng) - 1));
+        rays.push_back(ray(from, to - from));
+    }
+    stage_timer timer;
+    size_t hits = 0;
+    hit_record rec;
+    for (const ray& r : rays)
+        hits += mesh->hit(r, interval(0.001, infinity), rec);
+    double trace_seconds = 0;
+    timer.lap(trace_seconds);
+    std::cout << "  " << ray_count << " rays in " << trace_seconds * 1000 << " ms, " << ray_count / trace_seconds / 1e6
+        << " Mrays/s, " << hits << " hit\n";
+
+    if (!image_path.empty()) {
+        camera_rt2 cam;
+        cam.aspect_ratio = 1;
+        cam.image_width = 400;
+        cam.samples_per_pixel = 16;
+        cam.max_depth = 8;
+        cam.vfov = 40;
+        cam.lookfrom = center + 2.5 * half.length() * unit_vector(vec3(1, 0.6, 1.4));
+        cam.lookat = center;
+        cam.thread_count = 0;
+        cam.output_format = image_format_from_path(image_path);
+        hittable_list scene(mesh);
+        framebuffer image = cam.render_image(scene);
+        if (!write_image(image, cam.output_format, image_path))
+            return 1;
+    }
+    return 0;
+}
+
+// arena命令里一种做法的计时，单位毫秒，多次运行取最小值
+struct arena_timing {
+    double build_ms = infinity, bvh_ms = infinity, trace_ms = infinity, teardown_ms = infinity;
+    uint64_t cache_misses = 0, l1d_misses = 0;
+    size_t hits = 0;
+    size_t blocks = 0;
+};
+
+// arena命令：per_object为true时每个球单独一个sphere、每个材质单独一个对象，材质在第一次被球用到时创建
+// (main_16原来逐个make_shared的写法，球和材质在堆上交错)；为false时用build_scene_world按sphere_set分组
+static arena_timing measure_scene_memory(const scene_data& scene, const std::vector<ray>& rays, bool per_object,
+    bool use_arena) {
+    // 成员按声明的相反顺序析构：先BVH和列表，再arena里的物体，最后材质
+    struct built_scene {
+        material_table materials;
+        scene_arena arena;
+        hittable_list world;
+        shared_ptr<hittable> bvh;
+    };
+    arena_timing result;
+    stage_timer timer;
+    double build_seconds = 0, bvh_seconds = 0, trace_seconds = 0, teardown_seconds = 0;
+    auto built = std::make_unique<built_scene>();
+    scene_arena* arena = use_arena ? &built->arena : nullptr;
+    if (per_object) {
+        std::vector<shared_ptr<material>> owned(scene.materials.size());
+        std::vector<const material*> mats(scene.materials.size(), nullptr);
+        for (size_t k = 0; k < scene.sphere_count(); k++) {
+            uint32_t m = scene.material[k];
+            if (!mats[m]) {
+                const scene_material& sm = scene.materials[m];
+                color albedo(sm.params[0], sm.params[1], sm.params[2]);
+                switch (scene_material_type(sm.type)) {
+                case scene_material_type::metal: owned[m] = make_shared_in<metal>(arena, albedo, sm.params[3]); break;
+                case scene_material_type::dielectric: owned[m] = make_shared_in<dielectric>(arena, sm.params[0]); break;
+                default: owned[m] = make_shared_in<lambertian>(arena, albedo); break;
+                }
+                mats[m] = owned[m].get();
+            }
+            point3 center(scene.cx[k], scene.cy[k], scene.cz[k]);
+            if (use_arena)
+                built->world.add(built->arena.make_shared<sphere>(center, scene.radius[k], mats[m], int(k)));
+            else
+                built->world.add(make_shared<sphere>(center, scene.radius[k], owned[m]));
+        }
+    }
+    else if (use_arena)
+        build_scene_world(scene, built->materials, built->world, built->arena);
+    else
+        build_scene_world(scene, built->materials, built->world);
+    timer.lap(build_seconds);
+    built->bvh = make_shared_in<bvh_node>(arena, built->world);
+    timer.lap(bvh_seconds);
+    result.blocks = built->arena.block_count();
+
+    perf_counter misses(perf_counter::event::cache_misses), l1d(perf_counter::event::l1d_read_misses);
+    misses.start();
+    l1d.start();
+    double counter_setup_seconds = 0;
+    timer.lap(counter_setup_seconds);
+    hit_record rec;
+    for (const ray& r : rays)
+        result.hits += built->bvh->hit(r, interval(0.001, infinity), rec);
+    timer.lap(trace_seconds);
+    result.l1d_misses = l1d.stop();
+    result.cache_misses = misses.stop();
+
+    built.reset();
+    timer.lap(teardown_seconds);
+    result.build_ms = build_seconds * 1000;
+    result.bvh_ms = bvh_seconds * 1000;
+    result.trace_ms = trace_seconds * 1000;
+    result.teardown_ms = teardown_seconds * 1000;
+    return result;
+}
+
+static int arena_command(int half_extent) {
+    scene_data scene = random_spheres_scene(half_extent);
+    rng_state rng;
+    rng.seed(0xa7e);
+    std::vector<ray> rays;
+    const double extent = half_extent + 1;
+    for (int k = 0; k < (1 << 18); k++) {
+        point3 from(extent * (2 * random_double(rng) - 1), 3, extent * (2 * random_double(rng) - 1));
+        point3 to(extent * (2 * random_double(rng) - 1), 0, extent * (2 * random_double(rng) - 1));
+        rays.push_back(ray(from, to - from));
+    }
+    const bool counters = perf_counter(perf_counter::event::cache_misses).valid();
+    std::cout << scene.sphere_count() << " spheres, " << scene.materials.size() << " materials, " << rays.size()
+        << " rays" << (counters ? "" : " (hardware cache counters unavailable)") << "\n";
+    std::printf("%-10s %-12s %10s %10s %10s %12s %14s %14s %8s\n", "layout", "allocation", "build ms", "bvh ms",
+        "trace ms", "teardown ms", "llc miss/ray", "l1d miss/ray", "blocks");
+    for (bool per_object : { true, false }) {
+        arena_timing best[2];
+        // 两种做法交替跑几遍，各项取最小值，减少堆的状态和其他进程的干扰
+        for (int repeat = 0; repeat < 3; repeat++)
+            for (int use_arena = 0; use_arena < 2; use_arena++) {
+                arena_timing t = measure_scene_memory(scene, rays, per_object, use_arena != 0);
+                arena_timing& b = best[use_arena];
+                b.build_ms = std::fmin(b.build_ms, t.build_ms);
+                b.bvh_ms = std::fmin(b.bvh_ms, t.bvh_ms);
+                b.teardown_ms = std::fmin(b.teardown_ms, t.teardown_ms);
+                if (t.trace_ms < b.trace_ms) {
+                    b.trace_ms = t.trace_ms;
+                    b.cache_misses = t.cache_misses;
+                    b.l1d_misses = t.l1d_misses;
+                }
+                b.hits = t.hits;
+                b.blocks = t.blocks;
+            }
+        if (best[0].hits != best[1].hits)
+            std::cerr << "warning: hit counts differ (" << best[0].hits << " vs " << best[1].hits << ")\n";
+        for (int use_arena = 0; use_arena < 2; use_arena++) {
+            const arena_timing& b = best[use_arena];
+            char llc[32] = "n/a", l1[32] = "n/a";
+            if (counters) {
+                std::snprintf(llc, sizeof(llc), "%.2f", double(b.cache_misses) / rays.size());
+                std::snprintf(l1, sizeof(l1), "%.2f", double(b.l1d_misses) / rays.size());
+            }
+            std::printf("%-10s %-12s %10.2f %10.2f %10.2f %12.2f %14s %14s %8zu\n", per_object ? "per-object" : "grouped",
+                use_arena ? "scene_arena" : "make_shared", b.build_ms, b.bvh_ms, b.trace_ms, b.teardown_ms, llc, l1,
+                b.blocks);
+        }
+    }
+    return 0;
+}
+
+// 几个函数交替各调用trials次，best[i]是第i个函数单次调用的最短耗时(毫秒)，交替调用减少其他进程和频率变化的干扰
+template <class... Fns>
+static void best_of(int trials, double* best, Fns&&... fns) {
+    std::function<void()> list[] = { fns... };
+    for (size_t v = 0; v < sizeof...(Fns); v++)
+        best[v] = infinity;
+    for (int t = 0; t < trials; t++)
+        for (size_t v = 0; v < sizeof...(Fns); v++) {
+            stage_timer timer;
+            double seconds = 0;
+            list[v]();
+            timer.lap(seconds);
+            best[v] = std::fmin(best[v], seconds * 1000);
+        }
+}
+
+// sort命令：随机小球场景(每个球一个材质)，波前式引擎的排序阶段
+// 先取一批弹射过一次的光线(和渲染时一样：一个图像块的每个像素若干个采样)，分别测各阶段排序前后的耗时，
+// 再整张图用四种排序组合各渲染几遍，取最短的耗时；排序不改变结果，顺便检查四种组合的图像完全一样
+static int sort_command(int half_extent) {
+    scene_data scene = random_spheres_scene(half_extent);
+    material_table materials;
+    scene_arena arena;
+    hittable_list world;
+    build_scene_world(scene, materials, world, arena);
+    world = hittable_list(arena.make_shared<bvh_node>(world));
+    std::cout << scene.sphere_count() << " spheres, " << scene.materials.size() << " materials\n";
+
+    camera_rt2 cam;
+    apply_scene_camera(scene.camera, cam);
+    cam.image_width = 300;
+    cam.samples_per_pixel = 16;
+    cam.thread_count = 1;
+    cam.engine = render_engine::wavefront;
+    cam.prepare();
+
+    // 图像中间32x32的块，每个像素8个采样，和wavefront_batch默认的8192条路径一样多
+    wavefront_queue q;
+    const int image_height = std::max(1, int(cam.image_width / cam.aspect_ratio));
+    const int x0 = std::max(0, cam.image_width / 2 - 16), y0 = std::max(0, image_height / 2 - 16);
+    for (int p = 0; p < 32 * 32; p++)
+        for (int s = 0; s < 8; s++) {
+            ray r = cam.primary_ray(x0 + p % 32, y0 + p / 32);
+            hit_record rec;
+            color attenuation;
+            ray scattered;
+            if (world.hit(r, interval(0.001, infinity), rec)
+                && scatter_material(*rec.mat, r, rec, attenuation, scattered, thread_rng(), dispatch_mode::closed_set))
+                q.paths.push_back({ scattered, attenuation, 0, 0, uint32_t(s), uint32_t(q.paths.size()) });
+        }
+    const size_t n = q.paths.size();
+    wavefront_identity_order(q);
+    wavefront_intersect(world, q);
+    const std::vector<uint32_t> unsorted = q.order;
+    size_t sink = 0;
+    auto shade = [&]() {
+        for (uint32_t k : q.order) {
+            color attenuation;
+            ray scattered;
+            if (q.did_hit[k])
+                sink += scatter_material(*q.hits[k].mat, q.paths[k].r, q.hits[k], attenuation, scattered,
+                    thread_rng(), dispatch_mode::closed_set);
+        }
+    };
+    double best[6];
+    best_of(40, best,
+        [&]() { q.order = unsorted; wavefront_intersect(world, q); },
+        [&]() { wavefront_sort_rays(q); },
+        [&]() { wavefront_sort_rays(q); wavefront_intersect(world, q); },
+        [&]() { q.order = unsorted; shade(); },
+        [&]() { q.order = unsorted; wavefront_sort_by_material(q); },
+        [&]() { q.order = unsorted; wavefront_sort_by_material(q); shade(); });
+    std::printf("%zu secondary rays in one batch, ns per ray (best of 40):\n", n);
+    std::printf("  intersect %8.1f   sort rays %6.1f   sort + intersect %8.1f\n",
+        best[0] * 1e6 / n, best[1] * 1e6 / n, best[2] * 1e6 / n);
+    std::printf("  scatter   %8.1f   sort mats %6.1f   sort + scatter   %8.1f\n",
+        best[3] * 1e6 / n, best[4] * 1e6 / n, best[5] * 1e6 / n);
+    do_not_optimize(sink);
+
+    const char* names[] = { "none", "rays", "materials", "rays+materials" };
+    framebuffer images[4];
+    auto render = [&](int v) {
+        cam.sort_secondary_rays = (v & 1) != 0;
+        cam.sort_by_material = (v & 2) != 0;
+        images[v] = cam.render_image(world);
+    };
+    double render_ms[4];
+    best_of(7, render_ms, [&]() { render(0); }, [&]() { render(1); }, [&]() { render(2); }, [&]() { render(3); });
+    std::printf("%-16s %10s %8s %10s\n", "sort", "render ms", "speedup", "identical");
+    const std::vector<color>& reference = images[0].data();
+    for (int v = 0; v < 4; v++) {
+        bool identical = images[v].data().size() == reference.size()
+            && std::memcmp(images[v].data().data(), reference.data(), reference.size() * sizeof(color)) == 0;
+        std::printf("%-16s %10.1f %8.3f %10s\n", names[v], render_ms[v], render_ms[0] / render_ms[v],
+            identical ? "yes" : "NO");
+    }
+    return 0;
+}
+
+// check命令：每个坏输入都应该解析失败，好的输入应该能读回来
+static int check_command() {
+    scene_data good;
+    uint32_t mat = good.add_lambertian(color(0.5, 0.5, 0.5));
+    good.add_sphere(point3(0, 0, 0), 1, mat);
+    good.add_sphere(point3(2, 0, 0), 0.5, mat);
+    std::ostringstream stream;
+    write_scene_binary(good, stream);
+    const std::string bytes = stream.str();
+
+    // 改文件头里的个数
+    auto with_counts = [&](uint32_t materials, uint64_t spheres) {
+        std::string out = bytes;
+        scene_binary_header header;
+        std::memcpy(&header, out.data(), sizeof(header));
+        header.material_count = materials;
+        header.sphere_count = spheres;
+        std::memcpy(&out[0], &header, sizeof(header));
+        return out;
+    };
+    std::string bad_index = bytes;
+    const uint32_t missing_material = 7;
+    std::memcpy(&bad_index[bad_index.size() - sizeof(uint32_t)], &missing_material, sizeof(uint32_t));
+    // 材质数组紧跟在文件头后面，第一个字段是类型
+    std::string bad_type = bytes;
+    const uint32_t unknown_type = 3;
+    std::memcpy(&bad_type[sizeof(scene_binary_header)], &unknown_type, sizeof(uint32_t));
+
+    struct binary_case {
+        const char* name;
+        std::string data;
+        bool valid;
+    };
+    const binary_case binary_cases[] = {
+        { "valid", bytes, true },
+        { "truncated header", bytes.substr(0, sizeof(scene_binary_header) - 1), false },
+        { "truncated data", bytes.substr(0, bytes.size() - 1), false },
+        // 36 * (2^64 / 36 + 1)在64位下溢出成一个很小的数
+        { "sphere count overflow", with_counts(1, UINT64_MAX / 36 + 1), false },
+        { "sphere count too large", with_counts(1, UINT64_MAX), false },
+        { "material count too large", with_counts(UINT32_MAX, 2), false },
+        { "material index out of range", bad_index, false },
+        { "unknown material type", bad_type, false },
+    };
+    struct text_case {
+        const char* name;
+        const char* data;
+        bool valid;
+    };
+    const text_case text_cases[] = {
+        { "valid", "image_width 400\nsamples_per_pixel 16\nmax_depth 10\n", true },
+        { "width too large", "image_width 1e12\n", false },
+        { "width not an integer", "image_width 400.5\n", false },
+        { "width zero", "image_width 0\n", false },
+        { "width nan", "image_width nan\n", false },
+        { "depth above int32", "max_depth 2147483648\n", false },
+        { "unknown material", "sphere 0 0 0 1 missing\n", false },
+    };
+
+    int failures = 0;
+    auto report = [&](const char* format, const char* name, bool ok, bool valid, const std::string& error) {
+        bool pass = ok == valid;
+        failures += pass ? 0 : 1;
+        std::printf("%-7s %-30s %-5s %s\n", format, name, pass ? "ok" : "FAIL", ok ? "loaded" : error.c_str());
+    };
+    for (const binary_case& c : binary_cases) {
+        scene_data scene;
+        std::string error;
+        bool ok = parse_scene_binary(c.data.data(), c.data.size(), scene, error);
+        if (ok && c.valid)
+            ok = scene.sphere_count() == good.sphere_count() && scene.cx == good.cx && scene.radius == good.radius;
+        report("binary", c.name, ok, c.valid, error);
+    }
+    for (const text_case& c : text_cases) {
+        scene_data scene;
+        std::string error;
+        bool ok = parse_scene_text(c.data, std::strlen(c.data), scene, error);
+        report("text", c.name, ok, c.valid, error);
+    }
+    // 三角形网格：越界的下标和不完整的三角形在构造时丢掉，剩下的正常求交
+    {
+        std::vector<float> positions = { 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+        std::vector<uint32_t> indices = { 0, 1, 2, 0, 1, 3, 2, 1, 0xffffffffu, 0, 1 };
+        lambertian mat(color(0.5, 0.5, 0.5));
+        triangle_mesh mesh(positions, indices, &mat);
+        hit_record rec;
+        bool ok = mesh.triangle_count() == 1 && mesh.dropped_triangle_count() == 2
+            && mesh.hit(ray(point3(0.25, 0.25, 1), vec3(0, 0, -1)), interval(0.001, infinity), rec);
+        report("mesh", "out-of-range indices", ok, true,
+            std::to_string(mesh.triangle_count()) + " kept, " + std::to_string(mesh.dropped_triangle_count()) + " dropped");
+    }
+    std::printf("%d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "random" && argc == 4) {
+        int half_extent = std::max(1, std::atoi(argv[2]));
+        scene_data scene = random_spheres_scene(half_extent);
+        if (!save_scene(argv[3], scene))
+            return 1;
+        std::clog << "Wrote " << scene.sphere_count() << " spheres, " << scene.materials.size()
+            << " materials to " << argv[3] << "\n";
+        return 0;
+    }
+    if (command == "convert" && argc == 4) {
+        scene_data scene;
+        std::string error;
+        if (!load_scene(argv[2], scene, error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        return save_scene(argv[3], scene) ? 0 : 1;
+    }
+    if (command == "info" && argc == 3) {
+        scene_data scene;
+        std::string error;
+        stage_timer timer;
+        double load_seconds = 0, build_seconds = 0;
+        if (!load_scene(argv[2], scene, error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        timer.lap(load_seconds);
+        material_table materials;
+        hittable_list world;
+        build_scene_world(scene, materials, world);
+        timer.lap(build_seconds);
+        std::cout << argv[2] << ": " << scene.sphere_count() << " spheres, " << scene.materials.size()
+            << " materials, camera " << scene.camera.image_width << " px wide, "
+            << scene.camera.samples_per_pixel << " spp\n"
+            << "  load " << load_seconds * 1000 << " ms, build " << world.objects.size()
+            << " objects in " << build_seconds * 1000 << " ms\n";
+        return 0;
+    }
+    if (command == "instances" && (argc == 3 || argc == 4))
+        return instances_command(std::max(1, std::atoi(argv[2])), argc == 4 ? argv[3] : "");
+    if (command == "obj" && argc == 4) {
+        std::vector<float> positions;
+        std::vector<uint32_t> indices;
+        bumpy_sphere_mesh(std::max(2, std::atoi(argv[2])), positions, indices);
+        if (!save_obj(argv[3], positions, indices))
+            return 1;
+        std::clog << "Wrote " << positions.size() / 3 << " vertices, " << indices.size() / 3 << " triangles to "
+            << argv[3] << "\n";
+        return 0;
+    }
+    if (command == "arena" && argc == 3)
+        return arena_command(std::max(1, std::atoi(argv[2])));
+    if (command == "sort" && argc == 3)
+        return sort_command(std::max(1, std::atoi(argv[2])));
+    if (command == "mesh" && (argc == 3 || argc == 4))
+        return mesh_command(argv[2], argc == 4 ? argv[3] : "");
+    if (command == "check" && argc == 2)
+        return check_command();
+    std::cerr << "Usage: " << argv[0] << " random <half_extent> <out>\n"
+        << "       " << argv[0] << " convert <in> <out>\n"
+        << "       " << argv[0] << " info <in>\n"
+        << "       " << argv[0] << " instances <count> [image]\n"
+        << "       " << argv[0] << " obj <segments> <out.obj>\n"
+        << "       " << argv[0] << " mesh <in.obj> [image]\n"
+        << "       " << argv[0] << " arena <half_extent>\n"
+        << "       " << argv[0] << " sort <half_extent>\n"
+        << "       " << argv[0] << " check\n";
+    return 1;
+}